@@ -1,15 +1,256 @@
 #pragma once
 
+#include <cstdint>
+#include <memory>
+#include <string>
 #include <unordered_map>
+#include <vector>
 
 #include "types.hpp"
 
 namespace route_finder
 {
 
-bool is_valid_assignment(const Student &student, const Centre &centre);
-void run_batch_greedy_allotment();
+// Tier order is allotment priority: male first, then PwD, then female.
+enum StudentTier : std::uint8_t
+{
+    kTierMale = 0,
+    kTierPwd = 1,
+    kTierFemale = 2,
+    kTierCount = 3
+};
 
-} // namespace route_finder
+// Index of the lowest set bit of a non-zero word. A de Bruijn multiply
+// instead of __builtin_ctzll, which MSVC does not have.
+inline int lowest_set_bit(std::uint64_t bits)
+{
+    static constexpr int kBitIndex[64] = {
+        0, 1, 48, 2, 57, 49, 28, 3, 61, 58, 50, 42, 38, 29, 17, 4,
+        62, 55, 59, 36, 53, 51, 43, 22, 45, 39, 33, 30, 24, 18, 12, 5,
+        63, 47, 56, 27, 60, 41, 37, 16, 54, 35, 52, 21, 44, 32, 23, 11,
+        46, 26, 40, 15, 34, 20, 31, 10, 25, 14, 19, 9, 13, 8, 7, 6};
+    return kBitIndex[((bits & (~bits + 1)) * 0x03f79d71b4cb0a89ULL) >> 58];
+}
+
+// Centres each tier may use, as one bitmask per tier built once per run.
+// A tier no rule restricts is flagged unrestricted and skips the bit tests.
+struct CentreEligibility
+{
+    std::vector<std::uint64_t> words[kTierCount];
+    bool unrestricted[kTierCount] = {true, true, true};
+
+    bool allows(int tier, int centre) const
+    {
+        return unrestricted[tier] || ((words[tier][centre >> 6] >> (centre & 63)) & 1u);
+    }
+
+    // Calls fn(centre) for every centre the tier may use, in index order.
+    template <typename Fn>
+    void for_each(int tier, int centre_count, Fn &&fn) const
+    {
+        if (unrestricted[tier])
+        {
+            for (int centre = 0; centre < centre_count; centre++)
+            {
+                fn(centre);
+            }
+            return;
+        }
+        for (size_t w = 0; w < words[tier].size(); w++)
+        {
+            for (std::uint64_t bits = words[tier][w]; bits != 0; bits &= bits - 1)
+            {
+                fn(static_cast<int>(w * 64 + lowest_set_bit(bits)));
+            }
+        }
+    }
+
+    int count(int tier, int centre_count) const
+    {
+        if (unrestricted[tier])
+        {
+            return centre_count;
+        }
+        int total = 0;
+        for (std::uint64_t bits : words[tier])
+        {
+            for (; bits != 0; bits &= bits - 1)
+            {
+                total++;
+            }
+        }
+        return total;
+    }
+};
+
+// Read-only input of one allotment run, on dense student/centre indices.
+// Students snapped to the same node share one row of distance_rows; the
+// rows are shared between copies, so scenario variants only copy the
+// small per-centre and per-student vectors.
+struct AllotmentProblem
+{
+    int centre_count{};
+    std::vector<std::uint8_t> student_tier;
+    std::vector<int> student_row;
+    std::shared_ptr<const std::vector<double>> distance_rows = std::make_shared<std::vector<double>>();
+    std::vector<int> capacity;
+    CentreEligibility eligibility;
+    // Nearest centre of each row's node from the network Voronoi partition
+    // (-1 = none); empty when no partition matches the centres.
+    std::vector<int> row_nearest;
+
+    int student_count() const { return static_cast<int>(student_tier.size()); }
+
+    bool eligible(int student, int centre) const { return eligibility.allows(student_tier[student], centre); }
+
+    const double *row(int student) const
+    {
+        const int r = student_row[student];
+        return r < 0 ? nullptr : distance_rows->data() + static_cast<size_t>(r) * centre_count;
+    }
+
+    int row_count() const { return centre_count > 0 ? static_cast<int>(distance_rows->size() / centre_count) : 0; }
+};
+
+struct AllotmentResult
+{
+    std::vector<int> centre_of_student;
+    std::vector<int> centre_load;
+    int assigned_count{};
+    int prepass_assigned{};
+    size_t peak_candidate_bytes{};
+};
+
+enum class AllotmentSolver
+{
+    Greedy,
+    MinCostFlow,
+    Auction,
+    Bottleneck
+};
+
+struct AllotmentOptions
+{
+    AllotmentSolver solver = AllotmentSolver::Greedy;
 
+    // Lazy mode keeps one heap entry per student and pulls the next centre
+    // only when the current one fills; eager mode pushes every reachable pair.
+    bool lazy_candidates = true;
 
+    // Greedy only: before the tiered pass, seat every student at its
+    // Voronoi-nearest centre wherever that centre's whole cell fits.
+    bool voronoi_prepass = false;
+
+    // Auction solver: final bid increment in seconds (the result is within
+    // students * epsilon of optimal per tier) and worker threads (0 = auto).
+    double auction_epsilon = 0.01;
+    unsigned threads = 0;
+
+    EligibilityRules rules;
+};
+
+struct AuctionStats
+{
+    int phases{};
+    long long rounds{};
+    long long bids{};
+    double final_epsilon{};
+    double gap_bound_sec{};
+    unsigned threads{};
+};
+
+struct BottleneckStats
+{
+    int probes{};
+    int distinct_thresholds{};
+    double threshold_sec{};
+    int tier_targets[kTierCount]{};
+};
+
+// Per-run report. solve_allotment fills in the solver that ran; the greedy
+// figures are the baseline that run_allotment always adds.
+struct AllotmentSummary
+{
+    std::string solver;
+    int assigned{};
+    double travel_time{};
+    double max_travel_time{};
+    double solve_ms{};
+    int prepass_assigned{};
+    int greedy_assigned{};
+    double greedy_travel_time{};
+    double greedy_max_travel_time{};
+    double greedy_ms{};
+    int eligible_centres[kTierCount]{};
+    int ineligible_students{};
+    AuctionStats auction;
+    BottleneckStats bottleneck;
+};
+
+// One what-if variant for /scenarios: capacity overrides and closed centres
+// applied to the current students and centres without touching them.
+struct AllotmentScenario
+{
+    std::string name;
+    AllotmentOptions options;
+    std::vector<std::pair<std::string, int>> capacity_changes;
+    std::vector<std::string> closed_centres;
+};
+
+struct ScenarioOutcome
+{
+    std::string name;
+    AllotmentSummary summary;
+    int open_centres{};
+    int seats{};
+    int full_centres{};
+    std::vector<std::string> unknown_centres;
+};
+
+// Changes applied on top of the current allotment by /allotment/delta.
+// Added and moved students arrive already snapped.
+struct AllotmentDelta
+{
+    std::vector<Student> added;
+    std::vector<Student> moved;
+    std::vector<std::string> removed;
+    std::vector<std::pair<std::string, int>> capacity_changes;
+    int max_cascade = 3;
+};
+
+struct AllotmentDeltaStats
+{
+    int added{};
+    int removed{};
+    int moved{};
+    int capacity_changes{};
+    int evictions{};
+    int relocations{};
+    int cascade_limit_hits{};
+    std::vector<std::string> unknown_students;
+    std::vector<std::string> unknown_centres;
+    std::vector<std::string> changed_students;
+};
+
+std::uint8_t tier_of_category(const std::string &category);
+bool centre_accepts_tier(const Centre &centre, std::uint8_t tier, const EligibilityRules &rules);
+bool is_valid_assignment(const Student &student, const Centre &centre, const EligibilityRules &rules = {});
+CentreEligibility build_centre_eligibility(const std::vector<Centre> &centre_list, const EligibilityRules &rules);
+
+AllotmentProblem build_allotment_problem(const GraphSnapshot &snapshot, const EligibilityRules &rules = {});
+AllotmentResult solve_greedy_allotment(const AllotmentProblem &problem, const AllotmentOptions &options = {});
+AllotmentResult solve_min_cost_flow_allotment(const AllotmentProblem &problem);
+AllotmentResult solve_auction_allotment(const AllotmentProblem &problem, const AllotmentOptions &options, AuctionStats &stats);
+AllotmentResult solve_bottleneck_allotment(const AllotmentProblem &problem, BottleneckStats &stats);
+double total_travel_time(const AllotmentProblem &problem, const AllotmentResult &result);
+double max_travel_time(const AllotmentProblem &problem, const AllotmentResult &result);
+AllotmentResult solve_allotment(const AllotmentProblem &problem, const AllotmentOptions &options, AllotmentSummary &summary);
+AllotmentSummary run_allotment(const GraphSnapshot &snapshot, const AllotmentOptions &options = {});
+std::vector<ScenarioOutcome> run_scenarios(const GraphSnapshot &snapshot, const std::vector<AllotmentScenario> &scenarios, unsigned threads = 0);
+AllotmentDeltaStats apply_allotment_delta(const GraphSnapshot &snapshot, const AllotmentDelta &delta);
+// Recomputes allotment_quality from scratch for the current students and
+// assignments; the engine calls it after a full run, diagnostics when the
+// figures were invalidated (e.g. a delta that could not track them).
+void rebuild_allotment_quality(const GraphSnapshot &snapshot);
+
+} // namespace route_finder
@@ -1,9 +1,13 @@
 #pragma once
 
+#include <cstddef>
+
 namespace route_finder
 {
 
 double haversine(double lat1, double lon1, double lat2, double lon2);
+void haversine_batch(const double *lat1, const double *lon1, const double *lat2, const double *lon2,
+                     double *out_metres, std::size_t count);
 
 } // namespace route_finder
 
@@ -8,9 +8,20 @@
 namespace route_finder
 {
 
-void build_graph_from_overpass(const nlohmann::json &osm_data);
-void generate_simulated_graph_fallback(double min_lat, double min_lon, double max_lat, double max_lon);
-void build_allotment_lookup();
+HighwayClass parse_highway_class(const std::string &highway_type);
+double default_speed_kmh(HighwayClass highway_class);
+bool highway_class_in_detail(HighwayClass highway_class, const std::string &graph_detail);
+bool graph_detail_covers(const std::string &loaded_detail, const std::string &requested_detail);
+
+// Build steps fill a draft snapshot that nobody else can see yet; the caller
+// publishes it once every step has run.
+void build_graph_from_overpass(GraphSnapshot &draft, const nlohmann::json &osm_data, const std::string &source_detail = "high");
+void apply_graph_detail(GraphSnapshot &draft, const std::string &graph_detail);
+TopologySimplificationStats simplify_graph_topology(GraphSnapshot &draft);
+RoiPruningStats prune_graph_to_region(GraphSnapshot &draft, const RegionOfInterest &roi);
+void build_dense_graph(GraphSnapshot &draft);
+void generate_simulated_graph_fallback(GraphSnapshot &draft, double min_lat, double min_lon, double max_lat, double max_lon);
+void build_allotment_lookup(GraphSnapshot &draft, bool keep_path_trees = true);
 
 } // namespace route_finder
 
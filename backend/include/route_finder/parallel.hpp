@@ -0,0 +1,220 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace route_finder
+{
+
+// Number of workers worth starting for `work_items` items when each worker
+// should get at least `min_items_per_worker` of them.
+inline unsigned worker_count(std::size_t work_items, std::size_t min_items_per_worker = 1)
+{
+    const unsigned hardware = std::max(1u, std::thread::hardware_concurrency());
+    const std::size_t useful = std::max<std::size_t>(1, work_items / std::max<std::size_t>(1, min_items_per_worker));
+    return static_cast<unsigned>(std::min<std::size_t>(hardware, useful));
+}
+
+// Splits [0, count) into `workers` contiguous ranges and calls
+// fn(worker, begin, end) for each on its own thread. Worker 0 runs on the
+// calling thread. If any range throws, every thread is still joined and the
+// first exception (by worker) is rethrown on the calling thread; escaping a
+// std::thread would terminate the server instead.
+template <typename Fn>
+void parallel_for_ranges(std::size_t count, unsigned workers, Fn &&fn)
+{
+    workers = std::max(1u, workers);
+    const std::size_t chunk = (count + workers - 1) / workers;
+
+    std::vector<std::exception_ptr> errors(workers);
+    const auto run = [&fn, &errors](unsigned worker, std::size_t begin, std::size_t end)
+    {
+        try
+        {
+            fn(worker, begin, end);
+        }
+        catch (...)
+        {
+            errors[worker] = std::current_exception();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    std::exception_ptr spawn_error;
+    try
+    {
+        threads.reserve(workers - 1);
+        for (unsigned worker = 1; worker < workers; worker++)
+        {
+            const std::size_t begin = std::min(count, worker * chunk);
+            const std::size_t end = std::min(count, begin + chunk);
+            threads.emplace_back([&run, worker, begin, end]()
+                                 { run(worker, begin, end); });
+        }
+    }
+    catch (...)
+    {
+        spawn_error = std::current_exception();
+    }
+
+    if (!spawn_error)
+    {
+        run(0u, std::size_t{0}, std::min(count, chunk));
+    }
+
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+
+    if (spawn_error)
+    {
+        std::rethrow_exception(spawn_error);
+    }
+    for (const auto &error : errors)
+    {
+        if (error)
+        {
+            std::rethrow_exception(error);
+        }
+    }
+}
+
+// Fixed set of threads for algorithms that run many short parallel rounds,
+// where starting threads per round (parallel_for_ranges) would dominate.
+// for_ranges has the same contract as parallel_for_ranges, including
+// rethrowing the first exception once every worker has finished the round.
+class WorkerPool
+{
+public:
+    explicit WorkerPool(unsigned workers) : workers_(std::max(1u, workers)), errors_(workers_)
+    {
+        for (unsigned worker = 1; worker < workers_; worker++)
+        {
+            threads_.emplace_back([this, worker]()
+                                  { work(worker); });
+        }
+    }
+
+    ~WorkerPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        wake_.notify_all();
+        for (auto &thread : threads_)
+        {
+            thread.join();
+        }
+    }
+
+    WorkerPool(const WorkerPool &) = delete;
+    WorkerPool &operator=(const WorkerPool &) = delete;
+
+    unsigned size() const { return workers_; }
+
+    template <typename Fn>
+    void for_ranges(std::size_t count, Fn &&fn)
+    {
+        const std::size_t chunk = (count + workers_ - 1) / workers_;
+        if (workers_ == 1)
+        {
+            fn(0u, std::size_t{0}, count);
+            return;
+        }
+
+        // Each worker writes only its own slot; they are read after the
+        // round under mutex_.
+        const auto run = [this, &fn, count, chunk](unsigned worker)
+        {
+            try
+            {
+                const std::size_t begin = std::min(count, worker * chunk);
+                fn(worker, begin, std::min(count, begin + chunk));
+            }
+            catch (...)
+            {
+                errors_[worker] = std::current_exception();
+            }
+        };
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            task_ = run;
+            pending_ = workers_ - 1;
+            generation_++;
+        }
+        wake_.notify_all();
+
+        run(0u);
+
+        std::exception_ptr error;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            done_.wait(lock, [this]()
+                       { return pending_ == 0; });
+            task_ = nullptr;
+            for (auto &slot : errors_)
+            {
+                if (slot && !error)
+                {
+                    error = slot;
+                }
+                slot = nullptr;
+            }
+        }
+        if (error)
+        {
+            std::rethrow_exception(error);
+        }
+    }
+
+private:
+    void work(unsigned worker)
+    {
+        unsigned long long seen = 0;
+        while (true)
+        {
+            std::function<void(unsigned)> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                wake_.wait(lock, [this, seen]()
+                           { return stopping_ || generation_ != seen; });
+                if (stopping_)
+                {
+                    return;
+                }
+                seen = generation_;
+                task = task_;
+            }
+
+            task(worker);
+
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                pending_--;
+            }
+            done_.notify_one();
+        }
+    }
+
+    unsigned workers_;
+    std::vector<std::exception_ptr> errors_;
+    std::vector<std::thread> threads_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable done_;
+    std::function<void(unsigned)> task_;
+    unsigned pending_ = 0;
+    unsigned long long generation_ = 0;
+    bool stopping_ = false;
+};
+
+} // namespace route_finder
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "types.hpp"
+
+namespace route_finder
+{
+
+struct PlacementCandidate
+{
+    std::string site_id;
+    double lat{};
+    double lon{};
+    long snapped_node_id{-1};
+    int capacity{0};
+    double fixed_cost_sec{};
+};
+
+struct PlacementOptions
+{
+    // Sites to open. 0 lets the candidates' fixed costs decide how many
+    // (uncapacitated facility location instead of p-median).
+    int sites = 0;
+
+    // Sweeps stop at this travel time. Students farther than this from
+    // every open site are uncovered and cost uncovered_penalty_sec each
+    // (0 = twice max_travel_time_sec).
+    double max_travel_time_sec = 1800.0;
+    double uncovered_penalty_sec = 0.0;
+
+    int max_swaps = 500;
+    unsigned threads = 0;
+};
+
+struct PlacementResult
+{
+    // Candidate indices, in the order greedy opened them (swapped in last).
+    std::vector<int> open_sites;
+    // Students whose nearest open site is open_sites[k].
+    std::vector<long long> site_students;
+
+    double objective{};
+    double greedy_objective{};
+    double travel_time{};
+    double max_travel_time{};
+    long long covered_students{};
+    long long uncovered_students{};
+    long long unreachable_students{};
+    int demand_nodes{};
+    long long distance_entries{};
+    int swaps{};
+    int passes{};
+    long long capacity_shortfall{};
+
+    // Capacity-aware greedy allotment onto the chosen sites; only run when
+    // every candidate has a capacity.
+    bool capacitated{};
+    int capacitated_assigned{};
+    double capacitated_travel_time{};
+
+    double distance_ms{};
+    double greedy_ms{};
+    double swap_ms{};
+};
+
+PlacementResult optimise_centre_placement(const GraphSnapshot &snapshot,
+                                          const std::vector<PlacementCandidate> &candidates,
+                                          const std::vector<long> &student_nodes,
+                                          const PlacementOptions &options);
+
+} // namespace route_finder
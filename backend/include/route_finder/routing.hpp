@@ -9,12 +9,29 @@
 namespace route_finder
 {
 
-std::vector<long> clean_and_validate_path(const std::vector<long> &path);
-std::vector<long> a_star_bidirectional(long start_node, long goal_node);
-std::vector<long> a_star(long start_node, long goal_node);
-std::unordered_map<long, double> dijkstra(long start_node);
-std::pair<std::unordered_map<long, double>, std::unordered_map<long, long>> dijkstra_with_parents(long start_node);
-DijkstraResult run_dijkstra_for_centre(const Centre &centre);
+// Scratch state for repeated bounded sweeps over a DenseGraph. `settled`
+// lists the nodes reached within the bound in distance order; only entries
+// the previous sweep touched are reset, so a sweep costs what it explores.
+struct DenseSweep
+{
+    std::vector<double> distance;
+    std::vector<int> settled;
+    std::vector<int> touched;
+};
+
+std::vector<long> clean_and_validate_path(const GraphSnapshot &snapshot, const std::vector<long> &path);
+std::vector<std::pair<double, double>> path_to_coordinates(const GraphSnapshot &snapshot, const std::vector<long> &path);
+std::vector<long> a_star_bidirectional(const GraphSnapshot &snapshot, long start_node, long goal_node);
+std::vector<long> a_star(const GraphSnapshot &snapshot, long start_node, long goal_node);
+std::unordered_map<long, double> dijkstra(const Graph &graph, long start_node);
+std::pair<std::unordered_map<long, double>, std::unordered_map<long, long>> dijkstra_with_parents(const Graph &graph, long start_node);
+std::vector<double> dijkstra_dense(const DenseGraph &g, int source_index, bool reverse_edges, std::vector<int> *parents = nullptr);
+void dijkstra_dense_bounded(const DenseGraph &g, const std::vector<int> &source_indices, bool reverse_edges, double bound, DenseSweep &sweep);
+void dijkstra_dense_tree(const DenseGraph &g, int source_index, bool reverse_edges, const std::vector<int> &target_indices,
+                         DenseSweep &sweep, std::vector<int> &parents);
+std::vector<long> path_along_next_hops(const DenseGraph &g, const std::vector<std::int32_t> &next_hop, int node_index);
+VoronoiPartition network_voronoi(const DenseGraph &g, const std::vector<int> &source_indices, bool reverse_edges);
+DijkstraResult run_dijkstra_for_centre(const Graph &graph, const Centre &centre);
 bool save_dijkstra_results(const DijkstraResult &result, const std::string &distances_file, const std::string &parents_file);
 
 } // namespace route_finder
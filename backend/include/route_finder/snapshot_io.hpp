@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+#include "types.hpp"
+
+namespace route_finder
+{
+
+// Binary image of a built snapshot, so an evicted graph session can be
+// reloaded without refetching or rebuilding. The format is a private cache
+// for this binary (native byte order and struct layout), not an exchange
+// format; files from another build are rejected by the version check.
+bool save_graph_snapshot(const GraphSnapshot &snapshot, const std::string &path);
+std::shared_ptr<GraphSnapshot> load_graph_snapshot(const std::string &path);
+
+// Approximate heap footprint, used for the session memory budget.
+size_t snapshot_memory_bytes(const GraphSnapshot &snapshot);
+
+} // namespace route_finder
@@ -1,5 +1,9 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <unordered_map>
 #include <vector>
@@ -9,16 +13,60 @@
 namespace route_finder
 {
 
-extern Graph graph;
-extern std::unordered_map<long, Node> nodes;
-extern KDTreeNode *kdtree_root;
-extern std::unordered_map<long, std::unordered_map<std::string, double>> allotment_lookup_map;
+// Graph sessions: each built graph is served under a graph_id ("default"
+// when a request names none). Resident sessions count against a memory
+// budget; when it is exceeded the least recently used one is written to disk
+// and dropped, and the next request for it loads it back.
+constexpr const char *kDefaultGraphId = "default";
+
+struct GraphSessionInfo
+{
+    std::string graph_id;
+    bool resident = false;
+    bool on_disk = false;
+    size_t memory_bytes = 0;
+    size_t disk_bytes = 0;
+    double idle_sec = 0.0;
+    size_t nodes = 0;
+    size_t edges = 0;
+    size_t centres = 0;
+    std::string detail;
+};
+
+bool valid_graph_id(const std::string &graph_id);
+bool has_graph_session(const std::string &graph_id);
+
+// The graph served under graph_id. Never null: an empty snapshot when nothing
+// has been built under that id. Callers keep the returned pointer for as long
+// as they read from it; publishing or evicting only drops the session's
+// reference, so a request that started on a graph finishes on it.
+std::shared_ptr<const GraphSnapshot> current_snapshot(const std::string &graph_id = kDefaultGraphId);
+void publish_snapshot(std::shared_ptr<const GraphSnapshot> snapshot, const std::string &graph_id = kDefaultGraphId);
+
+std::vector<GraphSessionInfo> list_graph_sessions();
+size_t graph_memory_budget();
+void set_graph_memory_budget(size_t bytes);
+
+// Allotment state. Handlers hold allotment_mutex while they read or write it.
+// It belongs to one graph session at a time (allotment_graph_id); centres are
+// replaced together with that session's snapshot.
+extern std::mutex allotment_mutex;
+extern std::string allotment_graph_id;
+// Bumped whenever students, centres or assignments change, so readers that
+// release the mutex between pieces (the diagnostics stream) notice.
+extern std::uint64_t allotment_revision;
+// GraphSnapshot::build_id the allotment was computed on. Rebuilding that
+// graph clears the allotment, and handlers refuse to read one that is older
+// than the snapshot they serve.
+extern std::uint64_t allotment_build_id;
 extern std::vector<Centre> centres;
 extern std::vector<Student> students;
 extern std::unordered_map<std::string, std::string> final_assignments;
-extern std::unordered_map<long, int> node_component;
-
-void reset_kdtree();
+extern std::vector<int> student_assignment;
+extern std::unordered_map<std::string, int> student_index;
+extern EligibilityRules eligibility_rules;
+extern AllotmentQuality allotment_quality;
+extern AllotmentRoster allotment_roster;
 
 } // namespace route_finder
 
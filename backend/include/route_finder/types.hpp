@@ -2,7 +2,11 @@
 
 #include <cmath>
 #include <cstddef>
+#include <cstdint>
+#include <functional>
 #include <limits>
+#include <map>
+#include <memory>
 #include <queue>
 #include <string>
 #include <unordered_map>
@@ -33,11 +37,74 @@ struct Centre
     bool is_female_only{false};
 };
 
+// Which centre attributes restrict which student categories.
+struct EligibilityRules
+{
+    bool pwd_requires_wheelchair_access = true;
+    bool female_only_centres = true;
+};
+
+struct CategoryQuality
+{
+    int total{};
+    int assigned{};
+    double travel_sum{};
+};
+
+// Quality figures of the live allotment, kept current while the engine
+// assigns (run_allotment, apply_allotment_delta) so diagnostics read them
+// instead of rescanning every student against every centre. The per-student
+// vectors run parallel to `students`.
+struct AllotmentQuality
+{
+    bool valid = false;
+
+    // Fastest and runner-up centre over all centres (max() when unreachable).
+    std::vector<double> best_time;
+    std::vector<double> second_best_time;
+    std::vector<int> reachable_count;
+    // Metres from the student to its snapped node; -1 when the node is unknown.
+    std::vector<double> snap_distance;
+    // Travel time to the assigned centre; -1 when unassigned.
+    std::vector<double> travel_time;
+    std::vector<std::uint8_t> first_choice;
+
+    int assigned{};
+    int first_choice_count{};
+    double travel_sum{};
+    double max_travel{};
+    // Set when the student holding max_travel leaves; settled by a rescan.
+    bool max_stale = false;
+    int snapped{};
+    int large_snaps{};
+    double snap_distance_sum{};
+    std::map<std::string, CategoryQuality> by_category;
+};
+
+// Who sits where, kept by the engine next to student_assignment so an
+// allotment delta visits only the centres it touches. Entries are appended
+// whenever a student's seat changes and go stale when it changes again;
+// readers skip stale entries and compact the lists they read.
+struct AllotmentRoster
+{
+    bool valid = false;
+    // Students seated at each centre.
+    std::vector<std::vector<int>> occupants;
+    // Seated students each centre is eligible for and faster than their
+    // current seat, among each student's closest few such centres: the
+    // only ones a seat freed there is offered to.
+    std::vector<std::vector<int>> preferred_by;
+    // Students without a seat.
+    std::vector<int> unassigned;
+    // Entries appended since the lists were last compacted.
+    size_t appended{};
+};
+
 struct AssignmentPair
 {
     double distance{};
-    std::string student_id;
-    std::string centre_id;
+    int student{};
+    int centre{};
 
     bool operator>(const AssignmentPair &other) const
     {
@@ -63,6 +130,13 @@ struct KDTreeNode
 
     KDTreeNode(long id, double lat_, double lon_, int axis_)
         : node_id(id), lat(lat_), lon(lon_), axis(axis_), left(nullptr), right(nullptr) {}
+    KDTreeNode(const KDTreeNode &) = delete;
+    KDTreeNode &operator=(const KDTreeNode &) = delete;
+    ~KDTreeNode()
+    {
+        delete left;
+        delete right;
+    }
 };
 
 struct SearchNode
@@ -88,7 +162,185 @@ struct DijkstraResult
     std::string error_message;
 };
 
+enum class HighwayClass : std::uint8_t
+{
+    Motorway,
+    Trunk,
+    Primary,
+    Secondary,
+    Tertiary,
+    Unclassified,
+    Residential,
+    LivingStreet,
+    Service,
+    Other
+};
+
+struct ClassifiedEdge
+{
+    long to{};
+    double time_seconds{};
+    HighwayClass highway_class{HighwayClass::Other};
+};
+
+// Intermediate shape points of a contracted edge, as a slice of the flat
+// edge_shape_points array.
+struct EdgeShape
+{
+    std::uint32_t offset{};
+    std::uint32_t count{};
+};
+
+struct NodePairHash
+{
+    std::size_t operator()(const std::pair<long, long> &key) const
+    {
+        return std::hash<long>()(key.first) * 31 ^ std::hash<long>()(key.second);
+    }
+};
+
+struct TopologySimplificationStats
+{
+    std::size_t nodes_before{};
+    std::size_t nodes_after{};
+    std::size_t edges_before{};
+    std::size_t edges_after{};
+    std::size_t chains_contracted{};
+    std::size_t shape_points{};
+    double dijkstra_before_ms{};
+    double dijkstra_after_ms{};
+};
+
+// Area the allotment actually needs: the convex hull of `anchor_points`
+// (centres plus the expected student area) grown by a distance and/or a
+// travel-time margin. A margin of zero disables that test.
+struct RegionOfInterest
+{
+    std::vector<std::pair<double, double>> anchor_points;
+    double margin_metres{0.0};
+    double margin_seconds{0.0};
+};
+
+struct RoiPruningStats
+{
+    std::size_t nodes_before{};
+    std::size_t nodes_kept{};
+    std::size_t edges_before{};
+    std::size_t edges_kept{};
+    std::size_t hull_vertices{};
+};
+
+// Compressed sparse row copy of `graph` over dense 0..n-1 indices, with the
+// reverse adjacency alongside. Rebuilt whenever the routable graph changes.
+struct DenseGraph
+{
+    std::vector<long> node_ids;
+    std::unordered_map<long, int> index_of;
+    std::vector<int> offsets;
+    std::vector<int> targets;
+    std::vector<double> weights;
+    std::vector<int> reverse_offsets;
+    std::vector<int> reverse_targets;
+    std::vector<double> reverse_weights;
+
+    int size() const { return static_cast<int>(node_ids.size()); }
+
+    int index(long node_id) const
+    {
+        const auto it = index_of.find(node_id);
+        return it != index_of.end() ? it->second : -1;
+    }
+};
+
+// Travel time in seconds from every dense graph node to each centre, one
+// column per centre (index into `centres`). Unreachable entries hold
+// std::numeric_limits<double>::max().
+struct DistanceTable
+{
+    int centre_count{};
+    int node_count{};
+    std::vector<std::vector<double>> by_centre;
+    // Shortest path trees of the same searches: the next node (dense index)
+    // on every node's route to the centre, the centre itself for the centre
+    // and -1 where it is unreachable. Empty if the build skipped them.
+    std::vector<std::vector<std::int32_t>> next_hop_by_centre;
+
+    double at(int centre, int node_index) const
+    {
+        if (node_index < 0 || node_index >= node_count)
+        {
+            return std::numeric_limits<double>::max();
+        }
+        return by_centre[centre][node_index];
+    }
+
+    bool has_path_trees() const { return !next_hop_by_centre.empty(); }
+};
+
+// Nearest and second-nearest source of every dense graph node, labelled
+// by the source's position in the list the partition was built from
+// (centre index for the global one); -1 where fewer sources reach it.
+struct VoronoiPartition
+{
+    std::vector<int> nearest;
+    std::vector<double> nearest_time;
+    std::vector<int> runner_up;
+    std::vector<double> runner_up_time;
+
+    bool empty() const { return nearest.empty(); }
+};
+
 using Graph = std::unordered_map<long, std::vector<std::pair<long, double>>>;
+using EdgeShapeMap = std::unordered_map<std::pair<long, long>, EdgeShape, NodePairHash>;
+using ClassifiedGraph = std::unordered_map<long, std::vector<ClassifiedEdge>>;
+
+struct GraphBounds
+{
+    double min_lat{};
+    double min_lon{};
+    double max_lat{};
+    double max_lon{};
+};
+
+// Everything one /build-graph run produces. A published snapshot is never
+// modified again: readers hold it for the length of a request while the next
+// build fills a fresh one, which then replaces it (see current_snapshot()).
+struct GraphSnapshot
+{
+    Graph graph;
+    // Every road class of the loaded area; lower detail views are derived
+    // from it, so snapshots built from the same area share one copy.
+    std::shared_ptr<const ClassifiedGraph> full_graph;
+    std::string full_graph_detail;
+    bool has_source_bounds = false;
+    GraphBounds source_bounds;
+
+    EdgeShapeMap edge_shapes;
+    std::vector<std::pair<double, double>> edge_shape_points;
+    std::unordered_map<long, Node> nodes;
+    std::unique_ptr<KDTreeNode> kdtree_root;
+    std::unordered_map<long, int> node_component;
+    int main_component_id = -1;
+    DenseGraph dense_graph;
+
+    // Centres snapped to this graph; distance_table columns and voronoi
+    // labels follow this order.
+    std::vector<Centre> centres;
+    DistanceTable distance_table;
+    VoronoiPartition voronoi;
+
+    // Numbers the builds of this process, so the allotment can tell whether
+    // it was computed on the snapshot a session serves now.
+    std::uint64_t build_id{};
+
+    bool empty() const { return graph.empty() || nodes.empty(); }
+
+    int node_component_of(long node_id) const
+    {
+        const auto it = node_component.find(node_id);
+        return it != node_component.end() ? it->second : -1;
+    }
+};
 
 } // namespace route_finder
 
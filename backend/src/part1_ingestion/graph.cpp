@@ -2,9 +2,13 @@
 #include "route_finder/graph.hpp"
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cmath>
+#include <cstdint>
 #include <iostream>
 #include <limits>
+#include <queue>
 #include <set>
 #include <sstream>
 #include <string>
@@ -13,63 +17,272 @@
 
 #include "route_finder/geometry.hpp"
 #include "route_finder/kdtree.hpp"
+#include "route_finder/parallel.hpp"
 #include "route_finder/routing.hpp"
-#include "route_finder/state.hpp"
 
 namespace route_finder
 {
 namespace
 {
 
-double get_default_speed(const std::string &highway_type)
+// A node is a pure shape point when it joins exactly two distinct neighbours
+// and only passes traffic through: either a two-way segment (both edges in
+// both directions) or a one-way segment (one edge in, one edge out).
+bool is_chain_node(const Graph &graph, long node_id, const Graph &reverse_graph)
 {
-    if (highway_type == "motorway")
+    const auto out_it = graph.find(node_id);
+    const auto in_it = reverse_graph.find(node_id);
+    if (out_it == graph.end() || in_it == reverse_graph.end())
     {
-        return 100.0;
+        return false;
     }
-    if (highway_type == "trunk")
+
+    const auto &out_edges = out_it->second;
+    const auto &in_edges = in_it->second;
+
+    if (out_edges.size() == 1 && in_edges.size() == 1)
     {
-        return 90.0;
+        const long next = out_edges[0].first;
+        const long prev = in_edges[0].first;
+        return next != prev && next != node_id && prev != node_id;
     }
-    if (highway_type == "primary")
+
+    if (out_edges.size() == 2 && in_edges.size() == 2)
     {
-        return 80.0;
+        const long a = out_edges[0].first;
+        const long b = out_edges[1].first;
+        if (a == b || a == node_id || b == node_id)
+        {
+            return false;
+        }
+        const long c = in_edges[0].first;
+        const long d = in_edges[1].first;
+        return (c == a && d == b) || (c == b && d == a);
     }
-    if (highway_type == "secondary")
+
+    return false;
+}
+
+size_t count_graph_nodes(const Graph &g)
+{
+    std::unordered_map<long, bool> seen;
+    seen.reserve(g.size() * 2);
+    for (const auto &[node_id, edges] : g)
     {
-        return 60.0;
+        seen[node_id] = true;
+        for (const auto &edge : edges)
+        {
+            seen[edge.first] = true;
+        }
     }
-    if (highway_type == "tertiary")
+    return seen.size();
+}
+
+size_t count_graph_edges(const Graph &g)
+{
+    size_t total = 0;
+    for (const auto &entry : g)
     {
-        return 50.0;
+        total += entry.second.size();
     }
-    if (highway_type == "residential")
+    return total;
+}
+
+double time_dijkstra_ms(const Graph &graph, long start_node)
+{
+    const auto start = std::chrono::high_resolution_clock::now();
+    dijkstra(graph, start_node);
+    const auto end = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+// Local equirectangular projection in metres, good enough for city-sized areas.
+struct PlanarPoint
+{
+    double x{};
+    double y{};
+};
+
+PlanarPoint project(double lat, double lon, double reference_lat)
+{
+    constexpr double kMetresPerDegree = 111320.0;
+    constexpr double kDegToRad = 3.14159265358979323846 / 180.0;
+    return {lon * kMetresPerDegree * std::cos(reference_lat * kDegToRad), lat * kMetresPerDegree};
+}
+
+double cross(const PlanarPoint &o, const PlanarPoint &a, const PlanarPoint &b)
+{
+    return (a.x - o.x) * (b.y - o.y) - (a.y - o.y) * (b.x - o.x);
+}
+
+// Andrew's monotone chain; returns the hull counter-clockwise.
+std::vector<PlanarPoint> convex_hull(std::vector<PlanarPoint> points)
+{
+    std::sort(points.begin(), points.end(), [](const PlanarPoint &a, const PlanarPoint &b)
+              { return a.x != b.x ? a.x < b.x : a.y < b.y; });
+    if (points.size() < 3)
     {
-        return 30.0;
+        return points;
     }
-    if (highway_type == "living_street")
+
+    std::vector<PlanarPoint> hull(points.size() * 2);
+    size_t k = 0;
+    for (size_t i = 0; i < points.size(); i++)
     {
-        return 20.0;
+        while (k >= 2 && cross(hull[k - 2], hull[k - 1], points[i]) <= 0)
+        {
+            k--;
+        }
+        hull[k++] = points[i];
     }
-    if (highway_type == "service")
+    for (size_t i = points.size() - 1, lower = k + 1; i > 0; i--)
     {
-        return 20.0;
+        while (k >= lower && cross(hull[k - 2], hull[k - 1], points[i - 1]) <= 0)
+        {
+            k--;
+        }
+        hull[k++] = points[i - 1];
+    }
+    hull.resize(k - 1);
+    return hull;
+}
+
+double segment_distance(const PlanarPoint &p, const PlanarPoint &a, const PlanarPoint &b)
+{
+    const double dx = b.x - a.x;
+    const double dy = b.y - a.y;
+    const double length_sq = dx * dx + dy * dy;
+    double t = length_sq > 0.0 ? ((p.x - a.x) * dx + (p.y - a.y) * dy) / length_sq : 0.0;
+    t = std::max(0.0, std::min(1.0, t));
+    const double ex = a.x + t * dx - p.x;
+    const double ey = a.y + t * dy - p.y;
+    return std::sqrt(ex * ex + ey * ey);
+}
+
+// Zero inside the hull, otherwise the distance to its boundary.
+double distance_to_hull(const PlanarPoint &p, const std::vector<PlanarPoint> &hull)
+{
+    if (hull.empty())
+    {
+        return std::numeric_limits<double>::max();
+    }
+    if (hull.size() == 1)
+    {
+        return std::hypot(p.x - hull[0].x, p.y - hull[0].y);
+    }
+
+    bool inside = hull.size() >= 3;
+    double best = std::numeric_limits<double>::max();
+    for (size_t i = 0; i < hull.size(); i++)
+    {
+        const auto &a = hull[i];
+        const auto &b = hull[(i + 1) % hull.size()];
+        if (cross(a, b, p) < 0)
+        {
+            inside = false;
+        }
+        best = std::min(best, segment_distance(p, a, b));
+    }
+    return inside ? 0.0 : best;
+}
+
+int graph_detail_rank(const std::string &graph_detail)
+{
+    if (graph_detail == "low")
+    {
+        return 0;
+    }
+    if (graph_detail == "high")
+    {
+        return 2;
     }
-    if (highway_type == "unclassified")
+    return 1;
+}
+
+} // namespace
+
+HighwayClass parse_highway_class(const std::string &highway_type)
+{
+    static const std::unordered_map<std::string, HighwayClass> kHighwayClasses = {
+        {"motorway", HighwayClass::Motorway},
+        {"trunk", HighwayClass::Trunk},
+        {"primary", HighwayClass::Primary},
+        {"secondary", HighwayClass::Secondary},
+        {"tertiary", HighwayClass::Tertiary},
+        {"unclassified", HighwayClass::Unclassified},
+        {"residential", HighwayClass::Residential},
+        {"living_street", HighwayClass::LivingStreet},
+        {"service", HighwayClass::Service}};
+
+    const auto it = kHighwayClasses.find(highway_type);
+    return it != kHighwayClasses.end() ? it->second : HighwayClass::Other;
+}
+
+double default_speed_kmh(HighwayClass highway_class)
+{
+    switch (highway_class)
     {
+    case HighwayClass::Motorway:
+        return 100.0;
+    case HighwayClass::Trunk:
+        return 90.0;
+    case HighwayClass::Primary:
+        return 80.0;
+    case HighwayClass::Secondary:
+        return 60.0;
+    case HighwayClass::Tertiary:
+        return 50.0;
+    case HighwayClass::Residential:
+        return 30.0;
+    case HighwayClass::LivingStreet:
+        return 20.0;
+    case HighwayClass::Service:
+        return 20.0;
+    case HighwayClass::Unclassified:
         return 40.0;
+    case HighwayClass::Other:
+        break;
     }
     return 30.0;
 }
 
-} // namespace
+// Mirrors the highway filters used by fetch_overpass_data(). Edges of unknown
+// class only come from the simulated fallback and are kept at every level.
+bool highway_class_in_detail(HighwayClass highway_class, const std::string &graph_detail)
+{
+    switch (highway_class)
+    {
+    case HighwayClass::Primary:
+    case HighwayClass::Secondary:
+    case HighwayClass::Tertiary:
+    case HighwayClass::Other:
+        return true;
+    case HighwayClass::Unclassified:
+    case HighwayClass::Residential:
+    case HighwayClass::LivingStreet:
+    case HighwayClass::Service:
+        return graph_detail_rank(graph_detail) >= 1;
+    case HighwayClass::Motorway:
+    case HighwayClass::Trunk:
+        return graph_detail_rank(graph_detail) >= 2;
+    }
+    return true;
+}
 
-void build_graph_from_overpass(const nlohmann::json &osm_data)
+bool graph_detail_covers(const std::string &loaded_detail, const std::string &requested_detail)
+{
+    return graph_detail_rank(loaded_detail) >= graph_detail_rank(requested_detail);
+}
+
+void build_graph_from_overpass(GraphSnapshot &draft, const nlohmann::json &osm_data, const std::string &source_detail)
 {
     std::cout << "Building graph from OpenStreetMap data..." << std::endl;
 
+    auto &nodes = draft.nodes;
     nodes.clear();
-    graph.clear();
+    draft.graph.clear();
+    draft.full_graph.reset();
+    draft.full_graph_detail = source_detail;
 
     if (!osm_data.contains("elements") || osm_data["elements"].empty())
     {
@@ -77,26 +290,92 @@ void build_graph_from_overpass(const nlohmann::json &osm_data)
         return;
     }
 
-    for (const auto &element : osm_data["elements"])
+    const auto &elements = osm_data["elements"];
+    const size_t element_count = elements.size();
+    const unsigned workers = worker_count(element_count, 4096);
+
+    // Pass 1: split elements into nodes and ways, one slice per worker.
+    std::vector<std::vector<Node>> worker_nodes(workers);
+    std::vector<std::vector<size_t>> worker_ways(workers);
+    parallel_for_ranges(element_count, workers, [&](unsigned worker, size_t begin, size_t end)
+                        {
+        for (size_t i = begin; i < end; i++)
+        {
+            const auto &element = elements[i];
+            if (element["type"] == "node")
+            {
+                worker_nodes[worker].push_back({element["id"].get<long>(), element["lat"].get<double>(), element["lon"].get<double>()});
+            }
+            else if (element["type"] == "way" && element.contains("nodes"))
+            {
+                worker_ways[worker].push_back(i);
+            }
+        } });
+
+    // Dense indices let the merge below bucket edges with a counting sort.
+    std::vector<long> dense_ids;
+    std::vector<double> dense_lat;
+    std::vector<double> dense_lon;
+    std::unordered_map<long, std::uint32_t> dense_index;
+    size_t node_total = 0;
+    for (const auto &list : worker_nodes)
+    {
+        node_total += list.size();
+    }
+    nodes.reserve(node_total);
+    dense_index.reserve(node_total);
+    dense_ids.reserve(node_total);
+    dense_lat.reserve(node_total);
+    dense_lon.reserve(node_total);
+    for (const auto &list : worker_nodes)
     {
-        if (element["type"] == "node")
+        for (const auto &node : list)
         {
-            long id = element["id"];
-            double lat = element["lat"];
-            double lon = element["lon"];
-            nodes[id] = {id, lat, lon};
+            if (dense_index.emplace(node.id, static_cast<std::uint32_t>(dense_ids.size())).second)
+            {
+                dense_ids.push_back(node.id);
+                dense_lat.push_back(node.lat);
+                dense_lon.push_back(node.lon);
+            }
+            nodes[node.id] = node;
         }
     }
+    worker_nodes.clear();
     std::cout << "Stored " << nodes.size() << " nodes from OSM data." << std::endl;
 
-    int edge_count = 0;
-    int oneway_count = 0;
+    std::vector<size_t> way_elements;
+    for (const auto &list : worker_ways)
+    {
+        way_elements.insert(way_elements.end(), list.begin(), list.end());
+    }
+    worker_ways.clear();
 
-    for (const auto &element : osm_data["elements"])
+    // Pass 2: each worker turns its share of ways into directed edges.
+    struct EdgeList
     {
-        if (element["type"] == "way" && element.contains("nodes"))
+        std::vector<std::uint32_t> from;
+        std::vector<std::uint32_t> to;
+        std::vector<double> seconds;
+        std::vector<HighwayClass> highway_class;
+        size_t oneway_segments = 0;
+    };
+
+    const unsigned way_workers = worker_count(way_elements.size(), 256);
+    std::vector<EdgeList> worker_edges(way_workers);
+    parallel_for_ranges(way_elements.size(), way_workers, [&](unsigned worker, size_t begin, size_t end)
+                        {
+        EdgeList &out = worker_edges[worker];
+        std::vector<std::uint32_t> seg_from;
+        std::vector<std::uint32_t> seg_to;
+        std::vector<double> seg_speed;
+        std::vector<HighwayClass> seg_class;
+        std::vector<char> seg_oneway;
+
+        for (size_t w = begin; w < end; w++)
         {
-            std::string highway_type;
+            const auto &element = elements[way_elements[w]];
+
+            HighwayClass highway_class = HighwayClass::Other;
             bool is_oneway = false;
             double speed_kmh = 30.0;
 
@@ -106,8 +385,8 @@ void build_graph_from_overpass(const nlohmann::json &osm_data)
 
                 if (tags.contains("highway"))
                 {
-                    highway_type = tags["highway"].get<std::string>();
-                    speed_kmh = get_default_speed(highway_type);
+                    highway_class = parse_highway_class(tags["highway"].get<std::string>());
+                    speed_kmh = default_speed_kmh(highway_class);
                 }
 
                 if (tags.contains("oneway"))
@@ -130,52 +409,560 @@ void build_graph_from_overpass(const nlohmann::json &osm_data)
             }
 
             const auto &way_node_ids = element["nodes"];
-
             for (size_t i = 0; i + 1 < way_node_ids.size(); i++)
             {
-                const long node1_id = way_node_ids[i];
-                const long node2_id = way_node_ids[i + 1];
+                const auto it1 = dense_index.find(way_node_ids[i].get<long>());
+                const auto it2 = dense_index.find(way_node_ids[i + 1].get<long>());
+                if (it1 == dense_index.end() || it2 == dense_index.end())
+                {
+                    continue;
+                }
+
+                seg_from.push_back(it1->second);
+                seg_to.push_back(it2->second);
+                seg_speed.push_back(speed_kmh);
+                seg_class.push_back(highway_class);
+                seg_oneway.push_back(is_oneway ? 1 : 0);
+            }
+        }
+
+        const size_t segments = seg_from.size();
+        std::vector<double> lat1(segments), lon1(segments), lat2(segments), lon2(segments), metres(segments);
+        for (size_t i = 0; i < segments; i++)
+        {
+            lat1[i] = dense_lat[seg_from[i]];
+            lon1[i] = dense_lon[seg_from[i]];
+            lat2[i] = dense_lat[seg_to[i]];
+            lon2[i] = dense_lon[seg_to[i]];
+        }
+        haversine_batch(lat1.data(), lon1.data(), lat2.data(), lon2.data(), metres.data(), segments);
+
+        out.from.reserve(segments * 2);
+        out.to.reserve(segments * 2);
+        out.seconds.reserve(segments * 2);
+        out.highway_class.reserve(segments * 2);
+        for (size_t i = 0; i < segments; i++)
+        {
+            // km / (km/h) * 3600 = seconds
+            const double time_seconds = metres[i] / 1000.0 / seg_speed[i] * 3600.0;
+
+            out.from.push_back(seg_from[i]);
+            out.to.push_back(seg_to[i]);
+            out.seconds.push_back(time_seconds);
+            out.highway_class.push_back(seg_class[i]);
+
+            if (seg_oneway[i])
+            {
+                out.oneway_segments++;
+            }
+            else
+            {
+                out.from.push_back(seg_to[i]);
+                out.to.push_back(seg_from[i]);
+                out.seconds.push_back(time_seconds);
+                out.highway_class.push_back(seg_class[i]);
+            }
+        } });
+
+    // Merge: parallel counting sort of all worker edge lists by source node.
+    const size_t dense_count = dense_ids.size();
+    std::vector<std::atomic<std::uint32_t>> degree(dense_count);
+    for (auto &d : degree)
+    {
+        d.store(0, std::memory_order_relaxed);
+    }
+
+    parallel_for_ranges(worker_edges.size(), static_cast<unsigned>(worker_edges.size()), [&](unsigned, size_t begin, size_t end)
+                        {
+        for (size_t w = begin; w < end; w++)
+        {
+            for (const std::uint32_t from : worker_edges[w].from)
+            {
+                degree[from].fetch_add(1, std::memory_order_relaxed);
+            }
+        } });
+
+    std::vector<size_t> offsets(dense_count + 1, 0);
+    for (size_t i = 0; i < dense_count; i++)
+    {
+        offsets[i + 1] = offsets[i] + degree[i].load(std::memory_order_relaxed);
+        degree[i].store(0, std::memory_order_relaxed);
+    }
+
+    const size_t edge_count = offsets[dense_count];
+    std::vector<ClassifiedEdge> sorted_edges(edge_count);
+    size_t oneway_count = 0;
+    for (const auto &list : worker_edges)
+    {
+        oneway_count += list.oneway_segments;
+    }
+
+    parallel_for_ranges(worker_edges.size(), static_cast<unsigned>(worker_edges.size()), [&](unsigned, size_t begin, size_t end)
+                        {
+        for (size_t w = begin; w < end; w++)
+        {
+            const EdgeList &list = worker_edges[w];
+            for (size_t i = 0; i < list.from.size(); i++)
+            {
+                const std::uint32_t from = list.from[i];
+                const size_t slot = offsets[from] + degree[from].fetch_add(1, std::memory_order_relaxed);
+                sorted_edges[slot] = {dense_ids[list.to[i]], list.seconds[i], list.highway_class[i]};
+            }
+        } });
+    worker_edges.clear();
+
+    // Scatter order depends on thread timing; sort each bucket so the
+    // adjacency is identical from run to run.
+    std::vector<std::vector<ClassifiedEdge>> adjacency(dense_count);
+    parallel_for_ranges(dense_count, worker_count(dense_count, 4096), [&](unsigned, size_t begin, size_t end)
+                        {
+        for (size_t i = begin; i < end; i++)
+        {
+            if (offsets[i] == offsets[i + 1])
+            {
+                continue;
+            }
+            auto first = sorted_edges.begin() + offsets[i];
+            auto last = sorted_edges.begin() + offsets[i + 1];
+            std::sort(first, last, [](const ClassifiedEdge &a, const ClassifiedEdge &b)
+                      { return a.to != b.to ? a.to < b.to : a.time_seconds < b.time_seconds; });
+            adjacency[i].assign(first, last);
+        } });
+
+    auto full_graph = std::make_shared<ClassifiedGraph>();
+    full_graph->reserve(dense_count);
+    for (size_t i = 0; i < dense_count; i++)
+    {
+        if (!adjacency[i].empty())
+        {
+            full_graph->emplace(dense_ids[i], std::move(adjacency[i]));
+        }
+    }
+    draft.full_graph = std::move(full_graph);
+
+    std::cout << "Graph built with " << nodes.size() << " nodes and " << edge_count << " directed edges using "
+              << way_workers << " worker(s)." << std::endl;
+    std::cout << "Identified " << oneway_count << " one-way segments." << std::endl;
+
+    apply_graph_detail(draft, source_detail);
+}
+
+void apply_graph_detail(GraphSnapshot &draft, const std::string &graph_detail)
+{
+    Graph &graph = draft.graph;
+    graph.clear();
+    draft.edge_shapes.clear();
+    draft.edge_shape_points.clear();
+    if (!draft.full_graph)
+    {
+        return;
+    }
+    graph.reserve(draft.full_graph->size());
+
+    size_t kept_edges = 0;
+    size_t total_edges = 0;
+    for (const auto &[node_id, edges] : *draft.full_graph)
+    {
+        total_edges += edges.size();
+
+        std::vector<std::pair<long, double>> kept;
+        for (const auto &edge : edges)
+        {
+            if (highway_class_in_detail(edge.highway_class, graph_detail))
+            {
+                kept.push_back({edge.to, edge.time_seconds});
+            }
+        }
+
+        if (!kept.empty())
+        {
+            kept_edges += kept.size();
+            graph.emplace(node_id, std::move(kept));
+        }
+    }
+
+    std::cout << "Graph view (detail=" << graph_detail << ") keeps " << kept_edges << " of "
+              << total_edges << " directed edges." << std::endl;
+}
+
+// Collapses degree-2 chains into single weighted edges. Shape points stay in
+// `nodes` but leave the routable graph; their coordinates are kept per edge in
+// edge_shape_points so callers can still draw the full polyline.
+TopologySimplificationStats simplify_graph_topology(GraphSnapshot &draft)
+{
+    std::cout << "Simplifying graph topology (degree-2 chain contraction)..." << std::endl;
+
+    Graph &graph = draft.graph;
+    const auto &nodes = draft.nodes;
+
+    TopologySimplificationStats stats;
+    stats.nodes_before = count_graph_nodes(graph);
+    stats.edges_before = count_graph_edges(graph);
+
+    Graph reverse_graph;
+    reverse_graph.reserve(graph.size());
+    for (const auto &[node_id, edges] : graph)
+    {
+        for (const auto &edge : edges)
+        {
+            reverse_graph[edge.first].push_back({node_id, edge.second});
+        }
+    }
+
+    std::unordered_map<long, bool> chain_node;
+    chain_node.reserve(graph.size());
+    for (const auto &entry : graph)
+    {
+        chain_node[entry.first] = is_chain_node(graph, entry.first, reverse_graph);
+    }
+    const auto is_chain = [&chain_node](long node_id)
+    {
+        const auto it = chain_node.find(node_id);
+        return it != chain_node.end() && it->second;
+    };
+
+    Graph simplified;
+    EdgeShapeMap shapes;
+    std::vector<std::pair<double, double>> shape_points;
+    std::vector<std::pair<double, double>> chain_points;
+
+    for (const auto &[junction, edges] : graph)
+    {
+        if (is_chain(junction))
+        {
+            continue;
+        }
+
+        auto &out_edges = simplified[junction];
+        for (const auto &first_edge : edges)
+        {
+            long prev = junction;
+            long current = first_edge.first;
+            double weight = first_edge.second;
+            chain_points.clear();
+
+            while (is_chain(current))
+            {
+                const auto &node = nodes.at(current);
+                chain_points.push_back({node.lat, node.lon});
+
+                const auto &current_edges = graph.at(current);
+                const auto &next_edge = (current_edges.size() == 1 || current_edges[0].first != prev)
+                                            ? current_edges[0]
+                                            : current_edges[1];
+                weight += next_edge.second;
+                prev = current;
+                current = next_edge.first;
+
+                if (current == junction)
+                {
+                    break;
+                }
+            }
+
+            if (current == junction)
+            {
+                continue;
+            }
 
-                if (nodes.find(node1_id) == nodes.end() || nodes.find(node2_id) == nodes.end())
+            // Parallel chains between the same junctions: keep the fastest.
+            const auto key = std::make_pair(junction, current);
+            auto existing = std::find_if(out_edges.begin(), out_edges.end(),
+                                         [current](const std::pair<long, double> &edge)
+                                         { return edge.first == current; });
+            if (existing != out_edges.end())
+            {
+                if (existing->second <= weight)
                 {
                     continue;
                 }
+                existing->second = weight;
+                shapes.erase(key);
+            }
+            else
+            {
+                out_edges.push_back({current, weight});
+            }
+
+            if (!chain_points.empty())
+            {
+                shapes[key] = {static_cast<std::uint32_t>(shape_points.size()),
+                               static_cast<std::uint32_t>(chain_points.size())};
+                shape_points.insert(shape_points.end(), chain_points.begin(), chain_points.end());
+                stats.chains_contracted++;
+            }
+        }
+
+        if (out_edges.empty())
+        {
+            simplified.erase(junction);
+        }
+    }
+
+    long sample_node = -1;
+    for (const auto &entry : simplified)
+    {
+        sample_node = entry.first;
+        break;
+    }
+    if (sample_node != -1)
+    {
+        stats.dijkstra_before_ms = time_dijkstra_ms(graph, sample_node);
+    }
+
+    graph = std::move(simplified);
+    draft.edge_shapes = std::move(shapes);
+    draft.edge_shape_points = std::move(shape_points);
+
+    if (sample_node != -1)
+    {
+        stats.dijkstra_after_ms = time_dijkstra_ms(graph, sample_node);
+    }
+
+    stats.nodes_after = count_graph_nodes(graph);
+    stats.edges_after = count_graph_edges(graph);
+    stats.shape_points = draft.edge_shape_points.size();
+
+    std::cout << "Topology simplified: nodes " << stats.nodes_before << " -> " << stats.nodes_after
+              << ", edges " << stats.edges_before << " -> " << stats.edges_after
+              << ", " << stats.shape_points << " shape points kept." << std::endl;
+
+    return stats;
+}
+
+// Keeps the part of the graph near the region of interest and drops
+// everything else. Runs before component labelling, so the main component is
+// chosen from what is left.
+RoiPruningStats prune_graph_to_region(GraphSnapshot &draft, const RegionOfInterest &roi)
+{
+    Graph &graph = draft.graph;
+    const auto &nodes = draft.nodes;
+
+    RoiPruningStats stats;
+    stats.nodes_before = count_graph_nodes(graph);
+    stats.edges_before = count_graph_edges(graph);
+
+    if (roi.anchor_points.empty())
+    {
+        stats.nodes_kept = stats.nodes_before;
+        stats.edges_kept = stats.edges_before;
+        return stats;
+    }
+
+    double reference_lat = 0.0;
+    for (const auto &point : roi.anchor_points)
+    {
+        reference_lat += point.first;
+    }
+    reference_lat /= roi.anchor_points.size();
+
+    std::vector<PlanarPoint> anchors;
+    anchors.reserve(roi.anchor_points.size());
+    for (const auto &point : roi.anchor_points)
+    {
+        anchors.push_back(project(point.first, point.second, reference_lat));
+    }
+    const auto hull = convex_hull(std::move(anchors));
+    stats.hull_vertices = hull.size();
+
+    std::unordered_map<long, double> hull_distance;
+    hull_distance.reserve(graph.size());
+    for (const auto &entry : graph)
+    {
+        const auto node_it = nodes.find(entry.first);
+        if (node_it == nodes.end())
+        {
+            continue;
+        }
+        hull_distance[entry.first] = distance_to_hull(project(node_it->second.lat, node_it->second.lon, reference_lat), hull);
+    }
+
+    std::unordered_map<long, bool> keep;
+    keep.reserve(hull_distance.size());
+    for (const auto &[node_id, distance] : hull_distance)
+    {
+        if (roi.margin_metres > 0.0 && distance <= roi.margin_metres)
+        {
+            keep[node_id] = true;
+        }
+    }
+
+    if (roi.margin_seconds > 0.0)
+    {
+        // Multi-source sweep from every node inside the hull. Edges are used in
+        // both directions: a node is near if it is close by road either way.
+        Graph undirected;
+        undirected.reserve(graph.size());
+        for (const auto &[node_id, edges] : graph)
+        {
+            for (const auto &edge : edges)
+            {
+                undirected[node_id].push_back(edge);
+                undirected[edge.first].push_back({node_id, edge.second});
+            }
+        }
+
+        std::unordered_map<long, double> travel;
+        std::priority_queue<std::pair<double, long>, std::vector<std::pair<double, long>>, std::greater<std::pair<double, long>>> pq;
+        // Seed from inside the hull, or from the closest nodes when the hull is
+        // degenerate (a single centre and no student area).
+        double seed_distance = std::numeric_limits<double>::max();
+        for (const auto &entry : hull_distance)
+        {
+            seed_distance = std::min(seed_distance, entry.second);
+        }
+        for (const auto &[node_id, distance] : hull_distance)
+        {
+            if (distance <= seed_distance)
+            {
+                travel[node_id] = 0.0;
+                pq.push({0.0, node_id});
+            }
+        }
 
-                const double dist_meters = haversine(
-                    nodes[node1_id].lat, nodes[node1_id].lon,
-                    nodes[node2_id].lat, nodes[node2_id].lon);
-                const double dist_km = dist_meters / 1000.0;
-                const double time_hours = dist_km / speed_kmh;
-                const double time_seconds = time_hours * 3600.0;
+        while (!pq.empty())
+        {
+            const auto [current_dist, current] = pq.top();
+            pq.pop();
+            if (current_dist > travel[current])
+            {
+                continue;
+            }
+            keep[current] = true;
 
-                if (is_oneway)
+            for (const auto &[neighbor, weight] : undirected[current])
+            {
+                const double next = current_dist + weight;
+                if (next > roi.margin_seconds || hull_distance.find(neighbor) == hull_distance.end())
                 {
-                    graph[node1_id].push_back({node2_id, time_seconds});
-                    edge_count++;
-                    oneway_count++;
+                    continue;
                 }
-                else
+                const auto it = travel.find(neighbor);
+                if (it == travel.end() || next < it->second)
                 {
-                    graph[node1_id].push_back({node2_id, time_seconds});
-                    graph[node2_id].push_back({node1_id, time_seconds});
-                    edge_count += 2;
+                    travel[neighbor] = next;
+                    pq.push({next, neighbor});
                 }
             }
         }
     }
 
-    std::cout << "Graph built with " << nodes.size() << " nodes and " << edge_count << " directed edges." << std::endl;
-    std::cout << "Identified " << oneway_count << " one-way segments." << std::endl;
+    Graph pruned;
+    pruned.reserve(keep.size());
+    for (const auto &[node_id, edges] : graph)
+    {
+        if (!keep.count(node_id))
+        {
+            continue;
+        }
+
+        std::vector<std::pair<long, double>> kept_edges;
+        kept_edges.reserve(edges.size());
+        for (const auto &edge : edges)
+        {
+            if (keep.count(edge.first))
+            {
+                kept_edges.push_back(edge);
+            }
+        }
+        if (!kept_edges.empty())
+        {
+            pruned.emplace(node_id, std::move(kept_edges));
+        }
+    }
+    graph = std::move(pruned);
+
+    stats.nodes_kept = count_graph_nodes(graph);
+    stats.edges_kept = count_graph_edges(graph);
 
-    compute_connected_components();
+    std::cout << "Region-of-interest pruning kept " << stats.nodes_kept << " of " << stats.nodes_before
+              << " nodes and " << stats.edges_kept << " of " << stats.edges_before << " edges." << std::endl;
+
+    return stats;
+}
+
+void build_dense_graph(GraphSnapshot &draft)
+{
+    const Graph &graph = draft.graph;
+
+    DenseGraph dense;
+    dense.index_of.reserve(graph.size());
+
+    const auto intern = [&dense](long node_id)
+    {
+        const auto inserted = dense.index_of.emplace(node_id, static_cast<int>(dense.node_ids.size()));
+        if (inserted.second)
+        {
+            dense.node_ids.push_back(node_id);
+        }
+        return inserted.first->second;
+    };
+
+    size_t edge_total = 0;
+    for (const auto &[node_id, edges] : graph)
+    {
+        intern(node_id);
+        for (const auto &edge : edges)
+        {
+            intern(edge.first);
+        }
+        edge_total += edges.size();
+    }
+
+    const int n = dense.size();
+    dense.offsets.assign(n + 1, 0);
+    dense.reverse_offsets.assign(n + 1, 0);
+    for (const auto &[node_id, edges] : graph)
+    {
+        dense.offsets[dense.index_of[node_id] + 1] += static_cast<int>(edges.size());
+        for (const auto &edge : edges)
+        {
+            dense.reverse_offsets[dense.index_of[edge.first] + 1]++;
+        }
+    }
+    for (int i = 0; i < n; i++)
+    {
+        dense.offsets[i + 1] += dense.offsets[i];
+        dense.reverse_offsets[i + 1] += dense.reverse_offsets[i];
+    }
+
+    dense.targets.resize(edge_total);
+    dense.weights.resize(edge_total);
+    dense.reverse_targets.resize(edge_total);
+    dense.reverse_weights.resize(edge_total);
+    std::vector<int> reverse_cursor(dense.reverse_offsets.begin(), dense.reverse_offsets.end() - 1);
+
+    for (const auto &[node_id, edges] : graph)
+    {
+        const int from = dense.index_of[node_id];
+        int cursor = dense.offsets[from];
+        for (const auto &edge : edges)
+        {
+            const int to = dense.index_of[edge.first];
+            dense.targets[cursor] = to;
+            dense.weights[cursor] = edge.second;
+            cursor++;
+
+            const int slot = reverse_cursor[to]++;
+            dense.reverse_targets[slot] = from;
+            dense.reverse_weights[slot] = edge.second;
+        }
+    }
+
+    draft.dense_graph = std::move(dense);
+    std::cout << "Dense graph ready: " << draft.dense_graph.size() << " nodes, " << edge_total << " edges." << std::endl;
 }
 
-void generate_simulated_graph_fallback(double min_lat, double min_lon, double max_lat, double max_lon)
+void generate_simulated_graph_fallback(GraphSnapshot &draft, double min_lat, double min_lon, double max_lat, double max_lon)
 {
     std::cout << "Generating simulated fallback graph..." << std::endl;
 
+    auto &nodes = draft.nodes;
     nodes.clear();
-    graph.clear();
+    draft.graph.clear();
+    draft.full_graph_detail = "high";
+    auto full_graph_ptr = std::make_shared<ClassifiedGraph>();
+    ClassifiedGraph &full_graph = *full_graph_ptr;
 
     constexpr int grid_size = 80;
     const double lat_step = (max_lat - min_lat) / grid_size;
@@ -221,9 +1008,9 @@ void generate_simulated_graph_fallback(double min_lat, double min_lon, double ma
                     nodes[neighbor].lat, nodes[neighbor].lon);
 
                 bool exists = false;
-                for (const auto &edge : graph[current])
+                for (const auto &edge : full_graph[current])
                 {
-                    if (edge.first == neighbor)
+                    if (edge.to == neighbor)
                     {
                         exists = true;
                         break;
@@ -232,7 +1019,7 @@ void generate_simulated_graph_fallback(double min_lat, double min_lon, double ma
 
                 if (!exists)
                 {
-                    graph[current].push_back({neighbor, dist});
+                    full_graph[current].push_back({neighbor, dist, HighwayClass::Other});
                 }
             }
         }
@@ -240,28 +1027,57 @@ void generate_simulated_graph_fallback(double min_lat, double min_lon, double ma
 
     std::cout << "Simulated graph generated with " << nodes.size() << " nodes." << std::endl;
 
-    compute_connected_components();
+    draft.full_graph = std::move(full_graph_ptr);
+    apply_graph_detail(draft, draft.full_graph_detail);
 }
 
-void build_allotment_lookup()
+// One reverse Dijkstra per centre over the dense graph, so each column holds
+// the travel time from every node *to* that centre (one-way streets respected).
+// With `keep_path_trees` the searches' parent arrays are kept as well, which
+// turns any route to a centre into a walk along next hops.
+void build_allotment_lookup(GraphSnapshot &draft, bool keep_path_trees)
 {
     std::cout << "Precomputing distance lookup for centres..." << std::endl;
 
-    allotment_lookup_map.clear();
+    const DenseGraph &dense_graph = draft.dense_graph;
+    const auto &centres = draft.centres;
 
-    for (const auto &centre : centres)
+    DistanceTable table;
+    table.centre_count = static_cast<int>(centres.size());
+    table.node_count = dense_graph.size();
+    table.by_centre.resize(centres.size());
+    if (keep_path_trees)
     {
-        std::cout << "Running Dijkstra from centre " << centre.centre_id << "..." << std::endl;
-
-        const auto distances = dijkstra(centre.snapped_node_id);
+        table.next_hop_by_centre.resize(centres.size());
+    }
 
-        for (const auto &[node_id, dist] : distances)
+    parallel_for_ranges(centres.size(), worker_count(centres.size()), [&](unsigned, size_t begin, size_t end)
+                        {
+        for (size_t c = begin; c < end; c++)
         {
-            allotment_lookup_map[node_id][centre.centre_id] = dist;
-        }
-    }
+            table.by_centre[c] = dijkstra_dense(dense_graph, dense_graph.index(centres[c].snapped_node_id), true,
+                                                keep_path_trees ? &table.next_hop_by_centre[c] : nullptr);
+        } });
 
-    std::cout << "Allotment lookup table ready." << std::endl;
+    draft.distance_table = std::move(table);
+
+    std::cout << "Allotment lookup table ready (" << draft.distance_table.centre_count << " centres x "
+              << draft.distance_table.node_count << " nodes"
+              << (keep_path_trees ? ", with path trees" : "") << ")." << std::endl;
+
+    // Nearest and runner-up centre of every node from one multi-source sweep.
+    const auto voronoi_start = std::chrono::high_resolution_clock::now();
+    std::vector<int> sources;
+    sources.reserve(centres.size());
+    for (const auto &centre : centres)
+    {
+        sources.push_back(dense_graph.index(centre.snapped_node_id));
+    }
+    draft.voronoi = network_voronoi(dense_graph, sources, true);
+    const auto voronoi_end = std::chrono::high_resolution_clock::now();
+    std::cout << "Network Voronoi partition ready in "
+              << std::chrono::duration_cast<std::chrono::milliseconds>(voronoi_end - voronoi_start).count()
+              << " ms." << std::endl;
 }
 
 } // namespace route_finder
@@ -0,0 +1,503 @@
+#include "route_finder/snapshot_io.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#include "route_finder/kdtree.hpp"
+
+namespace route_finder
+{
+namespace
+{
+
+constexpr char kMagic[8] = {'R', 'F', 'S', 'N', 'A', 'P', '\0', '\0'};
+constexpr std::uint32_t kFormatVersion = 3;
+
+class SnapshotWriter
+{
+public:
+    explicit SnapshotWriter(std::ostream &out) : out_(out) {}
+
+    template <typename T>
+    void pod(const T &value)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "pod() needs a trivially copyable type");
+        out_.write(reinterpret_cast<const char *>(&value), sizeof(T));
+    }
+
+    void count(size_t n)
+    {
+        pod(static_cast<std::uint64_t>(n));
+    }
+
+    template <typename T>
+    void array(const std::vector<T> &values)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "array() needs a trivially copyable type");
+        count(values.size());
+        if (!values.empty())
+        {
+            out_.write(reinterpret_cast<const char *>(values.data()), values.size() * sizeof(T));
+        }
+    }
+
+    void string(const std::string &value)
+    {
+        count(value.size());
+        out_.write(value.data(), value.size());
+    }
+
+private:
+    std::ostream &out_;
+};
+
+// Every length is checked against the bytes left in the file, so a truncated
+// or corrupt image fails cleanly instead of triggering a huge allocation.
+class SnapshotReader
+{
+public:
+    SnapshotReader(std::istream &in, std::uint64_t size) : in_(in), remaining_(size) {}
+
+    template <typename T>
+    T pod()
+    {
+        take(sizeof(T));
+        T value{};
+        in_.read(reinterpret_cast<char *>(&value), sizeof(T));
+        return value;
+    }
+
+    size_t count(size_t element_bytes)
+    {
+        const auto n = pod<std::uint64_t>();
+        if (element_bytes > 0 && n > remaining_ / element_bytes)
+        {
+            throw std::runtime_error("graph snapshot is truncated");
+        }
+        return static_cast<size_t>(n);
+    }
+
+    template <typename T>
+    void array(std::vector<T> &values)
+    {
+        values.resize(count(sizeof(T)));
+        take(values.size() * sizeof(T));
+        if (!values.empty())
+        {
+            in_.read(reinterpret_cast<char *>(values.data()), values.size() * sizeof(T));
+        }
+    }
+
+    std::string string()
+    {
+        std::string value(count(1), '\0');
+        take(value.size());
+        in_.read(&value[0], value.size());
+        return value;
+    }
+
+private:
+    void take(std::uint64_t bytes)
+    {
+        if (bytes > remaining_ || !in_)
+        {
+            throw std::runtime_error("graph snapshot is truncated");
+        }
+        remaining_ -= bytes;
+    }
+
+    std::istream &in_;
+    std::uint64_t remaining_;
+};
+
+template <typename Map>
+size_t map_bytes(const Map &map)
+{
+    // Node-based hash map: value plus a next pointer and allocator overhead
+    // per entry, and one pointer per bucket.
+    return map.size() * (sizeof(typename Map::value_type) + 2 * sizeof(void *)) +
+           map.bucket_count() * sizeof(void *);
+}
+
+template <typename T>
+size_t vector_bytes(const std::vector<T> &values)
+{
+    return values.capacity() * sizeof(T);
+}
+
+void write_snapshot(SnapshotWriter &out, const GraphSnapshot &snapshot)
+{
+    out.string(snapshot.full_graph_detail);
+    out.pod<std::uint8_t>(snapshot.has_source_bounds ? 1 : 0);
+    out.pod(snapshot.source_bounds);
+
+    out.pod<std::uint8_t>(snapshot.full_graph ? 1 : 0);
+    if (snapshot.full_graph)
+    {
+        out.count(snapshot.full_graph->size());
+        for (const auto &[node_id, edges] : *snapshot.full_graph)
+        {
+            out.pod(node_id);
+            out.count(edges.size());
+            for (const auto &edge : edges)
+            {
+                out.pod(edge.to);
+                out.pod(edge.time_seconds);
+                out.pod(edge.highway_class);
+            }
+        }
+    }
+
+    out.count(snapshot.graph.size());
+    for (const auto &[node_id, edges] : snapshot.graph)
+    {
+        out.pod(node_id);
+        out.count(edges.size());
+        for (const auto &edge : edges)
+        {
+            out.pod(edge.first);
+            out.pod(edge.second);
+        }
+    }
+
+    out.count(snapshot.edge_shapes.size());
+    for (const auto &[key, shape] : snapshot.edge_shapes)
+    {
+        out.pod(key.first);
+        out.pod(key.second);
+        out.pod(shape);
+    }
+    out.count(snapshot.edge_shape_points.size());
+    for (const auto &point : snapshot.edge_shape_points)
+    {
+        out.pod(point.first);
+        out.pod(point.second);
+    }
+
+    out.count(snapshot.nodes.size());
+    for (const auto &entry : snapshot.nodes)
+    {
+        out.pod(entry.second);
+    }
+
+    out.count(snapshot.node_component.size());
+    for (const auto &[node_id, component] : snapshot.node_component)
+    {
+        out.pod(node_id);
+        out.pod(component);
+    }
+    out.pod(snapshot.main_component_id);
+    out.pod(snapshot.build_id);
+
+    const DenseGraph &dense = snapshot.dense_graph;
+    out.array(dense.node_ids);
+    out.array(dense.offsets);
+    out.array(dense.targets);
+    out.array(dense.weights);
+    out.array(dense.reverse_offsets);
+    out.array(dense.reverse_targets);
+    out.array(dense.reverse_weights);
+
+    out.count(snapshot.centres.size());
+    for (const auto &centre : snapshot.centres)
+    {
+        out.string(centre.centre_id);
+        out.pod(centre.lat);
+        out.pod(centre.lon);
+        out.pod(centre.snapped_node_id);
+        out.pod(centre.max_capacity);
+        out.pod(centre.current_load);
+        out.pod<std::uint8_t>(centre.has_wheelchair_access ? 1 : 0);
+        out.pod<std::uint8_t>(centre.is_female_only ? 1 : 0);
+    }
+
+    out.pod(snapshot.distance_table.centre_count);
+    out.pod(snapshot.distance_table.node_count);
+    out.count(snapshot.distance_table.by_centre.size());
+    for (const auto &column : snapshot.distance_table.by_centre)
+    {
+        out.array(column);
+    }
+    out.count(snapshot.distance_table.next_hop_by_centre.size());
+    for (const auto &column : snapshot.distance_table.next_hop_by_centre)
+    {
+        out.array(column);
+    }
+
+    out.array(snapshot.voronoi.nearest);
+    out.array(snapshot.voronoi.nearest_time);
+    out.array(snapshot.voronoi.runner_up);
+    out.array(snapshot.voronoi.runner_up_time);
+}
+
+void read_snapshot(SnapshotReader &in, GraphSnapshot &snapshot)
+{
+    snapshot.full_graph_detail = in.string();
+    snapshot.has_source_bounds = in.pod<std::uint8_t>() != 0;
+    snapshot.source_bounds = in.pod<GraphBounds>();
+
+    if (in.pod<std::uint8_t>() != 0)
+    {
+        auto full_graph = std::make_shared<ClassifiedGraph>();
+        const size_t count = in.count(sizeof(long) + sizeof(std::uint64_t));
+        full_graph->reserve(count);
+        for (size_t i = 0; i < count; i++)
+        {
+            const long node_id = in.pod<long>();
+            auto &edges = (*full_graph)[node_id];
+            edges.resize(in.count(sizeof(long) + sizeof(double) + sizeof(HighwayClass)));
+            for (auto &edge : edges)
+            {
+                edge.to = in.pod<long>();
+                edge.time_seconds = in.pod<double>();
+                edge.highway_class = in.pod<HighwayClass>();
+            }
+        }
+        snapshot.full_graph = std::move(full_graph);
+    }
+
+    const size_t graph_count = in.count(sizeof(long) + sizeof(std::uint64_t));
+    snapshot.graph.reserve(graph_count);
+    for (size_t i = 0; i < graph_count; i++)
+    {
+        const long node_id = in.pod<long>();
+        auto &edges = snapshot.graph[node_id];
+        edges.resize(in.count(sizeof(long) + sizeof(double)));
+        for (auto &edge : edges)
+        {
+            edge.first = in.pod<long>();
+            edge.second = in.pod<double>();
+        }
+    }
+
+    const size_t shape_count = in.count(2 * sizeof(long) + sizeof(EdgeShape));
+    snapshot.edge_shapes.reserve(shape_count);
+    for (size_t i = 0; i < shape_count; i++)
+    {
+        const long from = in.pod<long>();
+        const long to = in.pod<long>();
+        snapshot.edge_shapes[{from, to}] = in.pod<EdgeShape>();
+    }
+    snapshot.edge_shape_points.resize(in.count(2 * sizeof(double)));
+    for (auto &point : snapshot.edge_shape_points)
+    {
+        point.first = in.pod<double>();
+        point.second = in.pod<double>();
+    }
+
+    const size_t node_count = in.count(sizeof(Node));
+    snapshot.nodes.reserve(node_count);
+    for (size_t i = 0; i < node_count; i++)
+    {
+        const Node node = in.pod<Node>();
+        snapshot.nodes[node.id] = node;
+    }
+
+    const size_t component_count = in.count(sizeof(long) + sizeof(int));
+    snapshot.node_component.reserve(component_count);
+    for (size_t i = 0; i < component_count; i++)
+    {
+        const long node_id = in.pod<long>();
+        snapshot.node_component[node_id] = in.pod<int>();
+    }
+    snapshot.main_component_id = in.pod<int>();
+    snapshot.build_id = in.pod<std::uint64_t>();
+
+    DenseGraph &dense = snapshot.dense_graph;
+    in.array(dense.node_ids);
+    in.array(dense.offsets);
+    in.array(dense.targets);
+    in.array(dense.weights);
+    in.array(dense.reverse_offsets);
+    in.array(dense.reverse_targets);
+    in.array(dense.reverse_weights);
+    dense.index_of.reserve(dense.node_ids.size());
+    for (size_t i = 0; i < dense.node_ids.size(); i++)
+    {
+        dense.index_of.emplace(dense.node_ids[i], static_cast<int>(i));
+    }
+
+    snapshot.centres.resize(in.count(sizeof(std::uint64_t)));
+    for (auto &centre : snapshot.centres)
+    {
+        centre.centre_id = in.string();
+        centre.lat = in.pod<double>();
+        centre.lon = in.pod<double>();
+        centre.snapped_node_id = in.pod<long>();
+        centre.max_capacity = in.pod<int>();
+        centre.current_load = in.pod<int>();
+        centre.has_wheelchair_access = in.pod<std::uint8_t>() != 0;
+        centre.is_female_only = in.pod<std::uint8_t>() != 0;
+    }
+
+    snapshot.distance_table.centre_count = in.pod<int>();
+    snapshot.distance_table.node_count = in.pod<int>();
+    snapshot.distance_table.by_centre.resize(in.count(sizeof(std::uint64_t)));
+    for (auto &column : snapshot.distance_table.by_centre)
+    {
+        in.array(column);
+    }
+    snapshot.distance_table.next_hop_by_centre.resize(in.count(sizeof(std::uint64_t)));
+    for (auto &column : snapshot.distance_table.next_hop_by_centre)
+    {
+        in.array(column);
+    }
+
+    in.array(snapshot.voronoi.nearest);
+    in.array(snapshot.voronoi.nearest_time);
+    in.array(snapshot.voronoi.runner_up);
+    in.array(snapshot.voronoi.runner_up_time);
+}
+
+} // namespace
+
+// Written to a temporary file and renamed into place, so a reader never sees
+// a half-written image.
+bool save_graph_snapshot(const GraphSnapshot &snapshot, const std::string &path)
+{
+    try
+    {
+        const std::filesystem::path target(path);
+        if (target.has_parent_path())
+        {
+            std::filesystem::create_directories(target.parent_path());
+        }
+
+        const std::string temporary = path + ".tmp";
+        {
+            std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+            if (!out.good())
+            {
+                std::cerr << "Cannot write graph snapshot to " << temporary << std::endl;
+                return false;
+            }
+
+            SnapshotWriter writer(out);
+            out.write(kMagic, sizeof(kMagic));
+            writer.pod(kFormatVersion);
+            writer.pod(static_cast<std::uint32_t>(sizeof(long)));
+            write_snapshot(writer, snapshot);
+
+            out.flush();
+            if (!out.good())
+            {
+                std::cerr << "Failed while writing graph snapshot " << temporary << std::endl;
+                return false;
+            }
+        }
+
+        std::filesystem::rename(temporary, target);
+        return true;
+    }
+    catch (const std::exception &ex)
+    {
+        std::cerr << "Error saving graph snapshot " << path << ": " << ex.what() << std::endl;
+        return false;
+    }
+}
+
+std::shared_ptr<GraphSnapshot> load_graph_snapshot(const std::string &path)
+{
+    try
+    {
+        std::ifstream in(path, std::ios::binary);
+        if (!in.good())
+        {
+            std::cerr << "Graph snapshot " << path << " not found." << std::endl;
+            return nullptr;
+        }
+
+        SnapshotReader reader(in, std::filesystem::file_size(path));
+        char magic[sizeof(kMagic)];
+        for (char &c : magic)
+        {
+            c = reader.pod<char>();
+        }
+        if (std::memcmp(magic, kMagic, sizeof(kMagic)) != 0 ||
+            reader.pod<std::uint32_t>() != kFormatVersion ||
+            reader.pod<std::uint32_t>() != sizeof(long))
+        {
+            std::cerr << "Graph snapshot " << path << " has an unknown format." << std::endl;
+            return nullptr;
+        }
+
+        auto snapshot = std::make_shared<GraphSnapshot>();
+        read_snapshot(reader, *snapshot);
+        build_snapshot_kdtree(*snapshot);
+        return snapshot;
+    }
+    catch (const std::exception &ex)
+    {
+        std::cerr << "Error loading graph snapshot " << path << ": " << ex.what() << std::endl;
+        return nullptr;
+    }
+}
+
+size_t snapshot_memory_bytes(const GraphSnapshot &snapshot)
+{
+    size_t bytes = sizeof(GraphSnapshot);
+
+    bytes += map_bytes(snapshot.graph);
+    for (const auto &entry : snapshot.graph)
+    {
+        bytes += vector_bytes(entry.second);
+    }
+    if (snapshot.full_graph)
+    {
+        bytes += map_bytes(*snapshot.full_graph);
+        for (const auto &entry : *snapshot.full_graph)
+        {
+            bytes += vector_bytes(entry.second);
+        }
+    }
+
+    bytes += map_bytes(snapshot.edge_shapes) + vector_bytes(snapshot.edge_shape_points);
+    bytes += map_bytes(snapshot.nodes) + map_bytes(snapshot.node_component);
+
+    const DenseGraph &dense = snapshot.dense_graph;
+    bytes += vector_bytes(dense.node_ids) + map_bytes(dense.index_of);
+    bytes += vector_bytes(dense.offsets) + vector_bytes(dense.targets) + vector_bytes(dense.weights);
+    bytes += vector_bytes(dense.reverse_offsets) + vector_bytes(dense.reverse_targets) + vector_bytes(dense.reverse_weights);
+
+    std::vector<const KDTreeNode *> stack;
+    if (snapshot.kdtree_root)
+    {
+        stack.push_back(snapshot.kdtree_root.get());
+    }
+    while (!stack.empty())
+    {
+        const KDTreeNode *node = stack.back();
+        stack.pop_back();
+        bytes += sizeof(KDTreeNode);
+        if (node->left)
+        {
+            stack.push_back(node->left);
+        }
+        if (node->right)
+        {
+            stack.push_back(node->right);
+        }
+    }
+
+    bytes += vector_bytes(snapshot.centres);
+    for (const auto &column : snapshot.distance_table.by_centre)
+    {
+        bytes += vector_bytes(column);
+    }
+    for (const auto &column : snapshot.distance_table.next_hop_by_centre)
+    {
+        bytes += vector_bytes(column);
+    }
+    bytes += vector_bytes(snapshot.voronoi.nearest) + vector_bytes(snapshot.voronoi.nearest_time);
+    bytes += vector_bytes(snapshot.voronoi.runner_up) + vector_bytes(snapshot.voronoi.runner_up_time);
+
+    return bytes;
+}
+
+} // namespace route_finder
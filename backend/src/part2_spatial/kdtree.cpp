@@ -1,15 +1,21 @@
 #include "route_finder/kdtree.hpp"
 
 #include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
+#include <cstdint>
 #include <iostream>
 #include <limits>
+#include <mutex>
 #include <set>
+#include <thread>
 #include <unordered_map>
 #include <utility>
 #include <vector>
 
 #include "route_finder/geometry.hpp"
+#include "route_finder/parallel.hpp"
 #include "route_finder/state.hpp"
 
 namespace route_finder
@@ -46,7 +52,31 @@ KDTreeNode *build_kdtree(std::vector<std::pair<long, std::pair<double, double>>>
     return node;
 }
 
-void kdtree_nearest_helper(KDTreeNode *node, double target_lat, double target_lon, long &best_id, double &best_dist)
+// Only the largest strongly connected component is indexed, so every snap
+// lands on a node that can reach and be reached by every centre.
+void build_snapshot_kdtree(GraphSnapshot &draft)
+{
+    const DenseGraph &dense_graph = draft.dense_graph;
+    std::cout << "Building KD-tree for " << draft.nodes.size() << " nodes..." << std::endl;
+
+    std::vector<std::pair<long, std::pair<double, double>>> node_points;
+    node_points.reserve(dense_graph.size());
+
+    for (const long node_id : dense_graph.node_ids)
+    {
+        if (draft.node_component_of(node_id) == draft.main_component_id)
+        {
+            const auto &node = draft.nodes.at(node_id);
+            node_points.push_back({node_id, {node.lat, node.lon}});
+        }
+    }
+
+    std::cout << "KD-tree will be built from " << node_points.size() << " main-component nodes." << std::endl;
+
+    draft.kdtree_root.reset(build_kdtree(node_points, 0));
+}
+
+void kdtree_nearest_helper(const KDTreeNode *node, double target_lat, double target_lon, long &best_id, double &best_dist)
 {
     if (!node)
     {
@@ -62,8 +92,8 @@ void kdtree_nearest_helper(KDTreeNode *node, double target_lat, double target_lo
     }
 
     double diff = (node->axis == 0) ? (target_lat - node->lat) : (target_lon - node->lon);
-    KDTreeNode *near_side = (diff < 0) ? node->left : node->right;
-    KDTreeNode *far_side = (diff < 0) ? node->right : node->left;
+    const KDTreeNode *near_side = (diff < 0) ? node->left : node->right;
+    const KDTreeNode *far_side = (diff < 0) ? node->right : node->left;
 
     kdtree_nearest_helper(near_side, target_lat, target_lon, best_id, best_dist);
 
@@ -74,13 +104,13 @@ void kdtree_nearest_helper(KDTreeNode *node, double target_lat, double target_lo
     }
 }
 
-long find_nearest_node(double lat, double lon)
+long find_nearest_node(const GraphSnapshot &snapshot, double lat, double lon)
 {
-    if (kdtree_root)
+    if (snapshot.kdtree_root)
     {
         long best_id = -1;
         double best_dist = std::numeric_limits<double>::max();
-        kdtree_nearest_helper(kdtree_root, lat, lon, best_id, best_dist);
+        kdtree_nearest_helper(snapshot.kdtree_root.get(), lat, lon, best_id, best_dist);
 
         if (best_id != -1)
         {
@@ -88,7 +118,7 @@ long find_nearest_node(double lat, double lon)
         }
     }
 
-    std::vector<long> nearest = find_k_nearest_nodes(lat, lon, 1);
+    std::vector<long> nearest = find_k_nearest_nodes(snapshot, lat, lon, 1);
 
     if (nearest.empty())
     {
@@ -98,8 +128,11 @@ long find_nearest_node(double lat, double lon)
     return nearest[0];
 }
 
-std::vector<long> find_k_nearest_nodes(double lat, double lon, int k)
+std::vector<long> find_k_nearest_nodes(const GraphSnapshot &snapshot, double lat, double lon, int k)
 {
+    const Graph &graph = snapshot.graph;
+    const auto &nodes = snapshot.nodes;
+
     std::vector<std::pair<double, long>> distances;
     distances.reserve(nodes.size());
 
@@ -120,7 +153,10 @@ std::vector<long> find_k_nearest_nodes(double lat, double lon, int k)
         return {};
     }
 
-    std::nth_element(distances.begin(), distances.begin() + k_safe - 1, distances.end());
+    // Nearest first, ties by id: callers try candidates in order, and the
+    // answer must not depend on hash-map iteration order (which differs once
+    // a graph session is reloaded from disk).
+    std::partial_sort(distances.begin(), distances.begin() + k_safe, distances.end());
 
     std::vector<long> result;
     result.reserve(k_safe);
@@ -132,13 +168,13 @@ std::vector<long> find_k_nearest_nodes(double lat, double lon, int k)
     return result;
 }
 
-long find_best_snap_node_fast(double lat, double lon)
+long find_best_snap_node_fast(const GraphSnapshot &snapshot, double lat, double lon)
 {
-    if (kdtree_root)
+    if (snapshot.kdtree_root)
     {
         long best_id = -1;
         double best_dist = std::numeric_limits<double>::max();
-        kdtree_nearest_helper(kdtree_root, lat, lon, best_id, best_dist);
+        kdtree_nearest_helper(snapshot.kdtree_root.get(), lat, lon, best_id, best_dist);
 
         if (best_id != -1)
         {
@@ -149,9 +185,10 @@ long find_best_snap_node_fast(double lat, double lon)
     long best_node = -1;
     double best_dist = std::numeric_limits<double>::max();
 
-    for (const auto &[node_id, node] : nodes)
+    for (const auto &[node_id, node] : snapshot.nodes)
     {
-        if (graph.find(node_id) == graph.end() || graph[node_id].empty())
+        const auto graph_it = snapshot.graph.find(node_id);
+        if (graph_it == snapshot.graph.end() || graph_it->second.empty())
         {
             continue;
         }
@@ -167,84 +204,247 @@ long find_best_snap_node_fast(double lat, double lon)
     return best_node;
 }
 
-void compute_connected_components()
+// Labels strongly connected components of the draft's dense graph, so two nodes share a
+// label only if each can reach the other. Nodes that cannot lie on a cycle
+// are trimmed first; the rest is split with forward-backward reachability
+// (pivot's forward set ∩ backward set is one SCC, the three remainders are
+// independent subproblems) and the subproblems run on a worker pool.
+void compute_connected_components(GraphSnapshot &draft)
 {
+    auto &node_component = draft.node_component;
+    int &main_component_id = draft.main_component_id;
     node_component.clear();
-    int comp_id = 0;
-    std::vector<long> stack;
-    for (const auto &p : nodes)
+    main_component_id = -1;
+
+    const DenseGraph &g = draft.dense_graph;
+    const int n = g.size();
+    std::vector<int> component(n, 0);
+    std::atomic<int> next_component{0};
+
+    std::vector<int> in_degree(n);
+    std::vector<int> out_degree(n);
+    std::vector<int> trim_queue;
+    for (int v = 0; v < n; v++)
     {
-        long nid = p.first;
-        if (node_component.find(nid) != node_component.end())
+        out_degree[v] = g.offsets[v + 1] - g.offsets[v];
+        in_degree[v] = g.reverse_offsets[v + 1] - g.reverse_offsets[v];
+        if (in_degree[v] == 0 || out_degree[v] == 0)
         {
-            continue;
+            trim_queue.push_back(v);
+            component[v] = ++next_component;
+        }
+    }
+    for (size_t head = 0; head < trim_queue.size(); head++)
+    {
+        const int v = trim_queue[head];
+        for (int e = g.offsets[v]; e < g.offsets[v + 1]; e++)
+        {
+            const int w = g.targets[e];
+            if (component[w] == 0 && --in_degree[w] == 0)
+            {
+                component[w] = ++next_component;
+                trim_queue.push_back(w);
+            }
         }
-        if (graph.find(nid) == graph.end() || graph[nid].empty())
+        for (int e = g.reverse_offsets[v]; e < g.reverse_offsets[v + 1]; e++)
         {
-            node_component[nid] = -1;
-            continue;
+            const int u = g.reverse_targets[e];
+            if (component[u] == 0 && --out_degree[u] == 0)
+            {
+                component[u] = ++next_component;
+                trim_queue.push_back(u);
+            }
+        }
+    }
+    const size_t trimmed = trim_queue.size();
+
+    // Every subproblem gets a fresh colour; searches only cross nodes of their
+    // own colour, so concurrent tasks never touch the same node.
+    std::vector<std::atomic<int>> colour(n);
+    std::vector<std::uint8_t> reached(n, 0);
+    std::atomic<int> next_colour{1};
+
+    std::vector<std::vector<int>> tasks(1);
+    for (int v = 0; v < n; v++)
+    {
+        colour[v].store(component[v] == 0 ? 1 : 0, std::memory_order_relaxed);
+        if (component[v] == 0)
+        {
+            tasks[0].push_back(v);
         }
-        comp_id++;
-        stack.clear();
-        stack.push_back(nid);
-        node_component[nid] = comp_id;
+    }
+    if (tasks[0].empty())
+    {
+        tasks.clear();
+    }
+
+    std::mutex mutex;
+    std::condition_variable ready;
+    int active = 0;
+
+    const auto search = [&](int start, int task_colour, std::uint8_t bit,
+                            const std::vector<int> &offsets, const std::vector<int> &targets)
+    {
+        std::vector<int> stack = {start};
+        reached[start] |= bit;
         while (!stack.empty())
         {
-            long cur = stack.back();
+            const int v = stack.back();
             stack.pop_back();
-            if (graph.find(cur) == graph.end())
+            for (int e = offsets[v]; e < offsets[v + 1]; e++)
+            {
+                const int w = targets[e];
+                if (colour[w].load(std::memory_order_relaxed) == task_colour && !(reached[w] & bit))
+                {
+                    reached[w] |= bit;
+                    stack.push_back(w);
+                }
+            }
+        }
+    };
+
+    const auto split = [&](std::vector<int> members, std::vector<std::vector<int>> &subtasks)
+    {
+        const int task_colour = colour[members[0]].load(std::memory_order_relaxed);
+        const int pivot = members[0];
+        search(pivot, task_colour, 1, g.offsets, g.targets);
+        search(pivot, task_colour, 2, g.reverse_offsets, g.reverse_targets);
+
+        const int scc = ++next_component;
+        std::vector<int> parts[3];
+        for (const int v : members)
+        {
+            const std::uint8_t mark = reached[v];
+            reached[v] = 0;
+            if (mark == 3)
+            {
+                component[v] = scc;
+            }
+            else
+            {
+                parts[mark].push_back(v);
+            }
+        }
+
+        for (auto &part : parts)
+        {
+            if (part.empty())
             {
                 continue;
             }
-            for (auto &e : graph[cur])
+            const int part_colour = ++next_colour;
+            for (const int v : part)
             {
-                long nb = e.first;
-                if (node_component.find(nb) == node_component.end())
-                {
-                    node_component[nb] = comp_id;
-                    stack.push_back(nb);
-                }
+                colour[v].store(part_colour, std::memory_order_relaxed);
             }
+            subtasks.push_back(std::move(part));
         }
-    }
-    std::cerr << "Computed components, found " << comp_id << " components (isolated marked -1)\n";
-}
+    };
 
-long find_nearest_in_main_component(double lat, double lon)
-{
-    std::unordered_map<int, int> comp_count;
-    for (auto &p : node_component)
+    const auto worker = [&]()
     {
-        if (p.second > 0)
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true)
         {
-            comp_count[p.second]++;
+            ready.wait(lock, [&]()
+                       { return !tasks.empty() || active == 0; });
+            if (tasks.empty())
+            {
+                ready.notify_all();
+                return;
+            }
+
+            std::vector<int> members = std::move(tasks.back());
+            tasks.pop_back();
+            active++;
+            lock.unlock();
+
+            std::vector<std::vector<int>> subtasks;
+            split(std::move(members), subtasks);
+
+            lock.lock();
+            for (auto &subtask : subtasks)
+            {
+                tasks.push_back(std::move(subtask));
+            }
+            active--;
+            ready.notify_all();
         }
+    };
+
+    const unsigned workers = worker_count(n - trimmed, 10000);
+    std::vector<std::thread> threads;
+    for (unsigned i = 1; i < workers; i++)
+    {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+
+    std::vector<int> component_size(next_component + 1, 0);
+    for (int v = 0; v < n; v++)
+    {
+        component_size[component[v]]++;
     }
-    int main_comp = -1;
-    int maxc = 0;
-    for (auto &q : comp_count)
+    int largest = 0;
+    for (int id = 1; id <= next_component; id++)
     {
-        if (q.second > maxc)
+        if (component_size[id] > largest)
         {
-            maxc = q.second;
-            main_comp = q.first;
+            largest = component_size[id];
+            main_component_id = id;
         }
     }
+
+    node_component.reserve(draft.nodes.size());
+    for (const auto &entry : draft.nodes)
+    {
+        node_component[entry.first] = -1;
+    }
+    for (int v = 0; v < n; v++)
+    {
+        node_component[g.node_ids[v]] = component[v];
+    }
+
+    std::cerr << "Computed strongly connected components, found " << next_component.load() << " ("
+              << trimmed << " trimmed as trivial), largest has " << largest << " nodes using "
+              << workers << " worker(s)\n";
+}
+
+int find_main_component(const GraphSnapshot &snapshot)
+{
+    return snapshot.main_component_id;
+}
+
+long find_nearest_in_main_component(const GraphSnapshot &snapshot, double lat, double lon)
+{
+    const int main_comp = find_main_component(snapshot);
     if (main_comp == -1)
     {
-        return find_best_snap_node_fast(lat, lon);
+        return find_best_snap_node_fast(snapshot, lat, lon);
+    }
+
+    // The KD-tree only indexes the main component (see build_snapshot_kdtree).
+    if (snapshot.kdtree_root)
+    {
+        long best_id = -1;
+        double best_dist = std::numeric_limits<double>::max();
+        kdtree_nearest_helper(snapshot.kdtree_root.get(), lat, lon, best_id, best_dist);
+        if (best_id != -1)
+        {
+            return best_id;
+        }
     }
 
     long best = -1;
     double bd = std::numeric_limits<double>::max();
-    for (auto &p : nodes)
+    for (auto &p : snapshot.nodes)
     {
         long nid = p.first;
-        if (node_component.find(nid) == node_component.end())
-        {
-            continue;
-        }
-        if (node_component[nid] != main_comp)
+        if (snapshot.node_component_of(nid) != main_comp)
         {
             continue;
         }
@@ -258,7 +458,7 @@ long find_nearest_in_main_component(double lat, double lon)
     return best;
 }
 
-void snap_all_students_fast()
+void snap_all_students_fast(const GraphSnapshot &snapshot)
 {
     std::cout << "\n⚡ Snapping " << students.size() << " students to road network..." << std::endl;
 
@@ -268,14 +468,14 @@ void snap_all_students_fast()
 
     for (auto &student : students)
     {
-        student.snapped_node_id = find_best_snap_node_fast(student.lat, student.lon);
+        student.snapped_node_id = find_best_snap_node_fast(snapshot, student.lat, student.lon);
 
         if (student.snapped_node_id != -1)
         {
-            int comp = node_component.count(student.snapped_node_id) ? node_component[student.snapped_node_id] : -1;
+            int comp = snapshot.node_component_of(student.snapped_node_id);
             if (comp <= 0)
             {
-                long alt = find_nearest_in_main_component(student.lat, student.lon);
+                long alt = find_nearest_in_main_component(snapshot, student.lat, student.lon);
                 if (alt != -1)
                 {
                     student.snapped_node_id = alt;
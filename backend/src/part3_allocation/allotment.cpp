@@ -1,17 +1,20 @@
 #include "route_finder/allotment.hpp"
 
 #include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <functional>
 #include <iostream>
 #include <limits>
 #include <queue>
-#include <set>
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 
+#include "route_finder/geometry.hpp"
+#include "route_finder/parallel.hpp"
 #include "route_finder/state.hpp"
 
 namespace route_finder
@@ -19,182 +22,2202 @@ namespace route_finder
     namespace
     {
 
+        const char *const kSolverNames[] = {"greedy", "min_cost_flow", "auction", "bottleneck"};
+
         using AssignmentQueue = std::priority_queue<AssignmentPair, std::vector<AssignmentPair>, std::greater<AssignmentPair>>;
 
         void process_priority_queue(
             AssignmentQueue &queue,
-            std::set<std::string> &assigned_students,
-            std::unordered_map<std::string, int> &centre_loads)
+            std::vector<bool> &assigned,
+            AllotmentResult &result,
+            const AllotmentProblem &problem)
         {
             while (!queue.empty())
             {
                 const auto assignment = queue.top();
                 queue.pop();
 
-                if (assigned_students.count(assignment.student_id))
+                if (assigned[assignment.student])
+                {
+                    continue;
+                }
+
+                if (result.centre_load[assignment.centre] >= problem.capacity[assignment.centre])
                 {
                     continue;
                 }
 
-                Centre *target_centre = nullptr;
-                for (auto &centre : centres)
+                result.centre_of_student[assignment.student] = assignment.centre;
+                result.centre_load[assignment.centre]++;
+                result.assigned_count++;
+                assigned[assignment.student] = true;
+            }
+        }
+
+        void enqueue_student_options(
+            const AllotmentProblem &problem,
+            int student,
+            std::vector<AssignmentPair> &pairs)
+        {
+            const double *row = problem.row(student);
+            if (!row)
+            {
+                return;
+            }
+
+            problem.eligibility.for_each(problem.student_tier[student], problem.centre_count, [&](int centre)
+                                         {
+                if (row[centre] != std::numeric_limits<double>::max())
+                {
+                    pairs.push_back({row[centre], student, centre});
+                } });
+        }
+
+        // Per-student cursor over its centres in distance order. The first
+        // candidate is a plain scan of the row; a row is only sorted once one
+        // of its students is bumped, and the sorted order is shared by every
+        // student snapped to that node. Full centres never reopen during a
+        // greedy pass, so skipping them keeps the stream exact. Sorted rows
+        // cover every centre; ineligible ones are skipped by the cursor.
+        class CandidateStreams
+        {
+        public:
+            explicit CandidateStreams(const AllotmentProblem &problem)
+                : problem_(problem),
+                  sorted_rows_(problem.row_count()),
+                  cursor_(problem.student_count(), -1)
+            {
+            }
+
+            bool next(int student, const std::vector<int> &load, AssignmentPair &candidate)
+            {
+                const double *row = problem_.row(student);
+                if (!row)
+                {
+                    return false;
+                }
+
+                if (cursor_[student] < 0)
+                {
+                    cursor_[student] = 0;
+                    return best_open_centre(student, row, load, candidate);
+                }
+
+                const std::vector<int> &order = sorted_row(student, row);
+                int &cursor = cursor_[student];
+                while (cursor < static_cast<int>(order.size()))
                 {
-                    if (centre.centre_id == assignment.centre_id)
+                    const int centre = order[cursor++];
+                    if (load[centre] < problem_.capacity[centre] && problem_.eligible(student, centre))
+                    {
+                        candidate = {row[centre], student, centre};
+                        return true;
+                    }
+                }
+                return false;
+            }
+
+            size_t memory_bytes() const
+            {
+                return sorted_entries_ * sizeof(int) + sorted_rows_.size() * sizeof(std::vector<int>) +
+                       cursor_.size() * sizeof(int);
+            }
+
+        private:
+            bool best_open_centre(int student, const double *row, const std::vector<int> &load, AssignmentPair &candidate) const
+            {
+                int best = -1;
+                problem_.eligibility.for_each(problem_.student_tier[student], problem_.centre_count, [&](int centre)
+                                              {
+                    if (row[centre] == std::numeric_limits<double>::max() || load[centre] >= problem_.capacity[centre])
                     {
-                        target_centre = &centre;
-                        break;
+                        return;
                     }
+                    if (best < 0 || row[centre] < row[best])
+                    {
+                        best = centre;
+                    } });
+                if (best < 0)
+                {
+                    return false;
                 }
+                candidate = {row[best], student, best};
+                return true;
+            }
 
-                if (!target_centre)
+            const std::vector<int> &sorted_row(int student, const double *row)
+            {
+                std::vector<int> &order = sorted_rows_[problem_.student_row[student]];
+                if (order.empty())
                 {
-                    continue;
+                    for (int centre = 0; centre < problem_.centre_count; centre++)
+                    {
+                        if (row[centre] != std::numeric_limits<double>::max())
+                        {
+                            order.push_back(centre);
+                        }
+                    }
+                    std::sort(order.begin(), order.end(), [row](int a, int b)
+                              { return row[a] < row[b]; });
+                    sorted_entries_ += order.size();
                 }
+                return order;
+            }
+
+            const AllotmentProblem &problem_;
+            std::vector<std::vector<int>> sorted_rows_;
+            std::vector<int> cursor_;
+            size_t sorted_entries_ = 0;
+        };
+
+        // Lazy counterpart of process_priority_queue: a popped student whose
+        // centre has filled is re-pushed with its next open centre.
+        void process_candidate_streams(
+            AssignmentQueue &queue,
+            CandidateStreams &streams,
+            AllotmentResult &result,
+            const AllotmentProblem &problem,
+            size_t &peak_heap_entries)
+        {
+            while (!queue.empty())
+            {
+                const auto assignment = queue.top();
+                queue.pop();
 
-                if (centre_loads[assignment.centre_id] >= target_centre->max_capacity)
+                if (result.centre_load[assignment.centre] >= problem.capacity[assignment.centre])
                 {
+                    AssignmentPair next;
+                    if (streams.next(assignment.student, result.centre_load, next))
+                    {
+                        queue.push(next);
+                        peak_heap_entries = std::max(peak_heap_entries, queue.size());
+                    }
                     continue;
                 }
 
-                final_assignments[assignment.student_id] = assignment.centre_id;
-                assigned_students.insert(assignment.student_id);
-                centre_loads[assignment.centre_id]++;
-                target_centre->current_load = centre_loads[assignment.centre_id];
+                result.centre_of_student[assignment.student] = assignment.centre;
+                result.centre_load[assignment.centre]++;
+                result.assigned_count++;
             }
         }
 
-        void enqueue_student_options(
-            const Student &student,
-            AssignmentQueue &queue)
+        // Lexicographic flow cost: per-tier assignment counts (negative, male
+        // compared first) and then total travel time. Keeping the tiers as
+        // separate integer components avoids big-M weights on the seconds.
+        struct FlowCost
         {
-            const auto lookup_it = allotment_lookup_map.find(student.snapped_node_id);
-            if (lookup_it == allotment_lookup_map.end())
+            long long tier[kTierCount]{};
+            double time{};
+
+            FlowCost operator+(const FlowCost &other) const
             {
-                return;
+                FlowCost sum;
+                for (int t = 0; t < kTierCount; t++)
+                {
+                    sum.tier[t] = tier[t] + other.tier[t];
+                }
+                sum.time = time + other.time;
+                return sum;
             }
 
-            const auto &centre_distances = lookup_it->second;
+            FlowCost operator-(const FlowCost &other) const
+            {
+                FlowCost difference;
+                for (int t = 0; t < kTierCount; t++)
+                {
+                    difference.tier[t] = tier[t] - other.tier[t];
+                }
+                difference.time = time - other.time;
+                return difference;
+            }
 
-            for (const auto &centre : centres)
+            bool operator<(const FlowCost &other) const
             {
-                if (!is_valid_assignment(student, centre))
+                for (int t = 0; t < kTierCount; t++)
                 {
-                    continue;
+                    if (tier[t] != other.tier[t])
+                    {
+                        return tier[t] < other.tier[t];
+                    }
                 }
+                return time < other.time;
+            }
+
+            bool operator>(const FlowCost &other) const { return other < *this; }
+        };
+
+        // One seat at a centre. A centre's seats form a min-heap on price, so
+        // the seat a bidder takes (or whose holder it evicts) is seats[0].
+        struct AuctionSeat
+        {
+            double price{};
+            int holder = -1;
+
+            bool operator>(const AuctionSeat &other) const { return price > other.price; }
+        };
+
+        struct AuctionBid
+        {
+            double amount{};
+            int person{};
+            int centre{};
+        };
+
+        double second_cheapest_seat(const std::vector<AuctionSeat> &seats)
+        {
+            if (seats.size() < 2)
+            {
+                return std::numeric_limits<double>::infinity();
+            }
+            return seats.size() == 2 ? seats[1].price : std::min(seats[1].price, seats[2].price);
+        }
+
+        // Dinic max flow whose threshold arcs only exist while their travel
+        // time is within the probe's threshold. Flow found at one threshold
+        // stays valid at any higher one, which is what lets the bottleneck
+        // search resume from the last infeasible probe.
+        class ThresholdFlowNetwork
+        {
+        public:
+            explicit ThresholdFlowNetwork(int node_count) : adjacency_(node_count) {}
+
+            int add_edge(int from, int to, int capacity, double threshold = -std::numeric_limits<double>::infinity())
+            {
+                const int id = static_cast<int>(to_.size());
+                adjacency_[from].push_back(id);
+                to_.push_back(to);
+                residual_.push_back(capacity);
+                threshold_.push_back(threshold);
+                adjacency_[to].push_back(id + 1);
+                to_.push_back(from);
+                residual_.push_back(0);
+                threshold_.push_back(-std::numeric_limits<double>::infinity());
+                return id;
+            }
+
+            void set_capacity(int edge, int capacity)
+            {
+                residual_[edge] = capacity - residual_[edge ^ 1];
+            }
+
+            int flow(int edge) const { return residual_[edge ^ 1]; }
 
-                const auto dist_it = centre_distances.find(centre.centre_id);
-                if (dist_it == centre_distances.end())
+            std::vector<int> save() const { return residual_; }
+            void restore(const std::vector<int> &saved) { residual_ = saved; }
+
+            long long augment(int source, int sink, double threshold)
+            {
+                long long total = 0;
+                while (build_levels(source, sink, threshold))
                 {
-                    continue;
+                    next_edge_.assign(adjacency_.size(), 0);
+                    while (const int pushed = push(source, sink, std::numeric_limits<int>::max(), threshold))
+                    {
+                        total += pushed;
+                    }
                 }
+                return total;
+            }
+
+        private:
+            bool open(int edge, double threshold) const
+            {
+                return residual_[edge] > 0 && threshold_[edge] <= threshold;
+            }
 
-                const double distance = dist_it->second;
-                if (distance == std::numeric_limits<double>::max())
+            bool build_levels(int source, int sink, double threshold)
+            {
+                level_.assign(adjacency_.size(), -1);
+                std::vector<int> frontier{source};
+                level_[source] = 0;
+                for (size_t i = 0; i < frontier.size(); i++)
                 {
-                    continue;
+                    const int v = frontier[i];
+                    for (const int e : adjacency_[v])
+                    {
+                        if (open(e, threshold) && level_[to_[e]] < 0)
+                        {
+                            level_[to_[e]] = level_[v] + 1;
+                            frontier.push_back(to_[e]);
+                        }
+                    }
                 }
+                return level_[sink] >= 0;
+            }
 
-                queue.push({distance, student.student_id, centre.centre_id});
+            int push(int v, int sink, int limit, double threshold)
+            {
+                if (v == sink)
+                {
+                    return limit;
+                }
+                for (size_t &i = next_edge_[v]; i < adjacency_[v].size(); i++)
+                {
+                    const int e = adjacency_[v][i];
+                    const int w = to_[e];
+                    if (!open(e, threshold) || level_[w] != level_[v] + 1)
+                    {
+                        continue;
+                    }
+                    if (const int pushed = push(w, sink, std::min(limit, residual_[e]), threshold))
+                    {
+                        residual_[e] -= pushed;
+                        residual_[e ^ 1] += pushed;
+                        return pushed;
+                    }
+                }
+                return 0;
             }
-        }
 
-    } // namespace
+            std::vector<std::vector<int>> adjacency_;
+            std::vector<int> to_;
+            std::vector<int> residual_;
+            std::vector<double> threshold_;
+            std::vector<int> level_;
+            std::vector<size_t> next_edge_;
+        };
 
-    bool is_valid_assignment(const Student &, const Centre &)
-    {
-        // All centres accept all students in the current data model.
-        return true;
-    }
+        // Per-student figures of allotment_quality that depend only on where
+        // the student is and where it is seated: O(C) for one student.
+        void fill_quality_row(const GraphSnapshot &snapshot, int s)
+        {
+            AllotmentQuality &quality = allotment_quality;
+            const Student &student = students[s];
+            const int node = snapshot.dense_graph.index(student.snapped_node_id);
+            const int centre_count = std::min(static_cast<int>(centres.size()), snapshot.distance_table.centre_count);
+            const auto time_to = [&](int c)
+            {
+                return node < 0 || c < 0 || c >= centre_count ? std::numeric_limits<double>::max()
+                                                               : snapshot.distance_table.at(c, node);
+            };
 
-    void run_batch_greedy_allotment()
-    {
-        std::cout << "Running tiered distance-first allotment..." << std::endl;
+            double best = std::numeric_limits<double>::max();
+            double second = std::numeric_limits<double>::max();
+            int reachable = 0;
+            for (int c = 0; c < centre_count; c++)
+            {
+                const double time = time_to(c);
+                if (time < std::numeric_limits<double>::max())
+                {
+                    reachable++;
+                    if (time < best)
+                    {
+                        second = best;
+                        best = time;
+                    }
+                    else if (time < second)
+                    {
+                        second = time;
+                    }
+                }
+            }
+            quality.best_time[s] = best;
+            quality.second_best_time[s] = second;
+            quality.reachable_count[s] = reachable;
 
-        auto start_time = std::chrono::high_resolution_clock::now();
+            const auto node_it = snapshot.nodes.find(student.snapped_node_id);
+            quality.snap_distance[s] = node_it == snapshot.nodes.end()
+                                           ? -1.0
+                                           : haversine(student.lat, student.lon, node_it->second.lat, node_it->second.lon);
 
-        std::set<std::string> assigned_students;
-        std::unordered_map<std::string, int> centre_loads;
-        for (auto &centre : centres)
+            const int centre = s < static_cast<int>(student_assignment.size()) ? student_assignment[s] : -1;
+            if (centre < 0)
+            {
+                quality.travel_time[s] = -1.0;
+                quality.first_choice[s] = 0;
+                return;
+            }
+            double travel = time_to(centre);
+            if (travel == std::numeric_limits<double>::max())
+            {
+                travel = 0.0;
+            }
+            quality.travel_time[s] = travel;
+            // Tolerance for floating point, as the old diagnostics scan had.
+            quality.first_choice[s] = travel <= best + 0.1;
+        }
+
+        // Adds (sign = 1) or retracts (sign = -1) student s's row from the totals.
+        void count_quality_row(int s, int sign)
         {
-            centre_loads[centre.centre_id] = 0;
-            centre.current_load = 0;
+            AllotmentQuality &quality = allotment_quality;
+            CategoryQuality &category = quality.by_category[students[s].category];
+            category.total += sign;
+            if (quality.snap_distance[s] >= 0.0)
+            {
+                quality.snapped += sign;
+                quality.snap_distance_sum += sign * quality.snap_distance[s];
+                if (quality.snap_distance[s] > 100.0)
+                {
+                    quality.large_snaps += sign;
+                }
+            }
+
+            const double travel = quality.travel_time[s];
+            if (travel >= 0.0)
+            {
+                quality.assigned += sign;
+                quality.first_choice_count += sign * quality.first_choice[s];
+                quality.travel_sum += sign * travel;
+                category.assigned += sign;
+                category.travel_sum += sign * travel;
+                if (sign > 0)
+                {
+                    quality.max_travel = std::max(quality.max_travel, travel);
+                }
+                else if (travel >= quality.max_travel)
+                {
+                    quality.max_stale = true;
+                }
+            }
+            if (category.total == 0)
+            {
+                quality.by_category.erase(students[s].category);
+            }
         }
 
-        final_assignments.clear();
+        void resize_quality_rows(size_t count)
+        {
+            AllotmentQuality &quality = allotment_quality;
+            quality.best_time.resize(count, std::numeric_limits<double>::max());
+            quality.second_best_time.resize(count, std::numeric_limits<double>::max());
+            quality.reachable_count.resize(count, 0);
+            quality.snap_distance.resize(count, -1.0);
+            quality.travel_time.resize(count, -1.0);
+            quality.first_choice.resize(count, 0);
+        }
 
-        std::vector<Student> female_students;
-        std::vector<Student> pwd_students;
-        std::vector<Student> male_students;
+        void move_quality_row(int from, int to)
+        {
+            AllotmentQuality &quality = allotment_quality;
+            quality.best_time[to] = quality.best_time[from];
+            quality.second_best_time[to] = quality.second_best_time[from];
+            quality.reachable_count[to] = quality.reachable_count[from];
+            quality.snap_distance[to] = quality.snap_distance[from];
+            quality.travel_time[to] = quality.travel_time[from];
+            quality.first_choice[to] = quality.first_choice[from];
+        }
 
-        for (const auto &student : students)
+        void settle_quality_max()
         {
-            if (student.category == "female")
+            AllotmentQuality &quality = allotment_quality;
+            if (!quality.max_stale)
             {
-                female_students.push_back(student);
+                return;
             }
-            else if (student.category == "pwd")
+            quality.max_travel = 0.0;
+            for (const double travel : quality.travel_time)
             {
-                pwd_students.push_back(student);
+                quality.max_travel = std::max(quality.max_travel, travel);
             }
-            else
+            quality.max_stale = false;
+        }
+
+        // A student waits on at most this many centres faster than its seat
+        // (the closest ones), so the roster stays O(S) rather than O(S * C).
+        constexpr size_t kPreferredCentresPerStudent = 8;
+
+        // Appends student s's current seat to allotment_roster: O(C) for one
+        // student. `node` is its dense graph node, -1 when it has none;
+        // `faster` is scratch space.
+        void enrol_roster_student(const GraphSnapshot &snapshot, const CentreEligibility &eligibility, int s, int node,
+                                  std::vector<std::pair<double, int>> &faster)
+        {
+            AllotmentRoster &roster = allotment_roster;
+            const int centre = student_assignment[s];
+            roster.appended++;
+            if (centre < 0)
+            {
+                roster.unassigned.push_back(s);
+                return;
+            }
+            roster.occupants[centre].push_back(s);
+            if (node < 0)
+            {
+                return;
+            }
+            const double current = snapshot.distance_table.at(centre, node);
+            const std::uint8_t tier = tier_of_category(students[s].category);
+            faster.clear();
+            for (int c = 0; c < static_cast<int>(roster.preferred_by.size()); c++)
+            {
+                const double time = snapshot.distance_table.at(c, node);
+                if (c != centre && time < current && eligibility.allows(tier, c))
+                {
+                    faster.push_back({time, c});
+                }
+            }
+            if (faster.size() > kPreferredCentresPerStudent)
+            {
+                std::nth_element(faster.begin(), faster.begin() + kPreferredCentresPerStudent, faster.end());
+                faster.resize(kPreferredCentresPerStudent);
+            }
+            for (const auto &entry : faster)
             {
-                male_students.push_back(student);
+                roster.preferred_by[entry.second].push_back(s);
+                roster.appended++;
             }
         }
 
-        std::cout << "Student distribution (male=" << male_students.size()
-                  << ", pwd=" << pwd_students.size()
-                  << ", female=" << female_students.size() << ")." << std::endl;
-
-        // Log centre capacities
-        int total_capacity = 0;
-        for (const auto &centre : centres)
+        // Built on the first delta after a full run, which never needs it.
+        void rebuild_allotment_roster(const GraphSnapshot &snapshot)
         {
-            std::cout << "Centre " << centre.centre_id << " capacity: " << centre.max_capacity << std::endl;
-            total_capacity += centre.max_capacity;
+            AllotmentRoster &roster = allotment_roster;
+            roster = AllotmentRoster();
+            roster.occupants.resize(centres.size());
+            roster.preferred_by.resize(centres.size());
+            const CentreEligibility eligibility = build_centre_eligibility(centres, eligibility_rules);
+            std::vector<std::pair<double, int>> faster;
+            for (int s = 0; s < static_cast<int>(students.size()); s++)
+            {
+                enrol_roster_student(snapshot, eligibility, s, snapshot.dense_graph.index(students[s].snapped_node_id), faster);
+            }
+            roster.appended = 0;
+            roster.valid = true;
         }
-        std::cout << "Total capacity across all centres: " << total_capacity << std::endl;
 
-        AssignmentQueue queue_male;
-        for (const auto &student : male_students)
+    } // namespace
+
+    std::uint8_t tier_of_category(const std::string &category)
+    {
+        if (category == "female")
+        {
+            return kTierFemale;
+        }
+        if (category == "pwd")
         {
-            enqueue_student_options(student, queue_male);
+            return kTierPwd;
         }
-        process_priority_queue(queue_male, assigned_students, centre_loads);
-        std::cout << "Assigned " << assigned_students.size() << " male students." << std::endl;
+        return kTierMale;
+    }
 
-        AssignmentQueue queue_pwd;
-        const size_t male_count = assigned_students.size();
-        for (const auto &student : pwd_students)
+    bool centre_accepts_tier(const Centre &centre, std::uint8_t tier, const EligibilityRules &rules)
+    {
+        if (rules.female_only_centres && centre.is_female_only && tier != kTierFemale)
+        {
+            return false;
+        }
+        if (rules.pwd_requires_wheelchair_access && tier == kTierPwd && !centre.has_wheelchair_access)
         {
-            enqueue_student_options(student, queue_pwd);
+            return false;
         }
-        process_priority_queue(queue_pwd, assigned_students, centre_loads);
-        std::cout << "Assigned " << assigned_students.size() - male_count << " PwD students." << std::endl;
+        return true;
+    }
+
+    bool is_valid_assignment(const Student &student, const Centre &centre, const EligibilityRules &rules)
+    {
+        return centre_accepts_tier(centre, tier_of_category(student.category), rules);
+    }
 
-        AssignmentQueue queue_female;
-        const size_t male_pwd_count = assigned_students.size();
-        for (const auto &student : female_students)
+    // Evaluates the rules once per (tier, centre) instead of per student.
+    CentreEligibility build_centre_eligibility(const std::vector<Centre> &centre_list, const EligibilityRules &rules)
+    {
+        CentreEligibility eligibility;
+        const size_t word_count = (centre_list.size() + 63) / 64;
+        for (std::uint8_t tier = 0; tier < kTierCount; tier++)
         {
-            enqueue_student_options(student, queue_female);
+            eligibility.words[tier].assign(word_count, 0);
+            bool all = true;
+            for (size_t c = 0; c < centre_list.size(); c++)
+            {
+                if (centre_accepts_tier(centre_list[c], tier, rules))
+                {
+                    eligibility.words[tier][c >> 6] |= std::uint64_t{1} << (c & 63);
+                }
+                else
+                {
+                    all = false;
+                }
+            }
+            eligibility.unrestricted[tier] = all;
         }
-        process_priority_queue(queue_female, assigned_students, centre_loads);
-        std::cout << "Assigned " << assigned_students.size() - male_pwd_count << " female students." << std::endl;
+        return eligibility;
+    }
 
-        auto end_time = std::chrono::high_resolution_clock::now();
-        const auto total_ms = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time).count();
+    // Translates the string-keyed global state into dense indices once per run.
+    AllotmentProblem build_allotment_problem(const GraphSnapshot &snapshot, const EligibilityRules &rules)
+    {
+        const DenseGraph &dense_graph = snapshot.dense_graph;
+        const DistanceTable &distance_table = snapshot.distance_table;
+        const VoronoiPartition &voronoi = snapshot.voronoi;
 
-        std::cout << "Allotment complete: " << assigned_students.size() << " of "
-                  << students.size() << " students assigned in "
-                  << total_ms << " ms." << std::endl;
-        std::cout << "Unassigned students: " << (students.size() - assigned_students.size()) << std::endl;
+        AllotmentProblem problem;
+        problem.centre_count = static_cast<int>(centres.size());
+        problem.eligibility = build_centre_eligibility(centres, rules);
+        problem.student_tier.reserve(students.size());
+        problem.student_row.assign(students.size(), -1);
+        problem.capacity.reserve(centres.size());
 
-        // Log final centre loads
         for (const auto &centre : centres)
         {
-            std::cout << "Centre " << centre.centre_id << " final load: "
-                      << centre.current_load << "/" << centre.max_capacity << std::endl;
+            problem.capacity.push_back(centre.max_capacity);
+        }
+
+        const bool has_voronoi = voronoi.nearest.size() == static_cast<size_t>(dense_graph.size()) &&
+                                 distance_table.centre_count == problem.centre_count;
+        std::vector<double> rows;
+        std::unordered_map<int, int> row_of_node;
+        for (size_t s = 0; s < students.size(); s++)
+        {
+            const Student &student = students[s];
+            problem.student_tier.push_back(tier_of_category(student.category));
+
+            const int node_index = dense_graph.index(student.snapped_node_id);
+            if (node_index < 0 || distance_table.centre_count != problem.centre_count)
+            {
+                continue;
+            }
+
+            const auto inserted = row_of_node.emplace(node_index, static_cast<int>(row_of_node.size()));
+            if (inserted.second)
+            {
+                for (int c = 0; c < problem.centre_count; c++)
+                {
+                    rows.push_back(distance_table.at(c, node_index));
+                }
+                if (has_voronoi)
+                {
+                    problem.row_nearest.push_back(voronoi.nearest[node_index]);
+                }
+            }
+            problem.student_row[s] = inserted.first->second;
+        }
+        problem.distance_rows = std::make_shared<std::vector<double>>(std::move(rows));
+
+        return problem;
+    }
+
+    AllotmentResult solve_greedy_allotment(const AllotmentProblem &problem, const AllotmentOptions &options)
+    {
+        AllotmentResult result;
+        result.centre_of_student.assign(problem.student_count(), -1);
+        result.centre_load.assign(problem.centre_count, 0);
+
+        std::vector<bool> assigned(problem.student_count(), false);
+        CandidateStreams streams(problem);
+        size_t peak_heap_entries = 0;
+
+        // A Voronoi cell that fits its centre is seated outright: each of
+        // those students gets their nearest centre whatever the tier order,
+        // and only the overflow goes through the priority queues.
+        if (options.voronoi_prepass && !problem.row_nearest.empty())
+        {
+            const auto cell_of = [&](int s)
+            {
+                const int r = problem.student_row[s];
+                const int nearest = r < 0 ? -1 : problem.row_nearest[r];
+                return nearest >= 0 && problem.eligible(s, nearest) ? nearest : -1;
+            };
+            std::vector<int> cell_size(problem.centre_count, 0);
+            for (int s = 0; s < problem.student_count(); s++)
+            {
+                const int cell = cell_of(s);
+                if (cell >= 0)
+                {
+                    cell_size[cell]++;
+                }
+            }
+            for (int s = 0; s < problem.student_count(); s++)
+            {
+                const int cell = cell_of(s);
+                if (cell >= 0 && cell_size[cell] <= problem.capacity[cell])
+                {
+                    result.centre_of_student[s] = cell;
+                    result.centre_load[cell]++;
+                    result.assigned_count++;
+                    assigned[s] = true;
+                }
+            }
+            result.prepass_assigned = result.assigned_count;
+            std::cout << "Voronoi pre-pass seated " << result.prepass_assigned << " of "
+                      << problem.student_count() << " students." << std::endl;
         }
+
+        for (std::uint8_t tier = 0; tier < kTierCount; tier++)
+        {
+            std::vector<AssignmentPair> pairs;
+            for (int s = 0; s < problem.student_count(); s++)
+            {
+                if (problem.student_tier[s] != tier || assigned[s])
+                {
+                    continue;
+                }
+
+                if (options.lazy_candidates)
+                {
+                    AssignmentPair first;
+                    if (streams.next(s, result.centre_load, first))
+                    {
+                        pairs.push_back(first);
+                    }
+                }
+                else
+                {
+                    enqueue_student_options(problem, s, pairs);
+                }
+            }
+
+            const int assigned_before = result.assigned_count;
+            peak_heap_entries = std::max(peak_heap_entries, pairs.size());
+            AssignmentQueue queue(std::greater<AssignmentPair>(), std::move(pairs));
+            if (options.lazy_candidates)
+            {
+                process_candidate_streams(queue, streams, result, problem, peak_heap_entries);
+            }
+            else
+            {
+                process_priority_queue(queue, assigned, result, problem);
+            }
+
+            static const char *kTierNames[] = {"male", "PwD", "female"};
+            std::cout << "Assigned " << result.assigned_count - assigned_before << " "
+                      << kTierNames[tier] << " students." << std::endl;
+        }
+
+        result.peak_candidate_bytes = peak_heap_entries * sizeof(AssignmentPair);
+        if (options.lazy_candidates)
+        {
+            result.peak_candidate_bytes += streams.memory_bytes();
+        }
+        else
+        {
+            result.peak_candidate_bytes += assigned.capacity() / 8;
+        }
+
+        return result;
+    }
+
+    // Successive shortest paths with potentials. Students on the same snapped
+    // node and tier are one supply group. Groups are never Dijkstra nodes:
+    // the residual graph is collapsed onto centres, where an arc a -> b is
+    // the cheapest group to move from a to b (kept in a lazy heap per pair)
+    // and source -> b is the cheapest unplaced group for b. Each round is a
+    // dense O(C^2) Dijkstra plus heap updates for the groups on the path.
+    AllotmentResult solve_min_cost_flow_allotment(const AllotmentProblem &problem)
+    {
+        const int centre_count = problem.centre_count;
+
+        std::unordered_map<long long, int> group_of_key;
+        std::vector<std::vector<int>> group_students;
+        for (int s = 0; s < problem.student_count(); s++)
+        {
+            if (problem.student_row[s] < 0)
+            {
+                continue;
+            }
+            const long long key = static_cast<long long>(problem.student_row[s]) * kTierCount + problem.student_tier[s];
+            const auto inserted = group_of_key.emplace(key, static_cast<int>(group_students.size()));
+            if (inserted.second)
+            {
+                group_students.emplace_back();
+            }
+            group_students[inserted.first->second].push_back(s);
+        }
+        const int group_count = static_cast<int>(group_students.size());
+
+        std::vector<const double *> group_row(group_count);
+        std::vector<int> unplaced(group_count);
+        std::vector<int> group_flow(static_cast<size_t>(group_count) * centre_count, 0);
+        for (int g = 0; g < group_count; g++)
+        {
+            group_row[g] = problem.row(group_students[g].front());
+            unplaced[g] = static_cast<int>(group_students[g].size());
+        }
+        const auto flow_at = [&](int g, int c) -> int &
+        { return group_flow[static_cast<size_t>(g) * centre_count + c]; };
+        const auto reachable = [&](int g, int c)
+        { return group_row[g][c] != std::numeric_limits<double>::max() && problem.eligible(group_students[g].front(), c); };
+
+        using HeapEntry = std::pair<FlowCost, int>;
+        const auto later = [](const HeapEntry &x, const HeapEntry &y)
+        { return x.first > y.first; };
+        using GroupHeap = std::priority_queue<HeapEntry, std::vector<HeapEntry>, decltype(later)>;
+
+        std::vector<GroupHeap> place_heap(centre_count, GroupHeap(later));
+        std::vector<GroupHeap> move_heap(static_cast<size_t>(centre_count) * centre_count, GroupHeap(later));
+        for (int g = 0; g < group_count; g++)
+        {
+            FlowCost key;
+            key.tier[problem.student_tier[group_students[g].front()]] = -1;
+            for (int c = 0; c < centre_count; c++)
+            {
+                if (reachable(g, c))
+                {
+                    key.time = group_row[g][c];
+                    place_heap[c].push({key, g});
+                }
+            }
+        }
+
+        // Called when group g gains its first student at centre a.
+        const auto offer_moves = [&](int g, int a)
+        {
+            for (int b = 0; b < centre_count; b++)
+            {
+                if (b != a && reachable(g, b))
+                {
+                    FlowCost key;
+                    key.time = group_row[g][b] - group_row[g][a];
+                    move_heap[static_cast<size_t>(a) * centre_count + b].push({key, g});
+                }
+            }
+        };
+        const auto place_top = [&](int c) -> const HeapEntry *
+        {
+            GroupHeap &heap = place_heap[c];
+            while (!heap.empty() && unplaced[heap.top().second] == 0)
+            {
+                heap.pop();
+            }
+            return heap.empty() ? nullptr : &heap.top();
+        };
+        const auto move_top = [&](int a, int b) -> const HeapEntry *
+        {
+            GroupHeap &heap = move_heap[static_cast<size_t>(a) * centre_count + b];
+            while (!heap.empty() && flow_at(heap.top().second, a) == 0)
+            {
+                heap.pop();
+            }
+            return heap.empty() ? nullptr : &heap.top();
+        };
+
+        AllotmentResult result;
+        result.centre_of_student.assign(problem.student_count(), -1);
+        result.centre_load.assign(centre_count, 0);
+
+        // Node layout for the collapsed graph: centres, then source, then sink.
+        const int source = centre_count;
+        const int sink = centre_count + 1;
+        const int node_count = centre_count + 2;
+        std::vector<FlowCost> potential(node_count);
+        for (int c = 0; c < centre_count; c++)
+        {
+            const HeapEntry *top = place_top(c);
+            potential[c] = top ? top->first : FlowCost{};
+            if (c == 0 || potential[c] < potential[sink])
+            {
+                potential[sink] = potential[c];
+            }
+        }
+
+        std::vector<FlowCost> distance(node_count);
+        std::vector<bool> reached(node_count), settled(node_count);
+        std::vector<int> parent(node_count), parent_group(node_count);
+
+        while (true)
+        {
+            std::fill(reached.begin(), reached.end(), false);
+            std::fill(settled.begin(), settled.end(), false);
+            distance[source] = FlowCost{};
+            reached[source] = true;
+
+            while (true)
+            {
+                int v = -1;
+                for (int u = 0; u < node_count; u++)
+                {
+                    if (reached[u] && !settled[u] && (v < 0 || distance[u] < distance[v]))
+                    {
+                        v = u;
+                    }
+                }
+                if (v < 0 || v == sink)
+                {
+                    break;
+                }
+                settled[v] = true;
+
+                const auto relax = [&](int w, const FlowCost &cost, int group)
+                {
+                    const FlowCost candidate = distance[v] + cost + potential[v] - potential[w];
+                    if (!settled[w] && (!reached[w] || candidate < distance[w]))
+                    {
+                        distance[w] = candidate;
+                        reached[w] = true;
+                        parent[w] = v;
+                        parent_group[w] = group;
+                    }
+                };
+
+                if (v == source)
+                {
+                    for (int c = 0; c < centre_count; c++)
+                    {
+                        if (const HeapEntry *top = place_top(c))
+                        {
+                            relax(c, top->first, top->second);
+                        }
+                    }
+                    continue;
+                }
+
+                for (int b = 0; b < centre_count; b++)
+                {
+                    if (b == v)
+                    {
+                        continue;
+                    }
+                    if (const HeapEntry *top = move_top(v, b))
+                    {
+                        relax(b, top->first, top->second);
+                    }
+                }
+                if (result.centre_load[v] < problem.capacity[v])
+                {
+                    relax(sink, FlowCost{}, -1);
+                }
+            }
+
+            if (!reached[sink])
+            {
+                break;
+            }
+            settled[sink] = true;
+
+            for (int v = 0; v < node_count; v++)
+            {
+                if (reached[v])
+                {
+                    potential[v] = potential[v] + (settled[v] ? distance[v] : distance[sink]);
+                }
+                else
+                {
+                    potential[v] = potential[v] + distance[sink];
+                }
+            }
+
+            // Bottleneck along sink <- centre ... <- source.
+            const int last_centre = parent[sink];
+            int push = problem.capacity[last_centre] - result.centre_load[last_centre];
+            for (int c = last_centre; c != source; c = parent[c])
+            {
+                const int g = parent_group[c];
+                push = std::min(push, parent[c] == source ? unplaced[g] : flow_at(g, parent[c]));
+            }
+
+            for (int c = last_centre; c != source; c = parent[c])
+            {
+                const int g = parent_group[c];
+                if (parent[c] == source)
+                {
+                    unplaced[g] -= push;
+                }
+                else
+                {
+                    flow_at(g, parent[c]) -= push;
+                }
+                if (flow_at(g, c) == 0)
+                {
+                    offer_moves(g, c);
+                }
+                flow_at(g, c) += push;
+            }
+            result.centre_load[last_centre] += push;
+            result.assigned_count += push;
+        }
+
+        for (int g = 0; g < group_count; g++)
+        {
+            size_t next_student = 0;
+            for (int c = 0; c < centre_count; c++)
+            {
+                for (int f = flow_at(g, c); f > 0; f--)
+                {
+                    result.centre_of_student[group_students[g][next_student++]] = c;
+                }
+            }
+        }
+        return result;
+    }
+
+    // Forward auction with epsilon-scaling over every student at once. The
+    // problem is made symmetric so seat prices stay valid across epsilon
+    // phases: surplus seats get zero-cost dummy bidders, and a shortfall of
+    // seats gets a virtual "unassigned" centre. Leaving a student unseated
+    // costs a per-tier reserve, each tier's reserve far above the next one's,
+    // so the tier priority of the greedy pass is kept. Rounds are Jacobi
+    // style: every unassigned bidder bids in parallel on the previous round's
+    // prices, then centres resolve their bids in parallel, keeping the
+    // highest and evicting their cheapest holders.
+    AllotmentResult solve_auction_allotment(const AllotmentProblem &problem, const AllotmentOptions &options, AuctionStats &stats)
+    {
+        const int centre_count = problem.centre_count;
+        const int virtual_centre = centre_count;
+        AllotmentResult result;
+        result.centre_of_student.assign(problem.student_count(), -1);
+        result.centre_load.assign(centre_count, 0);
+        stats = AuctionStats{};
+
+        std::vector<int> bidder_students;
+        for (int s = 0; s < problem.student_count(); s++)
+        {
+            if (problem.row(s))
+            {
+                bidder_students.push_back(s);
+            }
+        }
+        const int student_count = static_cast<int>(bidder_students.size());
+        if (student_count == 0)
+        {
+            return result;
+        }
+
+        double max_distance = 0.0;
+        for (const double distance : *problem.distance_rows)
+        {
+            if (distance != std::numeric_limits<double>::max())
+            {
+                max_distance = std::max(max_distance, distance);
+            }
+        }
+        // An augmenting chain moves at most one student per centre, so tier
+        // reserves this far apart cannot be traded for travel time.
+        const double tier_factor = std::max(1000.0, 4.0 * (centre_count + 1));
+        double reserve[kTierCount];
+        reserve[kTierCount - 1] = 2.0 * max_distance + 1.0;
+        for (int t = kTierCount - 2; t >= 0; t--)
+        {
+            reserve[t] = reserve[t + 1] * tier_factor;
+        }
+
+        int seat_count = 0;
+        std::vector<std::vector<AuctionSeat>> seats(centre_count + 1);
+        for (int c = 0; c < centre_count; c++)
+        {
+            seats[c].assign(std::max(problem.capacity[c], 0), AuctionSeat{});
+            seat_count += static_cast<int>(seats[c].size());
+        }
+        seats[virtual_centre].assign(std::max(student_count - seat_count, 0), AuctionSeat{});
+        const int person_count = student_count + std::max(seat_count - student_count, 0);
+
+        const double max_cost = seats[virtual_centre].empty() ? max_distance : reserve[0];
+        const double bid_floor = -4.0 * reserve[0];
+        const double final_epsilon = std::max(options.auction_epsilon, 1e-9);
+        const double scaling_factor = 4.0;
+
+        WorkerPool pool(options.threads > 0 ? options.threads : worker_count(person_count, 4096));
+        stats.threads = pool.size();
+        stats.final_epsilon = final_epsilon;
+
+        std::vector<double> cheapest(centre_count + 1), second(centre_count + 1);
+        std::vector<std::vector<AuctionBid>> worker_bids(pool.size());
+        std::vector<AuctionBid> bids_by_centre;
+        std::vector<size_t> bid_offsets(centre_count + 2);
+        std::vector<std::vector<int>> rebidders(centre_count + 1);
+        std::vector<int> bidders;
+        std::vector<int> seat_of_person;
+
+        const auto refresh_prices = [&](int c)
+        {
+            cheapest[c] = seats[c].empty() ? std::numeric_limits<double>::infinity() : seats[c][0].price;
+            second[c] = second_cheapest_seat(seats[c]);
+        };
+        for (int c = 0; c <= centre_count; c++)
+        {
+            refresh_prices(c);
+        }
+
+        // Persons below student_count are students; the rest are dummies.
+        const auto cost = [&](int person, int c)
+        {
+            if (person >= student_count)
+            {
+                return c == virtual_centre ? std::numeric_limits<double>::max() : 0.0;
+            }
+            const int student = bidder_students[person];
+            if (c == virtual_centre)
+            {
+                return reserve[problem.student_tier[student]];
+            }
+            return problem.eligible(student, c) ? problem.row(student)[c] : std::numeric_limits<double>::max();
+        };
+
+        double epsilon = std::max(final_epsilon, max_cost / scaling_factor);
+        while (true)
+        {
+            stats.phases++;
+            for (auto &centre_seats : seats)
+            {
+                for (auto &seat : centre_seats)
+                {
+                    seat.holder = -1;
+                }
+            }
+            seat_of_person.assign(person_count, -1);
+            bidders.resize(person_count);
+            for (int p = 0; p < person_count; p++)
+            {
+                bidders[p] = p;
+            }
+
+            while (!bidders.empty())
+            {
+                stats.rounds++;
+                stats.bids += static_cast<long long>(bidders.size());
+
+                pool.for_ranges(bidders.size(), [&](unsigned worker, size_t begin, size_t end)
+                                {
+                    std::vector<AuctionBid> &out = worker_bids[worker];
+                    out.clear();
+                    for (size_t i = begin; i < end; i++)
+                    {
+                        const int person = bidders[i];
+                        int best = -1;
+                        double best_value = bid_floor;
+                        double second_value = bid_floor;
+                        for (int c = 0; c <= centre_count; c++)
+                        {
+                            const double distance = cost(person, c);
+                            if (distance == std::numeric_limits<double>::max() || seats[c].empty())
+                            {
+                                continue;
+                            }
+                            const double value = -distance - cheapest[c];
+                            if (best < 0 || value > best_value)
+                            {
+                                if (best >= 0)
+                                {
+                                    second_value = std::max(second_value, best_value);
+                                }
+                                best = c;
+                                best_value = value;
+                            }
+                            else
+                            {
+                                second_value = std::max(second_value, value);
+                            }
+                        }
+                        // Unreachable or priced out entirely: the person drops.
+                        if (best < 0 || best_value < bid_floor)
+                        {
+                            continue;
+                        }
+                        second_value = std::max(second_value, -cost(person, best) - second[best]);
+                        out.push_back({cheapest[best] + best_value - second_value + epsilon, person, best});
+                    } });
+
+                // Counting sort of this round's bids by centre.
+                std::fill(bid_offsets.begin(), bid_offsets.end(), 0);
+                for (const auto &out : worker_bids)
+                {
+                    for (const auto &bid : out)
+                    {
+                        bid_offsets[bid.centre + 1]++;
+                    }
+                }
+                for (int c = 0; c <= centre_count; c++)
+                {
+                    bid_offsets[c + 1] += bid_offsets[c];
+                }
+                bids_by_centre.resize(bid_offsets[centre_count + 1]);
+                {
+                    std::vector<size_t> cursor(bid_offsets.begin(), bid_offsets.end() - 1);
+                    for (const auto &out : worker_bids)
+                    {
+                        for (const auto &bid : out)
+                        {
+                            bids_by_centre[cursor[bid.centre]++] = bid;
+                        }
+                    }
+                }
+
+                pool.for_ranges(centre_count + 1, [&](unsigned, size_t begin, size_t end)
+                                {
+                    for (size_t c = begin; c < end; c++)
+                    {
+                        std::vector<int> &losers = rebidders[c];
+                        losers.clear();
+                        auto first = bids_by_centre.begin() + bid_offsets[c];
+                        auto last = bids_by_centre.begin() + bid_offsets[c + 1];
+                        std::sort(first, last, [](const AuctionBid &x, const AuctionBid &y)
+                                  { return x.amount > y.amount; });
+
+                        std::vector<AuctionSeat> &heap = seats[c];
+                        for (auto it = first; it != last; ++it)
+                        {
+                            if (it->amount <= heap[0].price)
+                            {
+                                losers.push_back(it->person);
+                                continue;
+                            }
+                            if (heap[0].holder >= 0)
+                            {
+                                losers.push_back(heap[0].holder);
+                                seat_of_person[heap[0].holder] = -1;
+                            }
+                            std::pop_heap(heap.begin(), heap.end(), std::greater<AuctionSeat>());
+                            heap.back() = {it->amount, it->person};
+                            std::push_heap(heap.begin(), heap.end(), std::greater<AuctionSeat>());
+                            seat_of_person[it->person] = static_cast<int>(c);
+                        }
+                        refresh_prices(static_cast<int>(c));
+                    } });
+
+                bidders.clear();
+                for (const auto &losers : rebidders)
+                {
+                    bidders.insert(bidders.end(), losers.begin(), losers.end());
+                }
+            }
+
+            if (epsilon <= final_epsilon)
+            {
+                break;
+            }
+            epsilon = std::max(final_epsilon, epsilon / scaling_factor);
+        }
+
+        for (int p = 0; p < student_count; p++)
+        {
+            const int centre = seat_of_person[p];
+            if (centre >= 0 && centre != virtual_centre)
+            {
+                result.centre_of_student[bidder_students[p]] = centre;
+                result.centre_load[centre]++;
+                result.assigned_count++;
+            }
+        }
+        stats.gap_bound_sec = final_epsilon * person_count;
+
+        return result;
+    }
+
+    // Minimises the longest assigned journey. Tier targets come first: a
+    // max flow opened one tier at a time gives the lexicographically largest
+    // per-tier counts. The threshold is then binary searched over the
+    // distinct travel times; each probe resumes from the flow of the highest
+    // infeasible probe so far instead of starting empty. Among assignments
+    // within the threshold, min-cost flow picks the least total time.
+    AllotmentResult solve_bottleneck_allotment(const AllotmentProblem &problem, BottleneckStats &stats)
+    {
+        stats = BottleneckStats{};
+        const int centre_count = problem.centre_count;
+
+        std::unordered_map<long long, int> group_of_key;
+        std::vector<int> group_size, group_tier, group_student;
+        for (int s = 0; s < problem.student_count(); s++)
+        {
+            if (problem.student_row[s] < 0)
+            {
+                continue;
+            }
+            const long long key = static_cast<long long>(problem.student_row[s]) * kTierCount + problem.student_tier[s];
+            const auto inserted = group_of_key.emplace(key, static_cast<int>(group_size.size()));
+            if (inserted.second)
+            {
+                group_size.push_back(0);
+                group_tier.push_back(problem.student_tier[s]);
+                group_student.push_back(s);
+            }
+            group_size[inserted.first->second]++;
+        }
+        const int group_count = static_cast<int>(group_size.size());
+
+        // Nodes: source, one per tier, groups, centres, sink.
+        const int source = 0;
+        const int first_tier = 1;
+        const int first_group = first_tier + kTierCount;
+        const int first_centre = first_group + group_count;
+        const int sink = first_centre + centre_count;
+        ThresholdFlowNetwork network(sink + 1);
+
+        int tier_edge[kTierCount];
+        for (int t = 0; t < kTierCount; t++)
+        {
+            tier_edge[t] = network.add_edge(source, first_tier + t, 0);
+        }
+        std::vector<double> thresholds;
+        for (int g = 0; g < group_count; g++)
+        {
+            network.add_edge(first_tier + group_tier[g], first_group + g, group_size[g]);
+            const double *row = problem.row(group_student[g]);
+            problem.eligibility.for_each(group_tier[g], centre_count, [&](int c)
+                                         {
+                if (row[c] != std::numeric_limits<double>::max())
+                {
+                    network.add_edge(first_group + g, first_centre + c, group_size[g], row[c]);
+                    thresholds.push_back(row[c]);
+                } });
+        }
+        for (int c = 0; c < centre_count; c++)
+        {
+            network.add_edge(first_centre + c, sink, std::max(problem.capacity[c], 0));
+        }
+
+        std::sort(thresholds.begin(), thresholds.end());
+        thresholds.erase(std::unique(thresholds.begin(), thresholds.end()), thresholds.end());
+        stats.distinct_thresholds = static_cast<int>(thresholds.size());
+        if (thresholds.empty())
+        {
+            AllotmentResult result;
+            result.centre_of_student.assign(problem.student_count(), -1);
+            result.centre_load.assign(centre_count, 0);
+            return result;
+        }
+
+        const std::vector<int> empty_flow = network.save();
+        const double unlimited = std::numeric_limits<double>::infinity();
+        long long target = 0;
+        for (int t = 0; t < kTierCount; t++)
+        {
+            network.set_capacity(tier_edge[t], std::numeric_limits<int>::max());
+            target += network.augment(source, sink, unlimited);
+            stats.tier_targets[t] = network.flow(tier_edge[t]);
+        }
+
+        // Probes start from an empty flow with each tier capped at its target.
+        network.restore(empty_flow);
+        for (int t = 0; t < kTierCount; t++)
+        {
+            network.set_capacity(tier_edge[t], stats.tier_targets[t]);
+        }
+
+        long long base_value = 0;
+        int low = -1;
+        int high = static_cast<int>(thresholds.size()) - 1;
+        while (high - low > 1)
+        {
+            const int mid = low + (high - low) / 2;
+            stats.probes++;
+            const std::vector<int> base_flow = network.save();
+            const long long value = base_value + network.augment(source, sink, thresholds[mid]);
+            if (value == target)
+            {
+                high = mid;
+                network.restore(base_flow);
+            }
+            else
+            {
+                low = mid;
+                base_value = value;
+            }
+        }
+        stats.threshold_sec = thresholds[high];
+
+        auto within = std::make_shared<std::vector<double>>(*problem.distance_rows);
+        for (double &distance : *within)
+        {
+            if (distance > stats.threshold_sec)
+            {
+                distance = std::numeric_limits<double>::max();
+            }
+        }
+        AllotmentProblem restricted = problem;
+        restricted.distance_rows = std::move(within);
+        return solve_min_cost_flow_allotment(restricted);
+    }
+
+    double total_travel_time(const AllotmentProblem &problem, const AllotmentResult &result)
+    {
+        double total = 0.0;
+        for (int s = 0; s < problem.student_count(); s++)
+        {
+            const int centre = result.centre_of_student[s];
+            if (centre >= 0)
+            {
+                total += problem.row(s)[centre];
+            }
+        }
+        return total;
+    }
+
+    double max_travel_time(const AllotmentProblem &problem, const AllotmentResult &result)
+    {
+        double worst = 0.0;
+        for (int s = 0; s < problem.student_count(); s++)
+        {
+            const int centre = result.centre_of_student[s];
+            if (centre >= 0)
+            {
+                worst = std::max(worst, problem.row(s)[centre]);
+            }
+        }
+        return worst;
+    }
+
+    // Runs the selected solver on an already built problem. Touches no
+    // global state, so scenario variants can call it concurrently.
+    AllotmentResult solve_allotment(const AllotmentProblem &problem, const AllotmentOptions &options, AllotmentSummary &summary)
+    {
+        summary.solver = kSolverNames[static_cast<int>(options.solver)];
+
+        int tier_counts[kTierCount] = {0, 0, 0};
+        for (const auto tier : problem.student_tier)
+        {
+            tier_counts[tier]++;
+        }
+        summary.ineligible_students = 0;
+        for (int tier = 0; tier < kTierCount; tier++)
+        {
+            summary.eligible_centres[tier] = problem.eligibility.count(tier, problem.centre_count);
+            if (summary.eligible_centres[tier] == 0)
+            {
+                summary.ineligible_students += tier_counts[tier];
+            }
+        }
+
+        const auto solver_start = std::chrono::high_resolution_clock::now();
+        AllotmentResult result;
+        switch (options.solver)
+        {
+        case AllotmentSolver::Greedy:
+            result = solve_greedy_allotment(problem, options);
+            break;
+        case AllotmentSolver::MinCostFlow:
+            result = solve_min_cost_flow_allotment(problem);
+            break;
+        case AllotmentSolver::Auction:
+            result = solve_auction_allotment(problem, options, summary.auction);
+            break;
+        case AllotmentSolver::Bottleneck:
+            result = solve_bottleneck_allotment(problem, summary.bottleneck);
+            break;
+        }
+        const auto solver_end = std::chrono::high_resolution_clock::now();
+
+        summary.solve_ms = std::chrono::duration_cast<std::chrono::microseconds>(solver_end - solver_start).count() / 1000.0;
+        summary.assigned = result.assigned_count;
+        summary.prepass_assigned = result.prepass_assigned;
+        summary.travel_time = total_travel_time(problem, result);
+        summary.max_travel_time = max_travel_time(problem, result);
+        return result;
+    }
+
+    AllotmentSummary run_allotment(const GraphSnapshot &snapshot, const AllotmentOptions &options)
+    {
+        std::cout << "Running " << kSolverNames[static_cast<int>(options.solver)] << " allotment ("
+                  << (options.lazy_candidates ? "lazy" : "eager") << " candidates)..." << std::endl;
+
+        auto start_time = std::chrono::high_resolution_clock::now();
+
+        const AllotmentProblem problem = build_allotment_problem(snapshot, options.rules);
+        eligibility_rules = options.rules;
+
+        int tier_counts[kTierCount] = {0, 0, 0};
+        for (const auto tier : problem.student_tier)
+        {
+            tier_counts[tier]++;
+        }
+        std::cout << "Student distribution (male=" << tier_counts[kTierMale]
+                  << ", pwd=" << tier_counts[kTierPwd]
+                  << ", female=" << tier_counts[kTierFemale] << ")." << std::endl;
+
+        // Log centre capacities
+        int total_capacity = 0;
+        for (const auto &centre : centres)
+        {
+            std::cout << "Centre " << centre.centre_id << " capacity: " << centre.max_capacity << std::endl;
+            total_capacity += centre.max_capacity;
+        }
+        std::cout << "Total capacity across all centres: " << total_capacity << std::endl;
+
+        // Greedy always runs: it is the answer in greedy mode and the baseline otherwise.
+        AllotmentOptions greedy_options = options;
+        greedy_options.solver = AllotmentSolver::Greedy;
+        AllotmentSummary summary;
+        AllotmentResult result = solve_allotment(problem, greedy_options, summary);
+        summary.greedy_ms = summary.solve_ms;
+        summary.greedy_assigned = summary.assigned;
+        summary.greedy_travel_time = summary.travel_time;
+        summary.greedy_max_travel_time = summary.max_travel_time;
+        std::cout << "Greedy solve: " << summary.greedy_ms
+                  << " ms, peak candidate memory: " << result.peak_candidate_bytes / 1024.0 << " KiB." << std::endl;
+
+        if (options.solver != AllotmentSolver::Greedy)
+        {
+            result = solve_allotment(problem, options, summary);
+        }
+
+        static const char *kTierNames[] = {"male", "pwd", "female"};
+        for (int tier = 0; tier < kTierCount; tier++)
+        {
+            if (summary.eligible_centres[tier] == 0 && tier_counts[tier] > 0)
+            {
+                std::cout << "Warning: no centre accepts " << kTierNames[tier] << " students under the current rules; "
+                          << tier_counts[tier] << " will stay unassigned." << std::endl;
+            }
+        }
+        std::cout << "Eligible centres (male=" << summary.eligible_centres[kTierMale]
+                  << ", pwd=" << summary.eligible_centres[kTierPwd]
+                  << ", female=" << summary.eligible_centres[kTierFemale] << ")." << std::endl;
+
+        if (options.solver != AllotmentSolver::Greedy)
+        {
+            const double saved = summary.greedy_travel_time - summary.travel_time;
+            std::cout << summary.solver << " solve: " << summary.solve_ms << " ms, total travel time "
+                      << summary.travel_time << " s vs greedy " << summary.greedy_travel_time << " s ("
+                      << (summary.greedy_travel_time > 0.0 ? 100.0 * saved / summary.greedy_travel_time : 0.0)
+                      << "% better)." << std::endl;
+        }
+        if (options.solver == AllotmentSolver::Bottleneck)
+        {
+            std::cout << "Bottleneck threshold " << summary.bottleneck.threshold_sec << " s after "
+                      << summary.bottleneck.probes << " probes over " << summary.bottleneck.distinct_thresholds
+                      << " distinct travel times (greedy worst case " << summary.greedy_max_travel_time << " s)." << std::endl;
+        }
+        if (options.solver == AllotmentSolver::Auction)
+        {
+            std::cout << "Auction converged in " << summary.auction.phases << " epsilon phases, "
+                      << summary.auction.rounds << " rounds, " << summary.auction.bids << " bids on "
+                      << summary.auction.threads << " threads (gap <= " << summary.auction.gap_bound_sec
+                      << " s)." << std::endl;
+        }
+
+        // Ids are only translated back to strings here, at the API boundary.
+        final_assignments.clear();
+        final_assignments.reserve(result.assigned_count);
+        student_assignment = result.centre_of_student;
+        student_index.clear();
+        student_index.reserve(students.size());
+        for (size_t s = 0; s < students.size(); s++)
+        {
+            student_index[students[s].student_id] = static_cast<int>(s);
+            const int centre = result.centre_of_student[s];
+            if (centre >= 0)
+            {
+                final_assignments[students[s].student_id] = centres[centre].centre_id;
+            }
+        }
+        for (size_t c = 0; c < centres.size(); c++)
+        {
+            centres[c].current_load = result.centre_load[c];
+        }
+        rebuild_allotment_quality(snapshot);
+        allotment_roster = AllotmentRoster();
+
+        auto end_time = std::chrono::high_resolution_clock::now();
+        const auto total_ms = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time).count();
+
+        std::cout << "Allotment complete: " << result.assigned_count << " of "
+                  << students.size() << " students assigned in "
+                  << total_ms << " ms." << std::endl;
+        std::cout << "Unassigned students: " << (students.size() - result.assigned_count) << std::endl;
+
+        // Log final centre loads
+        for (const auto &centre : centres)
+        {
+            std::cout << "Centre " << centre.centre_id << " final load: "
+                      << centre.current_load << "/" << centre.max_capacity << std::endl;
+        }
+
+        return summary;
+    }
+
+    void rebuild_allotment_quality(const GraphSnapshot &snapshot)
+    {
+        allotment_quality = AllotmentQuality();
+        resize_quality_rows(students.size());
+        for (int s = 0; s < static_cast<int>(students.size()); s++)
+        {
+            fill_quality_row(snapshot, s);
+            count_quality_row(s, 1);
+        }
+        allotment_quality.valid = true;
+    }
+
+    // Evaluates what-if variants side by side. The problem, with its distance
+    // rows, is built once from the current state and shared read-only; each
+    // scenario copies only the per-student and per-centre vectors it may
+    // change. Nothing global is written, so the live allotment is untouched.
+    std::vector<ScenarioOutcome> run_scenarios(const GraphSnapshot &snapshot, const std::vector<AllotmentScenario> &scenarios, unsigned threads)
+    {
+        const auto start_time = std::chrono::high_resolution_clock::now();
+        std::vector<ScenarioOutcome> outcomes(scenarios.size());
+        if (scenarios.empty())
+        {
+            return outcomes;
+        }
+
+        const AllotmentProblem base = build_allotment_problem(snapshot);
+        std::unordered_map<std::string, int> centre_index;
+        for (size_t c = 0; c < centres.size(); c++)
+        {
+            centre_index[centres[c].centre_id] = static_cast<int>(c);
+        }
+
+        // Scenarios differ a lot in cost, so workers pull the next one
+        // instead of taking fixed ranges.
+        const unsigned workers = threads > 0 ? static_cast<unsigned>(std::min<size_t>(threads, scenarios.size()))
+                                             : worker_count(scenarios.size());
+        std::atomic<size_t> next_scenario{0};
+        parallel_for_ranges(workers, workers, [&](unsigned, size_t, size_t)
+                            {
+            for (size_t i = next_scenario++; i < scenarios.size(); i = next_scenario++)
+            {
+                const AllotmentScenario &scenario = scenarios[i];
+                ScenarioOutcome &outcome = outcomes[i];
+                outcome.name = scenario.name;
+
+                AllotmentProblem problem = base;
+                problem.eligibility = build_centre_eligibility(centres, scenario.options.rules);
+                const auto find_centre = [&](const std::string &centre_id)
+                {
+                    const auto it = centre_index.find(centre_id);
+                    if (it == centre_index.end())
+                    {
+                        outcome.unknown_centres.push_back(centre_id);
+                        return -1;
+                    }
+                    return it->second;
+                };
+                for (const auto &change : scenario.capacity_changes)
+                {
+                    const int c = find_centre(change.first);
+                    if (c >= 0)
+                    {
+                        problem.capacity[c] = std::max(change.second, 0);
+                    }
+                }
+                for (const auto &centre_id : scenario.closed_centres)
+                {
+                    const int c = find_centre(centre_id);
+                    if (c >= 0)
+                    {
+                        problem.capacity[c] = 0;
+                    }
+                }
+
+                const AllotmentResult result = solve_allotment(problem, scenario.options, outcome.summary);
+                for (int c = 0; c < problem.centre_count; c++)
+                {
+                    if (problem.capacity[c] > 0)
+                    {
+                        outcome.open_centres++;
+                        outcome.seats += problem.capacity[c];
+                        if (result.centre_load[c] >= problem.capacity[c])
+                        {
+                            outcome.full_centres++;
+                        }
+                    }
+                }
+            } });
+
+        const auto end_time = std::chrono::high_resolution_clock::now();
+        std::cout << "Evaluated " << scenarios.size() << " scenarios on " << workers << " threads in "
+                  << std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time).count()
+                  << " ms." << std::endl;
+        return outcomes;
+    }
+
+    // Repairs the current allotment in place instead of re-running a solver.
+    // Only added, moved and evicted students are (re)placed, each taking its
+    // nearest centre with a free seat or displacing that centre's weakest
+    // occupant (lower tier priority, then longer trip). Seats freed by
+    // removals, moves and capacity increases are offered to students who
+    // would rather be there. Both kinds of knock-on effect stop after
+    // max_cascade steps, so a delta never touches more than a bounded chain.
+    AllotmentDeltaStats apply_allotment_delta(const GraphSnapshot &snapshot, const AllotmentDelta &delta)
+    {
+        AllotmentDeltaStats stats;
+        const int centre_count = static_cast<int>(centres.size());
+        if (!allotment_roster.valid || static_cast<int>(allotment_roster.occupants.size()) != centre_count)
+        {
+            rebuild_allotment_roster(snapshot);
+        }
+        AllotmentRoster &roster = allotment_roster;
+
+        // Quality figures follow the delta: a student's row is retracted from
+        // the totals before it first changes and counted again at the end.
+        const bool track_quality = allotment_quality.valid && allotment_quality.best_time.size() == students.size();
+        std::unordered_set<std::string> retracted;
+        const auto retract = [&](int s)
+        {
+            if (track_quality && retracted.insert(students[s].student_id).second)
+            {
+                count_quality_row(s, -1);
+            }
+        };
+
+        std::unordered_map<std::string, int> centre_index;
+        for (int c = 0; c < centre_count; c++)
+        {
+            centre_index[centres[c].centre_id] = c;
+        }
+
+        // Rules of the allotment being repaired, re-evaluated since centres may
+        // have changed; tiers are looked up per student as categories move.
+        const CentreEligibility eligibility = build_centre_eligibility(centres, eligibility_rules);
+        const auto eligible = [&](int s, int c)
+        {
+            return eligibility.allows(tier_of_category(students[s].category), c);
+        };
+
+        std::vector<int> load(centre_count, 0);
+        for (const int centre : student_assignment)
+        {
+            if (centre >= 0)
+            {
+                load[centre]++;
+            }
+        }
+
+        // Dense node of each student, looked up once; -2 = not looked up yet.
+        std::vector<int> node_of_student;
+        const auto forget_node = [&](int s)
+        {
+            if (s < static_cast<int>(node_of_student.size()))
+            {
+                node_of_student[s] = -2;
+            }
+        };
+        const auto node_index = [&](int s)
+        {
+            if (s >= static_cast<int>(node_of_student.size()))
+            {
+                node_of_student.resize(students.size(), -2);
+            }
+            if (node_of_student[s] == -2)
+            {
+                node_of_student[s] = snapshot.dense_graph.index(students[s].snapped_node_id);
+            }
+            return node_of_student[s];
+        };
+        const auto travel_time = [&](int s, int c)
+        {
+            return snapshot.distance_table.at(c, node_index(s));
+        };
+        // Lower is stronger: tier priority first, then a shorter trip.
+        const auto claim = [&](int s, int c)
+        {
+            return std::make_pair(static_cast<int>(tier_of_category(students[s].category)), travel_time(s, c));
+        };
+
+        // Roster entries are checked against the live state when read.
+        const auto seated_at = [&](int c)
+        {
+            return [&, c](int s)
+            { return s < static_cast<int>(students.size()) && student_assignment[s] == c; };
+        };
+        const auto prefers = [&](int c)
+        {
+            return [&, c](int s)
+            {
+                if (s >= static_cast<int>(students.size()))
+                {
+                    return false;
+                }
+                const int current = student_assignment[s];
+                return current >= 0 && current != c && travel_time(s, c) < travel_time(s, current) && eligible(s, c);
+            };
+        };
+        const auto unseated = [&](int s)
+        {
+            return s < static_cast<int>(students.size()) && student_assignment[s] < 0;
+        };
+        const auto compact = [](std::vector<int> &list, const auto &live) -> std::vector<int> &
+        {
+            std::sort(list.begin(), list.end());
+            list.erase(std::unique(list.begin(), list.end()), list.end());
+            list.erase(std::remove_if(list.begin(), list.end(), [&](int s)
+                                      { return !live(s); }),
+                       list.end());
+            return list;
+        };
+        std::vector<std::pair<double, int>> faster_scratch;
+        const auto enrol = [&](int s)
+        {
+            enrol_roster_student(snapshot, eligibility, s, student_assignment[s] >= 0 ? node_index(s) : -1, faster_scratch);
+        };
+
+        // Centre each touched student held before the delta ("" = none).
+        std::unordered_map<std::string, std::string> original_centre;
+        const auto set_assignment = [&](int s, int c)
+        {
+            const int previous = student_assignment[s];
+            if (previous == c)
+            {
+                return;
+            }
+            retract(s);
+            original_centre.emplace(students[s].student_id, previous >= 0 ? centres[previous].centre_id : std::string());
+            if (previous >= 0)
+            {
+                load[previous]--;
+            }
+            if (c >= 0)
+            {
+                load[c]++;
+            }
+            student_assignment[s] = c;
+            enrol(s);
+        };
+
+        std::vector<int> freed_centres;
+        const auto note_freed = [&](int c)
+        {
+            if (c >= 0)
+            {
+                freed_centres.push_back(c);
+            }
+        };
+
+        // 1. Removals: swap with the last student so indices stay dense.
+        for (const auto &student_id : delta.removed)
+        {
+            const auto it = student_index.find(student_id);
+            if (it == student_index.end())
+            {
+                stats.unknown_students.push_back(student_id);
+                continue;
+            }
+            const int s = it->second;
+            retract(s);
+            note_freed(student_assignment[s]);
+            set_assignment(s, -1);
+            original_centre.emplace(student_id, std::string());
+
+            const int last = static_cast<int>(students.size()) - 1;
+            if (s != last)
+            {
+                students[s] = std::move(students[last]);
+                student_assignment[s] = student_assignment[last];
+                student_index[students[s].student_id] = s;
+                if (track_quality)
+                {
+                    move_quality_row(last, s);
+                }
+                forget_node(s);
+                enrol(s);
+            }
+            forget_node(last);
+            students.pop_back();
+            student_assignment.pop_back();
+            if (track_quality)
+            {
+                resize_quality_rows(students.size());
+            }
+            student_index.erase(student_id);
+            stats.removed++;
+        }
+
+        // Occupants of a centre, weakest on top. Built from the roster on
+        // first use; entries whose student has since left the centre are
+        // skipped lazily.
+        using Occupant = std::pair<std::pair<int, double>, int>;
+        std::unordered_map<int, std::priority_queue<Occupant>> occupants;
+        const auto occupants_of = [&](int c) -> std::priority_queue<Occupant> &
+        {
+            auto inserted = occupants.emplace(c, std::priority_queue<Occupant>());
+            if (inserted.second)
+            {
+                for (const int s : compact(roster.occupants[c], seated_at(c)))
+                {
+                    inserted.first->second.push({claim(s, c), s});
+                }
+            }
+            return inserted.first->second;
+        };
+        const auto weakest_occupant = [&](int c)
+        {
+            auto &heap = occupants_of(c);
+            while (!heap.empty() && student_assignment[heap.top().second] != c)
+            {
+                heap.pop();
+            }
+            return heap.empty() ? -1 : heap.top().second;
+        };
+        const auto seat = [&](int s, int c)
+        {
+            set_assignment(s, c);
+            const auto it = occupants.find(c);
+            if (it != occupants.end())
+            {
+                it->second.push({claim(s, c), s});
+            }
+        };
+
+        // (student, cascade depth) waiting for a seat.
+        std::vector<std::pair<int, int>> pending;
+
+        // 2. Capacity changes; shrinking below the load evicts the weakest.
+        for (const auto &change : delta.capacity_changes)
+        {
+            const auto it = centre_index.find(change.first);
+            if (it == centre_index.end())
+            {
+                stats.unknown_centres.push_back(change.first);
+                continue;
+            }
+            const int c = it->second;
+            const int previous_capacity = centres[c].max_capacity;
+            centres[c].max_capacity = std::max(change.second, 0);
+            stats.capacity_changes++;
+            while (load[c] > centres[c].max_capacity)
+            {
+                const int weakest = weakest_occupant(c);
+                set_assignment(weakest, -1);
+                pending.push_back({weakest, 1});
+                stats.evictions++;
+            }
+            if (centres[c].max_capacity > previous_capacity)
+            {
+                note_freed(c);
+            }
+        }
+
+        // 3. Moves keep the student's index but need a fresh seat.
+        for (const auto &moved : delta.moved)
+        {
+            const auto it = student_index.find(moved.student_id);
+            if (it == student_index.end())
+            {
+                stats.unknown_students.push_back(moved.student_id);
+                continue;
+            }
+            const int s = it->second;
+            retract(s);
+            note_freed(student_assignment[s]);
+            set_assignment(s, -1);
+            students[s] = moved;
+            forget_node(s);
+            pending.push_back({s, 0});
+            stats.moved++;
+        }
+
+        // 4. Additions; re-adding a known id replaces that student.
+        for (const auto &added : delta.added)
+        {
+            const auto it = student_index.find(added.student_id);
+            int s;
+            if (it != student_index.end())
+            {
+                s = it->second;
+                retract(s);
+                note_freed(student_assignment[s]);
+                set_assignment(s, -1);
+                students[s] = added;
+                forget_node(s);
+            }
+            else
+            {
+                s = static_cast<int>(students.size());
+                students.push_back(added);
+                student_assignment.push_back(-1);
+                student_index[added.student_id] = s;
+                forget_node(s);
+                if (track_quality)
+                {
+                    resize_quality_rows(students.size());
+                    retracted.insert(added.student_id);
+                }
+            }
+            pending.push_back({s, 0});
+            stats.added++;
+        }
+
+        // Students left out earlier get another chance once seats free up:
+        // the strongest claimants of each freed centre, one per free seat.
+        if (!freed_centres.empty())
+        {
+            const std::vector<int> &unassigned = compact(roster.unassigned, unseated);
+            std::vector<std::pair<std::pair<int, double>, int>> claimants;
+            for (const int c : freed_centres)
+            {
+                const int free_seats = centres[c].max_capacity - load[c];
+                if (free_seats <= 0)
+                {
+                    continue;
+                }
+                claimants.clear();
+                for (const int s : unassigned)
+                {
+                    if (students[s].snapped_node_id != -1 && eligible(s, c) && travel_time(s, c) != std::numeric_limits<double>::max())
+                    {
+                        claimants.push_back({claim(s, c), s});
+                    }
+                }
+                const size_t take = std::min(claimants.size(), static_cast<size_t>(free_seats));
+                std::partial_sort(claimants.begin(), claimants.begin() + take, claimants.end());
+                for (size_t i = 0; i < take; i++)
+                {
+                    pending.push_back({claimants[i].second, 0});
+                }
+            }
+        }
+
+        // 5. Place pending students in greedy order (tier priority, then the
+        // shortest trip to an eligible centre), allowing bounded evictions.
+        std::sort(pending.begin(), pending.end());
+        pending.erase(std::unique(pending.begin(), pending.end(), [](const std::pair<int, int> &a, const std::pair<int, int> &b)
+                                  { return a.first == b.first; }),
+                      pending.end());
+        std::vector<std::pair<std::pair<int, double>, std::pair<int, int>>> ranked;
+        ranked.reserve(pending.size());
+        for (const auto &entry : pending)
+        {
+            const int s = entry.first;
+            double nearest = std::numeric_limits<double>::max();
+            for (int c = 0; c < centre_count; c++)
+            {
+                if (eligible(s, c))
+                {
+                    nearest = std::min(nearest, travel_time(s, c));
+                }
+            }
+            ranked.push_back({{static_cast<int>(tier_of_category(students[s].category)), nearest}, entry});
+        }
+        std::sort(ranked.begin(), ranked.end());
+        for (size_t i = 0; i < ranked.size(); i++)
+        {
+            pending[i] = ranked[i].second;
+        }
+
+        std::vector<int> order(centre_count);
+        for (size_t next = 0; next < pending.size(); next++)
+        {
+            const int s = pending[next].first;
+            const int depth = pending[next].second;
+            if (student_assignment[s] >= 0 || students[s].snapped_node_id == -1)
+            {
+                continue;
+            }
+
+            for (int c = 0; c < centre_count; c++)
+            {
+                order[c] = c;
+            }
+            std::sort(order.begin(), order.end(), [&](int a, int b)
+                      { return travel_time(s, a) < travel_time(s, b); });
+
+            bool blocked_by_limit = false;
+            for (const int c : order)
+            {
+                if (travel_time(s, c) == std::numeric_limits<double>::max())
+                {
+                    break;
+                }
+                if (!eligible(s, c))
+                {
+                    continue;
+                }
+                if (load[c] < centres[c].max_capacity)
+                {
+                    seat(s, c);
+                    break;
+                }
+                const int weakest = weakest_occupant(c);
+                if (weakest < 0 || !(claim(s, c) < claim(weakest, c)))
+                {
+                    continue;
+                }
+                if (depth >= delta.max_cascade)
+                {
+                    blocked_by_limit = true;
+                    continue;
+                }
+                set_assignment(weakest, -1);
+                pending.push_back({weakest, depth + 1});
+                stats.evictions++;
+                seat(s, c);
+                break;
+            }
+            if (student_assignment[s] < 0 && blocked_by_limit)
+            {
+                stats.cascade_limit_hits++;
+            }
+        }
+
+        // 6. Offer freed seats to students who prefer them to where they are.
+        std::vector<std::pair<int, int>> freed_queue;
+        for (const int c : freed_centres)
+        {
+            freed_queue.push_back({c, 0});
+        }
+        for (size_t next = 0; next < freed_queue.size(); next++)
+        {
+            const int c = freed_queue[next].first;
+            const int depth = freed_queue[next].second;
+            const int free_seats = centres[c].max_capacity - load[c];
+            if (free_seats <= 0)
+            {
+                continue;
+            }
+
+            std::vector<std::pair<std::pair<int, double>, int>> candidates;
+            for (const int s : compact(roster.preferred_by[c], prefers(c)))
+            {
+                candidates.push_back({claim(s, c), s});
+            }
+            const size_t take = std::min(candidates.size(), static_cast<size_t>(free_seats));
+            std::partial_sort(candidates.begin(), candidates.begin() + take, candidates.end());
+            for (size_t i = 0; i < take; i++)
+            {
+                const int s = candidates[i].second;
+                const int previous = student_assignment[s];
+                seat(s, c);
+                stats.relocations++;
+                if (depth + 1 <= delta.max_cascade)
+                {
+                    freed_queue.push_back({previous, depth + 1});
+                }
+                else
+                {
+                    stats.cascade_limit_hits++;
+                }
+            }
+        }
+
+        // Ids are only translated back to strings here, at the API boundary.
+        for (const auto &entry : original_centre)
+        {
+            const auto it = student_index.find(entry.first);
+            const int centre = it == student_index.end() ? -1 : student_assignment[it->second];
+            if (centre < 0)
+            {
+                final_assignments.erase(entry.first);
+            }
+            else
+            {
+                final_assignments[entry.first] = centres[centre].centre_id;
+            }
+            if (it == student_index.end() || (centre >= 0 ? centres[centre].centre_id : std::string()) != entry.second)
+            {
+                stats.changed_students.push_back(entry.first);
+            }
+        }
+        for (int c = 0; c < centre_count; c++)
+        {
+            centres[c].current_load = load[c];
+        }
+
+        // Lists nobody read keep their stale entries; sweep them all once as
+        // many entries have been appended as there are students.
+        if (roster.appended > students.size())
+        {
+            for (int c = 0; c < centre_count; c++)
+            {
+                compact(roster.occupants[c], seated_at(c));
+                compact(roster.preferred_by[c], prefers(c));
+            }
+            compact(roster.unassigned, unseated);
+            roster.appended = 0;
+        }
+
+        if (track_quality)
+        {
+            for (const auto &student_id : retracted)
+            {
+                const auto it = student_index.find(student_id);
+                if (it != student_index.end())
+                {
+                    fill_quality_row(snapshot, it->second);
+                    count_quality_row(it->second, 1);
+                }
+            }
+            settle_quality_max();
+        }
+        else
+        {
+            // Diagnostics rebuild the figures on their next read.
+            allotment_quality.valid = false;
+        }
+
+        std::cout << "Allotment delta: +" << stats.added << " -" << stats.removed << " ~" << stats.moved
+                  << " students, " << stats.capacity_changes << " capacity changes, " << stats.evictions
+                  << " evictions, " << stats.relocations << " relocations, "
+                  << stats.changed_students.size() << " assignments changed." << std::endl;
+
+        return stats;
     }
 
 } // namespace route_finder
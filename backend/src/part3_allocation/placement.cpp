@@ -0,0 +1,496 @@
+#include "route_finder/placement.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <queue>
+#include <utility>
+#include <vector>
+
+#include "route_finder/allotment.hpp"
+#include "route_finder/parallel.hpp"
+#include "route_finder/routing.hpp"
+
+namespace route_finder
+{
+    namespace
+    {
+
+        // One entry of the sparse site <-> demand distance lists. Float
+        // times keep thousands of candidates x a city's demand in memory.
+        struct DistanceEntry
+        {
+            int index{};
+            float time{};
+        };
+
+        // Best exchange found in a pass; in < 0 is a pure drop and out < 0 a
+        // pure add (both only when the site count is left free).
+        struct SwapMove
+        {
+            double profit{};
+            int in = -1;
+            int out = -1;
+        };
+
+        double elapsed_ms(std::chrono::high_resolution_clock::time_point since)
+        {
+            const auto now = std::chrono::high_resolution_clock::now();
+            return std::chrono::duration_cast<std::chrono::microseconds>(now - since).count() / 1000.0;
+        }
+
+    } // namespace
+
+    // p-median / facility location over road travel times. Students are
+    // aggregated per snapped node into weighted demand. One multi-source
+    // sweep drops demand that no candidate reaches within the bound, then a
+    // bounded reverse sweep per candidate (in parallel) builds sparse
+    // candidate -> demand lists. Sites are opened greedily with lazy gain
+    // re-evaluation (gains only shrink as sites open), then improved by
+    // best-improvement swaps: with each demand's nearest and second-nearest
+    // open site kept up to date, one pass prices every (in, out) exchange in
+    // O(entries + candidates x open sites), split across a worker pool.
+    PlacementResult optimise_centre_placement(const GraphSnapshot &snapshot,
+                                              const std::vector<PlacementCandidate> &candidates,
+                                              const std::vector<long> &student_nodes,
+                                              const PlacementOptions &options)
+    {
+        const DenseGraph &dense_graph = snapshot.dense_graph;
+        PlacementResult result;
+        const int candidate_count = static_cast<int>(candidates.size());
+        const double bound = options.max_travel_time_sec;
+        const double penalty = std::max(options.uncovered_penalty_sec > 0.0 ? options.uncovered_penalty_sec : 2.0 * bound, bound);
+        const unsigned threads = options.threads > 0 ? options.threads : worker_count(candidate_count);
+
+        // Demand: students per dense node.
+        std::vector<int> demand_of_node(dense_graph.size(), -1);
+        std::vector<int> demand_node;
+        std::vector<int> weight;
+        for (const long node_id : student_nodes)
+        {
+            const int node = dense_graph.index(node_id);
+            if (node < 0)
+            {
+                result.unreachable_students++;
+                continue;
+            }
+            if (demand_of_node[node] < 0)
+            {
+                demand_of_node[node] = static_cast<int>(demand_node.size());
+                demand_node.push_back(node);
+                weight.push_back(0);
+            }
+            weight[demand_of_node[node]]++;
+        }
+
+        std::vector<int> site_node(candidate_count);
+        std::vector<int> sources;
+        for (int j = 0; j < candidate_count; j++)
+        {
+            site_node[j] = dense_graph.index(candidates[j].snapped_node_id);
+            if (site_node[j] >= 0)
+            {
+                sources.push_back(site_node[j]);
+            }
+        }
+
+        const auto distance_start = std::chrono::high_resolution_clock::now();
+        {
+            DenseSweep sweep;
+            dijkstra_dense_bounded(dense_graph, sources, true, bound, sweep);
+            std::vector<int> kept_node, kept_weight;
+            for (size_t d = 0; d < demand_node.size(); d++)
+            {
+                const int node = demand_node[d];
+                if (sweep.distance[node] == std::numeric_limits<double>::max())
+                {
+                    result.unreachable_students += weight[d];
+                    demand_of_node[node] = -1;
+                    continue;
+                }
+                demand_of_node[node] = static_cast<int>(kept_node.size());
+                kept_node.push_back(node);
+                kept_weight.push_back(weight[d]);
+            }
+            demand_node.swap(kept_node);
+            weight.swap(kept_weight);
+        }
+        const int demand_count = static_cast<int>(demand_node.size());
+        result.demand_nodes = demand_count;
+
+        std::vector<std::vector<DistanceEntry>> site_list(candidate_count);
+        parallel_for_ranges(candidate_count, threads, [&](unsigned, size_t begin, size_t end)
+                            {
+            DenseSweep sweep;
+            std::vector<int> source(1);
+            for (size_t j = begin; j < end; j++)
+            {
+                if (site_node[j] < 0)
+                {
+                    continue;
+                }
+                source[0] = site_node[j];
+                dijkstra_dense_bounded(dense_graph, source, true, bound, sweep);
+                for (const int node : sweep.settled)
+                {
+                    const int d = demand_of_node[node];
+                    if (d >= 0)
+                    {
+                        site_list[j].push_back({d, static_cast<float>(sweep.distance[node])});
+                    }
+                }
+            } });
+
+        // Transposed lists, demand -> candidates, for rescans after a site closes.
+        std::vector<size_t> demand_offsets(demand_count + 1, 0);
+        for (const auto &list : site_list)
+        {
+            for (const auto &entry : list)
+            {
+                demand_offsets[entry.index + 1]++;
+            }
+        }
+        for (int d = 0; d < demand_count; d++)
+        {
+            demand_offsets[d + 1] += demand_offsets[d];
+        }
+        std::vector<DistanceEntry> demand_entries(demand_offsets[demand_count]);
+        {
+            std::vector<size_t> cursor(demand_offsets.begin(), demand_offsets.end() - 1);
+            for (int j = 0; j < candidate_count; j++)
+            {
+                for (const auto &entry : site_list[j])
+                {
+                    demand_entries[cursor[entry.index]++] = {j, entry.time};
+                }
+            }
+        }
+        result.distance_entries = static_cast<long long>(demand_entries.size());
+        result.distance_ms = elapsed_ms(distance_start);
+
+        std::vector<char> open(candidate_count, 0);
+        std::vector<int> first_site(demand_count, -1), second_site(demand_count, -1);
+        std::vector<double> first_time(demand_count, penalty), second_time(demand_count, penalty);
+        const auto offer = [&](int d, int j, double time)
+        {
+            if (time < first_time[d])
+            {
+                second_site[d] = first_site[d];
+                second_time[d] = first_time[d];
+                first_site[d] = j;
+                first_time[d] = time;
+            }
+            else if (time < second_time[d])
+            {
+                second_site[d] = j;
+                second_time[d] = time;
+            }
+        };
+        const auto rescan = [&](int d)
+        {
+            first_site[d] = second_site[d] = -1;
+            first_time[d] = second_time[d] = penalty;
+            for (size_t e = demand_offsets[d]; e < demand_offsets[d + 1]; e++)
+            {
+                if (open[demand_entries[e].index])
+                {
+                    offer(d, demand_entries[e].index, demand_entries[e].time);
+                }
+            }
+        };
+        const auto objective = [&]()
+        {
+            double total = 0.0;
+            for (int d = 0; d < demand_count; d++)
+            {
+                total += weight[d] * first_time[d];
+            }
+            for (int j = 0; j < candidate_count; j++)
+            {
+                if (open[j])
+                {
+                    total += candidates[j].fixed_cost_sec;
+                }
+            }
+            return total;
+        };
+
+        long long total_demand = 0;
+        for (const int w : weight)
+        {
+            total_demand += w;
+        }
+        bool capacitated = candidate_count > 0;
+        for (const auto &candidate : candidates)
+        {
+            capacitated = capacitated && candidate.capacity > 0;
+        }
+        long long open_capacity = 0;
+
+        // Greedy opening with lazily re-evaluated gains.
+        const auto greedy_start = std::chrono::high_resolution_clock::now();
+        const auto add_gain = [&](int j)
+        {
+            double gain = -candidates[j].fixed_cost_sec;
+            for (const auto &entry : site_list[j])
+            {
+                if (entry.time < first_time[entry.index])
+                {
+                    gain += weight[entry.index] * (first_time[entry.index] - entry.time);
+                }
+            }
+            return gain;
+        };
+        std::vector<double> initial_gain(candidate_count);
+        parallel_for_ranges(candidate_count, threads, [&](unsigned, size_t begin, size_t end)
+                            {
+            for (size_t j = begin; j < end; j++)
+            {
+                initial_gain[j] = add_gain(static_cast<int>(j));
+            } });
+
+        std::priority_queue<std::pair<double, int>> gains;
+        std::vector<int> gain_stamp(candidate_count, 0);
+        for (int j = 0; j < candidate_count; j++)
+        {
+            if (site_node[j] >= 0)
+            {
+                gains.push({initial_gain[j], j});
+            }
+        }
+        const size_t target = options.sites > 0 ? static_cast<size_t>(options.sites) : static_cast<size_t>(candidate_count);
+        while (result.open_sites.size() < target && !gains.empty())
+        {
+            const auto top = gains.top();
+            gains.pop();
+            const int j = top.second;
+            if (gain_stamp[j] != static_cast<int>(result.open_sites.size()))
+            {
+                gain_stamp[j] = static_cast<int>(result.open_sites.size());
+                gains.push({add_gain(j), j});
+                continue;
+            }
+            if (options.sites == 0 && top.first <= 0.0)
+            {
+                break;
+            }
+            open[j] = 1;
+            open_capacity += candidates[j].capacity;
+            result.open_sites.push_back(j);
+            for (const auto &entry : site_list[j])
+            {
+                offer(entry.index, j, entry.time);
+            }
+        }
+        result.greedy_objective = objective();
+        result.greedy_ms = elapsed_ms(greedy_start);
+
+        // Swap local search.
+        const auto swap_start = std::chrono::high_resolution_clock::now();
+        const auto capacity_allows = [&](int in, int out)
+        {
+            if (!capacitated)
+            {
+                return true;
+            }
+            const long long after = open_capacity + (in >= 0 ? candidates[in].capacity : 0) - (out >= 0 ? candidates[out].capacity : 0);
+            return after >= std::min(open_capacity, total_demand);
+        };
+
+        WorkerPool pool(threads);
+        std::vector<std::vector<double>> worker_adjust(pool.size());
+        std::vector<SwapMove> worker_best(pool.size());
+        std::vector<int> slot_of_site(candidate_count, -1);
+        std::vector<double> removal_loss;
+        while (result.swaps < options.max_swaps && !result.open_sites.empty())
+        {
+            result.passes++;
+            const int open_count = static_cast<int>(result.open_sites.size());
+            for (int slot = 0; slot < open_count; slot++)
+            {
+                slot_of_site[result.open_sites[slot]] = slot;
+            }
+            // Cost of closing each open site with nothing opened in its place.
+            removal_loss.assign(open_count, 0.0);
+            for (int d = 0; d < demand_count; d++)
+            {
+                if (first_site[d] >= 0)
+                {
+                    removal_loss[slot_of_site[first_site[d]]] += weight[d] * (second_time[d] - first_time[d]);
+                }
+            }
+
+            pool.for_ranges(candidate_count, [&](unsigned worker, size_t begin, size_t end)
+                            {
+                std::vector<double> &adjust = worker_adjust[worker];
+                SwapMove &best = worker_best[worker];
+                best = SwapMove{};
+                for (size_t j = begin; j < end; j++)
+                {
+                    if (open[j] || site_node[j] < 0)
+                    {
+                        continue;
+                    }
+                    // Opening j: demand it would win, and how much cheaper
+                    // closing each open site becomes with j as the fallback.
+                    adjust.assign(open_count, 0.0);
+                    double gain = 0.0;
+                    for (const auto &entry : site_list[j])
+                    {
+                        const int d = entry.index;
+                        if (entry.time < first_time[d])
+                        {
+                            gain += weight[d] * (first_time[d] - entry.time);
+                            if (first_site[d] >= 0)
+                            {
+                                adjust[slot_of_site[first_site[d]]] -= weight[d] * (second_time[d] - first_time[d]);
+                            }
+                        }
+                        else if (entry.time < second_time[d])
+                        {
+                            adjust[slot_of_site[first_site[d]]] -= weight[d] * (second_time[d] - entry.time);
+                        }
+                    }
+                    const int in = static_cast<int>(j);
+                    for (int slot = 0; slot < open_count; slot++)
+                    {
+                        const int out = result.open_sites[slot];
+                        const double profit = gain - (removal_loss[slot] + adjust[slot]) -
+                                              candidates[in].fixed_cost_sec + candidates[out].fixed_cost_sec;
+                        if (profit > best.profit && capacity_allows(in, out))
+                        {
+                            best = {profit, in, out};
+                        }
+                    }
+                    if (options.sites == 0 && gain - candidates[in].fixed_cost_sec > best.profit)
+                    {
+                        best = {gain - candidates[in].fixed_cost_sec, in, -1};
+                    }
+                } });
+
+            SwapMove best;
+            for (const auto &candidate : worker_best)
+            {
+                if (candidate.profit > best.profit)
+                {
+                    best = candidate;
+                }
+            }
+            if (options.sites == 0 && open_count > 1)
+            {
+                for (int slot = 0; slot < open_count; slot++)
+                {
+                    const int out = result.open_sites[slot];
+                    const double profit = candidates[out].fixed_cost_sec - removal_loss[slot];
+                    if (profit > best.profit && capacity_allows(-1, out))
+                    {
+                        best = {profit, -1, out};
+                    }
+                }
+            }
+            // Relative threshold so float rounding cannot cycle two sites.
+            if (best.profit <= 1e-9 * std::max(1.0, result.greedy_objective))
+            {
+                break;
+            }
+
+            if (best.out >= 0)
+            {
+                open[best.out] = 0;
+                open_capacity -= candidates[best.out].capacity;
+                result.open_sites.erase(result.open_sites.begin() + slot_of_site[best.out]);
+                slot_of_site[best.out] = -1;
+            }
+            if (best.in >= 0)
+            {
+                open[best.in] = 1;
+                open_capacity += candidates[best.in].capacity;
+                result.open_sites.push_back(best.in);
+                for (const auto &entry : site_list[best.in])
+                {
+                    offer(entry.index, best.in, entry.time);
+                }
+            }
+            if (best.out >= 0)
+            {
+                for (const auto &entry : site_list[best.out])
+                {
+                    if (first_site[entry.index] == best.out || second_site[entry.index] == best.out)
+                    {
+                        rescan(entry.index);
+                    }
+                }
+            }
+            result.swaps++;
+        }
+        result.swap_ms = elapsed_ms(swap_start);
+
+        result.objective = objective();
+        result.site_students.assign(result.open_sites.size(), 0);
+        for (size_t slot = 0; slot < result.open_sites.size(); slot++)
+        {
+            slot_of_site[result.open_sites[slot]] = static_cast<int>(slot);
+        }
+        for (int d = 0; d < demand_count; d++)
+        {
+            if (first_site[d] < 0)
+            {
+                result.uncovered_students += weight[d];
+                continue;
+            }
+            result.covered_students += weight[d];
+            result.site_students[slot_of_site[first_site[d]]] += weight[d];
+            result.travel_time += weight[d] * first_time[d];
+            result.max_travel_time = std::max(result.max_travel_time, first_time[d]);
+        }
+        if (capacitated)
+        {
+            result.capacity_shortfall = std::max(0LL, total_demand - open_capacity);
+        }
+
+        // Capacities are only a feasibility guard in the search; the greedy
+        // allotment shows what the chosen sites give once seats run out.
+        if (capacitated && !result.open_sites.empty())
+        {
+            const int open_count = static_cast<int>(result.open_sites.size());
+            AllotmentProblem problem;
+            problem.centre_count = open_count;
+            for (const int j : result.open_sites)
+            {
+                problem.capacity.push_back(candidates[j].capacity);
+            }
+            auto rows = std::make_shared<std::vector<double>>(static_cast<size_t>(demand_count) * open_count,
+                                                              std::numeric_limits<double>::max());
+            for (int d = 0; d < demand_count; d++)
+            {
+                for (size_t e = demand_offsets[d]; e < demand_offsets[d + 1]; e++)
+                {
+                    const int slot = open[demand_entries[e].index] ? slot_of_site[demand_entries[e].index] : -1;
+                    if (slot >= 0)
+                    {
+                        (*rows)[static_cast<size_t>(d) * open_count + slot] = demand_entries[e].time;
+                    }
+                }
+                problem.student_tier.insert(problem.student_tier.end(), weight[d], kTierMale);
+                problem.student_row.insert(problem.student_row.end(), weight[d], d);
+            }
+            problem.distance_rows = std::move(rows);
+
+            const AllotmentResult allotment = solve_greedy_allotment(problem);
+            result.capacitated = true;
+            result.capacitated_assigned = allotment.assigned_count;
+            result.capacitated_travel_time = total_travel_time(problem, allotment);
+        }
+
+        std::cout << "Placement: opened " << result.open_sites.size() << " of " << candidate_count
+                  << " candidate sites for " << demand_count << " demand nodes (" << result.distance_entries
+                  << " distance entries); objective " << result.objective << " s vs greedy " << result.greedy_objective
+                  << " s after " << result.swaps << " swaps in " << result.passes << " passes ("
+                  << result.distance_ms << " / " << result.greedy_ms << " / " << result.swap_ms << " ms)." << std::endl;
+
+        return result;
+    }
+
+} // namespace route_finder
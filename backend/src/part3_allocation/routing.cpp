@@ -10,13 +10,14 @@
 #include <queue>
 #include <set>
 #include <string>
+#include <tuple>
 #include <unordered_map>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 
 #include "json_single.hpp"
 #include "route_finder/geometry.hpp"
-#include "route_finder/state.hpp"
 
 namespace route_finder
 {
@@ -25,16 +26,18 @@ namespace
 
 constexpr double kMaxSpeedMetresPerSecond = 27.8;
 
-double heuristic(long node1, long node2)
+double heuristic(const std::unordered_map<long, Node> &nodes, long node1, long node2)
 {
-    if (nodes.find(node1) == nodes.end() || nodes.find(node2) == nodes.end())
+    const auto it1 = nodes.find(node1);
+    const auto it2 = nodes.find(node2);
+    if (it1 == nodes.end() || it2 == nodes.end())
     {
         return 0.0;
     }
 
     const double distance_metres = haversine(
-        nodes[node1].lat, nodes[node1].lon,
-        nodes[node2].lat, nodes[node2].lon);
+        it1->second.lat, it1->second.lon,
+        it2->second.lat, it2->second.lon);
 
     return distance_metres / kMaxSpeedMetresPerSecond;
 }
@@ -53,8 +56,11 @@ struct BestFirstNode
 
 } // namespace
 
-std::vector<long> clean_and_validate_path(const std::vector<long> &path)
+std::vector<long> clean_and_validate_path(const GraphSnapshot &snapshot, const std::vector<long> &path)
 {
+    const Graph &graph = snapshot.graph;
+    const auto &nodes = snapshot.nodes;
+
     if (path.empty())
     {
         return {};
@@ -71,7 +77,7 @@ std::vector<long> clean_and_validate_path(const std::vector<long> &path)
             continue;
         }
 
-        if (graph.find(node_id) == graph.end() || graph[node_id].empty())
+        if (graph.find(node_id) == graph.end() || graph.at(node_id).empty())
         {
             std::cerr << "Path contains disconnected node " << node_id << std::endl;
             continue;
@@ -83,8 +89,44 @@ std::vector<long> clean_and_validate_path(const std::vector<long> &path)
     return cleaned_path;
 }
 
-std::vector<long> a_star_bidirectional(long start_node, long goal_node)
+std::vector<std::pair<double, double>> path_to_coordinates(const GraphSnapshot &snapshot, const std::vector<long> &path)
+{
+    const auto &nodes = snapshot.nodes;
+    const auto &edge_shapes = snapshot.edge_shapes;
+
+    std::vector<std::pair<double, double>> coordinates;
+    coordinates.reserve(path.size());
+
+    for (size_t i = 0; i < path.size(); i++)
+    {
+        const auto node_it = nodes.find(path[i]);
+        if (node_it == nodes.end())
+        {
+            continue;
+        }
+
+        // Contracted edges carry the shape points that were removed from the graph.
+        if (i > 0 && !edge_shapes.empty())
+        {
+            const auto shape_it = edge_shapes.find({path[i - 1], path[i]});
+            if (shape_it != edge_shapes.end())
+            {
+                const auto first = snapshot.edge_shape_points.begin() + shape_it->second.offset;
+                coordinates.insert(coordinates.end(), first, first + shape_it->second.count);
+            }
+        }
+
+        coordinates.push_back({node_it->second.lat, node_it->second.lon});
+    }
+
+    return coordinates;
+}
+
+std::vector<long> a_star_bidirectional(const GraphSnapshot &snapshot, long start_node, long goal_node)
 {
+    const Graph &graph = snapshot.graph;
+    const auto &nodes = snapshot.nodes;
+
     if (start_node == goal_node)
     {
         return {start_node};
@@ -108,8 +150,8 @@ std::vector<long> a_star_bidirectional(long start_node, long goal_node)
     g_score_forward[start_node] = 0.0;
     g_score_backward[goal_node] = 0.0;
 
-    open_forward.push({start_node, 0.0, heuristic(start_node, goal_node)});
-    open_backward.push({goal_node, 0.0, heuristic(goal_node, start_node)});
+    open_forward.push({start_node, 0.0, heuristic(nodes, start_node, goal_node)});
+    open_backward.push({goal_node, 0.0, heuristic(nodes, goal_node, start_node)});
 
     long meeting_point = -1;
     int iterations = 0;
@@ -138,7 +180,7 @@ std::vector<long> a_star_bidirectional(long start_node, long goal_node)
 
             if (graph.find(current.node_id) != graph.end())
             {
-                for (auto it = graph[current.node_id].begin(); it != graph[current.node_id].end(); ++it)
+                for (auto it = graph.at(current.node_id).begin(); it != graph.at(current.node_id).end(); ++it)
                 {
                     const long neighbor = it->first;
                     const double edge_weight = it->second;
@@ -149,7 +191,7 @@ std::vector<long> a_star_bidirectional(long start_node, long goal_node)
                         g_score_forward[neighbor] = tentative_g;
                         came_from_forward[neighbor] = current.node_id;
 
-                        const double f = tentative_g + heuristic(neighbor, goal_node);
+                        const double f = tentative_g + heuristic(nodes, neighbor, goal_node);
                         open_forward.push({neighbor, tentative_g, f});
                     }
                 }
@@ -175,7 +217,7 @@ std::vector<long> a_star_bidirectional(long start_node, long goal_node)
 
             if (graph.find(current.node_id) != graph.end())
             {
-                for (auto it = graph[current.node_id].begin(); it != graph[current.node_id].end(); ++it)
+                for (auto it = graph.at(current.node_id).begin(); it != graph.at(current.node_id).end(); ++it)
                 {
                     const long neighbor = it->first;
                     const double edge_weight = it->second;
@@ -186,7 +228,7 @@ std::vector<long> a_star_bidirectional(long start_node, long goal_node)
                         g_score_backward[neighbor] = tentative_g;
                         came_from_backward[neighbor] = current.node_id;
 
-                        const double f = tentative_g + heuristic(neighbor, start_node);
+                        const double f = tentative_g + heuristic(nodes, neighbor, start_node);
                         open_backward.push({neighbor, tentative_g, f});
                     }
                 }
@@ -225,8 +267,11 @@ std::vector<long> a_star_bidirectional(long start_node, long goal_node)
     return full_path;
 }
 
-std::vector<long> a_star(long start_node, long goal_node)
+std::vector<long> a_star(const GraphSnapshot &snapshot, long start_node, long goal_node)
 {
+    const Graph &graph = snapshot.graph;
+    const auto &nodes = snapshot.nodes;
+
     std::unordered_map<long, double> g_score;
     std::unordered_map<long, double> f_score;
     std::unordered_map<long, long> came_from;
@@ -243,7 +288,7 @@ std::vector<long> a_star(long start_node, long goal_node)
     }
 
     g_score[start_node] = 0.0;
-    f_score[start_node] = heuristic(start_node, goal_node);
+    f_score[start_node] = heuristic(nodes, start_node, goal_node);
     open_set.push(start_node);
     open_tracker.insert(start_node);
 
@@ -269,7 +314,7 @@ std::vector<long> a_star(long start_node, long goal_node)
 
         if (graph.find(current) != graph.end())
         {
-            for (auto it = graph[current].begin(); it != graph[current].end(); ++it)
+            for (auto it = graph.at(current).begin(); it != graph.at(current).end(); ++it)
             {
                 const long neighbor = it->first;
                 const double edge_weight = it->second;
@@ -279,7 +324,7 @@ std::vector<long> a_star(long start_node, long goal_node)
                 {
                     came_from[neighbor] = current;
                     g_score[neighbor] = tentative_g;
-                    f_score[neighbor] = tentative_g + heuristic(neighbor, goal_node);
+                    f_score[neighbor] = tentative_g + heuristic(nodes, neighbor, goal_node);
 
                     if (!open_tracker.count(neighbor))
                     {
@@ -294,7 +339,7 @@ std::vector<long> a_star(long start_node, long goal_node)
     return {};
 }
 
-std::unordered_map<long, double> dijkstra(long start_node)
+std::unordered_map<long, double> dijkstra(const Graph &graph, long start_node)
 {
     std::unordered_map<long, double> distances;
     std::priority_queue<std::pair<double, long>,
@@ -302,10 +347,15 @@ std::unordered_map<long, double> dijkstra(long start_node)
                         std::greater<std::pair<double, long>>>
         pq;
 
-    for (auto it = nodes.begin(); it != nodes.end(); ++it)
+    // Only reached nodes get an entry; absent nodes are unreachable. This keeps
+    // the sweep independent of shape points that are not part of the graph.
+    const auto distance_of = [&distances](long node_id)
     {
-        distances[it->first] = std::numeric_limits<double>::max();
-    }
+        const auto it = distances.find(node_id);
+        return it != distances.end() ? it->second : std::numeric_limits<double>::max();
+    };
+
+    distances.reserve(graph.size());
     distances[start_node] = 0.0;
     pq.push({0.0, start_node});
 
@@ -316,19 +366,20 @@ std::unordered_map<long, double> dijkstra(long start_node)
         const double current_dist = current_pair.first;
         const long current_node = current_pair.second;
 
-        if (current_dist > distances[current_node])
+        if (current_dist > distance_of(current_node))
         {
             continue;
         }
 
-        if (graph.find(current_node) != graph.end())
+        const auto graph_it = graph.find(current_node);
+        if (graph_it != graph.end())
         {
-            for (auto it = graph[current_node].begin(); it != graph[current_node].end(); ++it)
+            for (auto it = graph_it->second.begin(); it != graph_it->second.end(); ++it)
             {
                 const long neighbor = it->first;
                 const double edge_weight = it->second;
                 const double new_dist = current_dist + edge_weight;
-                if (new_dist < distances[neighbor])
+                if (new_dist < distance_of(neighbor))
                 {
                     distances[neighbor] = new_dist;
                     pq.push({new_dist, neighbor});
@@ -340,7 +391,7 @@ std::unordered_map<long, double> dijkstra(long start_node)
     return distances;
 }
 
-std::pair<std::unordered_map<long, double>, std::unordered_map<long, long>> dijkstra_with_parents(long start_node)
+std::pair<std::unordered_map<long, double>, std::unordered_map<long, long>> dijkstra_with_parents(const Graph &graph, long start_node)
 {
     std::unordered_map<long, double> distances;
     std::unordered_map<long, long> parents;
@@ -349,11 +400,14 @@ std::pair<std::unordered_map<long, double>, std::unordered_map<long, long>> dijk
                         std::greater<std::pair<double, long>>>
         pq;
 
-    for (auto it = nodes.begin(); it != nodes.end(); ++it)
+    const auto distance_of = [&distances](long node_id)
     {
-        distances[it->first] = std::numeric_limits<double>::max();
-        parents[it->first] = -1;
-    }
+        const auto it = distances.find(node_id);
+        return it != distances.end() ? it->second : std::numeric_limits<double>::max();
+    };
+
+    distances.reserve(graph.size());
+    parents.reserve(graph.size());
     distances[start_node] = 0.0;
     parents[start_node] = start_node;
     pq.push({0.0, start_node});
@@ -365,20 +419,21 @@ std::pair<std::unordered_map<long, double>, std::unordered_map<long, long>> dijk
         const double current_dist = current_pair.first;
         const long current_node = current_pair.second;
 
-        if (current_dist > distances[current_node])
+        if (current_dist > distance_of(current_node))
         {
             continue;
         }
 
-        if (graph.find(current_node) != graph.end())
+        const auto graph_it = graph.find(current_node);
+        if (graph_it != graph.end())
         {
-            for (auto it = graph[current_node].begin(); it != graph[current_node].end(); ++it)
+            for (auto it = graph_it->second.begin(); it != graph_it->second.end(); ++it)
             {
                 const long neighbor = it->first;
                 const double edge_weight = it->second;
                 const double new_dist = current_dist + edge_weight;
 
-                if (new_dist < distances[neighbor])
+                if (new_dist < distance_of(neighbor))
                 {
                     distances[neighbor] = new_dist;
                     parents[neighbor] = current_node;
@@ -391,7 +446,326 @@ std::pair<std::unordered_map<long, double>, std::unordered_map<long, long>> dijk
     return {distances, parents};
 }
 
-DijkstraResult run_dijkstra_for_centre(const Centre &centre)
+// Dijkstra over dense graph indices. With reverse_edges the search follows
+// edges backwards, so distances are travel times *to* the source. `parents`,
+// when given, receives the next hop towards the source (or the predecessor
+// from it in forward mode); -1 marks unreached nodes.
+std::vector<double> dijkstra_dense(const DenseGraph &g, int source_index, bool reverse_edges, std::vector<int> *parents)
+{
+    const auto &offsets = reverse_edges ? g.reverse_offsets : g.offsets;
+    const auto &targets = reverse_edges ? g.reverse_targets : g.targets;
+    const auto &weights = reverse_edges ? g.reverse_weights : g.weights;
+
+    std::vector<double> distances(g.size(), std::numeric_limits<double>::max());
+    if (parents)
+    {
+        parents->assign(g.size(), -1);
+    }
+    if (source_index < 0 || source_index >= g.size())
+    {
+        return distances;
+    }
+
+    std::priority_queue<std::pair<double, int>,
+                        std::vector<std::pair<double, int>>,
+                        std::greater<std::pair<double, int>>>
+        pq;
+    distances[source_index] = 0.0;
+    if (parents)
+    {
+        (*parents)[source_index] = source_index;
+    }
+    pq.push({0.0, source_index});
+
+    while (!pq.empty())
+    {
+        const auto [current_dist, current] = pq.top();
+        pq.pop();
+
+        if (current_dist > distances[current])
+        {
+            continue;
+        }
+
+        for (int e = offsets[current]; e < offsets[current + 1]; e++)
+        {
+            const int neighbor = targets[e];
+            const double new_dist = current_dist + weights[e];
+            if (new_dist < distances[neighbor])
+            {
+                distances[neighbor] = new_dist;
+                if (parents)
+                {
+                    (*parents)[neighbor] = current;
+                }
+                pq.push({new_dist, neighbor});
+            }
+        }
+    }
+
+    return distances;
+}
+
+// Multi-source Dijkstra that stops once the frontier passes `bound`. Every
+// source starts at distance 0, so each node ends up with the travel time
+// from (or, reversed, to) its nearest source.
+void dijkstra_dense_bounded(const DenseGraph &g, const std::vector<int> &source_indices, bool reverse_edges, double bound, DenseSweep &sweep)
+{
+    const auto &offsets = reverse_edges ? g.reverse_offsets : g.offsets;
+    const auto &targets = reverse_edges ? g.reverse_targets : g.targets;
+    const auto &weights = reverse_edges ? g.reverse_weights : g.weights;
+
+    if (sweep.distance.size() != static_cast<size_t>(g.size()))
+    {
+        sweep.distance.assign(g.size(), std::numeric_limits<double>::max());
+    }
+    else
+    {
+        for (const int node : sweep.touched)
+        {
+            sweep.distance[node] = std::numeric_limits<double>::max();
+        }
+    }
+    sweep.touched.clear();
+    sweep.settled.clear();
+
+    std::priority_queue<std::pair<double, int>,
+                        std::vector<std::pair<double, int>>,
+                        std::greater<std::pair<double, int>>>
+        pq;
+    for (const int source : source_indices)
+    {
+        if (source >= 0 && source < g.size() && sweep.distance[source] != 0.0)
+        {
+            sweep.distance[source] = 0.0;
+            sweep.touched.push_back(source);
+            pq.push({0.0, source});
+        }
+    }
+
+    while (!pq.empty())
+    {
+        const auto [current_dist, current] = pq.top();
+        pq.pop();
+
+        if (current_dist > sweep.distance[current])
+        {
+            continue;
+        }
+        sweep.settled.push_back(current);
+
+        for (int e = offsets[current]; e < offsets[current + 1]; e++)
+        {
+            const int neighbor = targets[e];
+            const double new_dist = current_dist + weights[e];
+            if (new_dist <= bound && new_dist < sweep.distance[neighbor])
+            {
+                if (sweep.distance[neighbor] == std::numeric_limits<double>::max())
+                {
+                    sweep.touched.push_back(neighbor);
+                }
+                sweep.distance[neighbor] = new_dist;
+                pq.push({new_dist, neighbor});
+            }
+        }
+    }
+}
+
+// Single-source Dijkstra that stops once every node in `target_indices` is
+// settled, leaving the shortest path tree in `parents` (the source is its own
+// parent, unreached nodes -1). On reversed edges, following parents from a
+// target walks its shortest path to the source. Scratch state is reset the
+// same way as in dijkstra_dense_bounded.
+void dijkstra_dense_tree(const DenseGraph &g, int source_index, bool reverse_edges, const std::vector<int> &target_indices,
+                         DenseSweep &sweep, std::vector<int> &parents)
+{
+    const auto &offsets = reverse_edges ? g.reverse_offsets : g.offsets;
+    const auto &targets = reverse_edges ? g.reverse_targets : g.targets;
+    const auto &weights = reverse_edges ? g.reverse_weights : g.weights;
+
+    if (sweep.distance.size() != static_cast<size_t>(g.size()) || parents.size() != static_cast<size_t>(g.size()))
+    {
+        sweep.distance.assign(g.size(), std::numeric_limits<double>::max());
+        parents.assign(g.size(), -1);
+    }
+    else
+    {
+        for (const int node : sweep.touched)
+        {
+            sweep.distance[node] = std::numeric_limits<double>::max();
+            parents[node] = -1;
+        }
+    }
+    sweep.touched.clear();
+    sweep.settled.clear();
+    if (source_index < 0 || source_index >= g.size())
+    {
+        return;
+    }
+
+    std::unordered_set<int> remaining;
+    for (const int target : target_indices)
+    {
+        if (target >= 0 && target < g.size())
+        {
+            remaining.insert(target);
+        }
+    }
+
+    std::priority_queue<std::pair<double, int>,
+                        std::vector<std::pair<double, int>>,
+                        std::greater<std::pair<double, int>>>
+        pq;
+    sweep.distance[source_index] = 0.0;
+    parents[source_index] = source_index;
+    sweep.touched.push_back(source_index);
+    pq.push({0.0, source_index});
+
+    while (!pq.empty() && !remaining.empty())
+    {
+        const auto [current_dist, current] = pq.top();
+        pq.pop();
+
+        if (current_dist > sweep.distance[current])
+        {
+            continue;
+        }
+        sweep.settled.push_back(current);
+        remaining.erase(current);
+
+        for (int e = offsets[current]; e < offsets[current + 1]; e++)
+        {
+            const int neighbor = targets[e];
+            const double new_dist = current_dist + weights[e];
+            if (new_dist < sweep.distance[neighbor])
+            {
+                if (sweep.distance[neighbor] == std::numeric_limits<double>::max())
+                {
+                    sweep.touched.push_back(neighbor);
+                }
+                sweep.distance[neighbor] = new_dist;
+                parents[neighbor] = current;
+                pq.push({new_dist, neighbor});
+            }
+        }
+    }
+}
+
+// Node ids from `node_index` to the root of a shortest path tree (a column of
+// DistanceTable::next_hop_by_centre, or parents from dijkstra_dense_tree on
+// reversed edges). Empty if the node is not in the tree.
+std::vector<long> path_along_next_hops(const DenseGraph &g, const std::vector<std::int32_t> &next_hop, int node_index)
+{
+    std::vector<long> path;
+    if (node_index < 0 || node_index >= static_cast<int>(next_hop.size()) || next_hop[node_index] < 0)
+    {
+        return path;
+    }
+    path.push_back(g.node_ids[node_index]);
+    while (next_hop[node_index] != node_index)
+    {
+        node_index = next_hop[node_index];
+        path.push_back(g.node_ids[node_index]);
+    }
+    return path;
+}
+
+// One multi-source sweep that keeps the two nearest distinct sources per
+// node. A source can only be among a node's two nearest if it is among
+// the two nearest of every node on its shortest path there, so each node
+// holds at most two tentative labels and is settled at most twice.
+VoronoiPartition network_voronoi(const DenseGraph &g, const std::vector<int> &source_indices, bool reverse_edges)
+{
+    const auto &offsets = reverse_edges ? g.reverse_offsets : g.offsets;
+    const auto &targets = reverse_edges ? g.reverse_targets : g.targets;
+    const auto &weights = reverse_edges ? g.reverse_weights : g.weights;
+
+    VoronoiPartition partition;
+    partition.nearest.assign(g.size(), -1);
+    partition.nearest_time.assign(g.size(), std::numeric_limits<double>::max());
+    partition.runner_up.assign(g.size(), -1);
+    partition.runner_up_time.assign(g.size(), std::numeric_limits<double>::max());
+
+    using Label = std::tuple<double, int, int>; // time, node, source
+    std::priority_queue<Label, std::vector<Label>, std::greater<Label>> pq;
+
+    // Records `source` at `node` if it becomes one of the two best labels.
+    const auto offer = [&](int node, int source, double time)
+    {
+        int &first = partition.nearest[node];
+        double &first_time = partition.nearest_time[node];
+        int &second = partition.runner_up[node];
+        double &second_time = partition.runner_up_time[node];
+        if (source == first)
+        {
+            if (time >= first_time)
+            {
+                return;
+            }
+            first_time = time;
+        }
+        else if (source == second)
+        {
+            if (time >= second_time)
+            {
+                return;
+            }
+            second_time = time;
+            if (second_time < first_time)
+            {
+                std::swap(first, second);
+                std::swap(first_time, second_time);
+            }
+        }
+        else if (time < first_time)
+        {
+            second = first;
+            second_time = first_time;
+            first = source;
+            first_time = time;
+        }
+        else if (time < second_time)
+        {
+            second = source;
+            second_time = time;
+        }
+        else
+        {
+            return;
+        }
+        pq.push({time, node, source});
+    };
+
+    for (size_t p = 0; p < source_indices.size(); p++)
+    {
+        if (source_indices[p] >= 0 && source_indices[p] < g.size())
+        {
+            offer(source_indices[p], static_cast<int>(p), 0.0);
+        }
+    }
+
+    while (!pq.empty())
+    {
+        const auto [time, node, source] = pq.top();
+        pq.pop();
+
+        const bool current = (source == partition.nearest[node] && time == partition.nearest_time[node]) ||
+                             (source == partition.runner_up[node] && time == partition.runner_up_time[node]);
+        if (!current)
+        {
+            continue;
+        }
+
+        for (int e = offsets[node]; e < offsets[node + 1]; e++)
+        {
+            offer(targets[e], source, time + weights[e]);
+        }
+    }
+
+    return partition;
+}
+
+DijkstraResult run_dijkstra_for_centre(const Graph &graph, const Centre &centre)
 {
     DijkstraResult result;
     result.centre_id = centre.centre_id;
@@ -401,7 +775,7 @@ DijkstraResult run_dijkstra_for_centre(const Centre &centre)
     try
     {
         const auto start_time = std::chrono::high_resolution_clock::now();
-        auto result_pair = dijkstra_with_parents(centre.snapped_node_id);
+        auto result_pair = dijkstra_with_parents(graph, centre.snapped_node_id);
         const auto end_time = std::chrono::high_resolution_clock::now();
 
         result.computation_time_ms =
@@ -1,22 +1,273 @@
 #include "route_finder/state.hpp"
 
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <iostream>
+#include <map>
+
+#include "route_finder/snapshot_io.hpp"
+
 namespace route_finder
 {
+namespace
+{
 
-Graph graph;
-std::unordered_map<long, Node> nodes;
-KDTreeNode *kdtree_root = nullptr;
-std::unordered_map<long, std::unordered_map<std::string, double>> allotment_lookup_map;
-std::vector<Centre> centres;
-std::vector<Student> students;
-std::unordered_map<std::string, std::string> final_assignments;
-std::unordered_map<long, int> node_component;
+using Clock = std::chrono::steady_clock;
+
+constexpr const char *kSnapshotDirectory = "graph_snapshots";
+constexpr size_t kDefaultMemoryBudget = size_t{1024} * 1024 * 1024;
 
-void reset_kdtree()
+struct GraphSession
 {
-    kdtree_root = nullptr;
+    // Null while evicted; the image on disk is then the only copy.
+    std::shared_ptr<const GraphSnapshot> snapshot;
+    // Bumped on every publish; the disk image is current when it matches.
+    std::uint64_t generation = 0;
+    std::uint64_t saved_generation = 0;
+    bool saving = false;
+    size_t disk_bytes = 0;
+    Clock::time_point last_used;
+    // Serialises reloads of this session without blocking the others.
+    std::shared_ptr<std::mutex> load_mutex = std::make_shared<std::mutex>();
+    // Kept for listing while the snapshot is evicted.
+    GraphSessionInfo facts;
+};
+
+std::mutex sessions_mutex;
+std::map<std::string, GraphSession> sessions;
+size_t memory_budget = kDefaultMemoryBudget;
+
+const std::shared_ptr<const GraphSnapshot> &empty_snapshot()
+{
+    static const std::shared_ptr<const GraphSnapshot> empty = std::make_shared<const GraphSnapshot>();
+    return empty;
 }
 
-} // namespace route_finder
+std::string snapshot_path(const std::string &graph_id)
+{
+    return std::string(kSnapshotDirectory) + "/" + graph_id + ".snapshot";
+}
+
+// Walks the whole snapshot, so callers run it before taking sessions_mutex.
+GraphSessionInfo describe(const GraphSnapshot &snapshot)
+{
+    GraphSessionInfo facts;
+    facts.memory_bytes = snapshot_memory_bytes(snapshot);
+    facts.nodes = snapshot.nodes.size();
+    facts.edges = snapshot.dense_graph.targets.size();
+    facts.centres = snapshot.centres.size();
+    facts.detail = snapshot.full_graph_detail;
+    return facts;
+}
+
+// Evicts least recently used sessions (never `keep`) until the resident ones
+// fit the budget. Images are written outside the lock; readers still holding
+// an evicted snapshot keep it alive until they finish.
+void enforce_memory_budget(const std::string &keep)
+{
+    while (true)
+    {
+        std::string victim_id;
+        std::shared_ptr<const GraphSnapshot> victim;
+        std::uint64_t generation = 0;
+        bool needs_save = false;
+        {
+            std::lock_guard<std::mutex> lock(sessions_mutex);
+            size_t resident = 0;
+            for (const auto &entry : sessions)
+            {
+                if (entry.second.snapshot)
+                {
+                    resident += entry.second.facts.memory_bytes;
+                }
+            }
+            if (resident <= memory_budget)
+            {
+                return;
+            }
+
+            GraphSession *oldest = nullptr;
+            for (auto &[graph_id, session] : sessions)
+            {
+                if (graph_id == keep || !session.snapshot || session.saving)
+                {
+                    continue;
+                }
+                if (!oldest || session.last_used < oldest->last_used)
+                {
+                    oldest = &session;
+                    victim_id = graph_id;
+                }
+            }
+            if (!oldest)
+            {
+                return;
+            }
+
+            oldest->saving = true;
+            victim = oldest->snapshot;
+            generation = oldest->generation;
+            needs_save = oldest->saved_generation != generation;
+        }
+
+        const bool saved = !needs_save || save_graph_snapshot(*victim, snapshot_path(victim_id));
+
+        std::lock_guard<std::mutex> lock(sessions_mutex);
+        GraphSession &session = sessions[victim_id];
+        session.saving = false;
+        if (!saved)
+        {
+            std::cerr << "Could not evict graph '" << victim_id << "'; keeping it in memory." << std::endl;
+            return;
+        }
+        if (session.generation == generation)
+        {
+            session.saved_generation = generation;
+            std::error_code error;
+            const auto file_bytes = std::filesystem::file_size(snapshot_path(victim_id), error);
+            session.disk_bytes = error ? 0 : static_cast<size_t>(file_bytes);
+            session.snapshot.reset();
+            std::cout << "Evicted graph '" << victim_id << "' (" << session.facts.memory_bytes / (1024 * 1024)
+                      << " MB) to " << snapshot_path(victim_id) << std::endl;
+        }
+    }
+}
+
+} // namespace
+
+bool valid_graph_id(const std::string &graph_id)
+{
+    if (graph_id.empty() || graph_id.size() > 64)
+    {
+        return false;
+    }
+    return std::all_of(graph_id.begin(), graph_id.end(), [](char c)
+                       { return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '-' || c == '_'; });
+}
+
+bool has_graph_session(const std::string &graph_id)
+{
+    std::lock_guard<std::mutex> lock(sessions_mutex);
+    return sessions.count(graph_id) > 0;
+}
+
+std::shared_ptr<const GraphSnapshot> current_snapshot(const std::string &graph_id)
+{
+    std::shared_ptr<std::mutex> load_mutex;
+    {
+        std::lock_guard<std::mutex> lock(sessions_mutex);
+        const auto it = sessions.find(graph_id);
+        if (it == sessions.end())
+        {
+            return empty_snapshot();
+        }
+        it->second.last_used = Clock::now();
+        if (it->second.snapshot)
+        {
+            return it->second.snapshot;
+        }
+        load_mutex = it->second.load_mutex;
+    }
+
+    std::lock_guard<std::mutex> load_lock(*load_mutex);
+    std::uint64_t generation = 0;
+    {
+        std::lock_guard<std::mutex> lock(sessions_mutex);
+        GraphSession &session = sessions[graph_id];
+        if (session.snapshot)
+        {
+            return session.snapshot;
+        }
+        generation = session.generation;
+    }
+
+    const auto start = Clock::now();
+    std::shared_ptr<const GraphSnapshot> loaded = load_graph_snapshot(snapshot_path(graph_id));
+    if (!loaded)
+    {
+        return empty_snapshot();
+    }
+    const GraphSessionInfo facts = describe(*loaded);
+    std::cout << "Reloaded graph '" << graph_id << "' from disk in "
+              << std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - start).count()
+              << " ms." << std::endl;
+
+    {
+        std::lock_guard<std::mutex> lock(sessions_mutex);
+        GraphSession &session = sessions[graph_id];
+        if (session.generation != generation || session.snapshot)
+        {
+            // Rebuilt while we were reading the old image.
+            return session.snapshot ? session.snapshot : empty_snapshot();
+        }
+        session.snapshot = loaded;
+        session.facts = facts;
+        session.last_used = Clock::now();
+    }
+    enforce_memory_budget(graph_id);
+    return loaded;
+}
+
+void publish_snapshot(std::shared_ptr<const GraphSnapshot> snapshot, const std::string &graph_id)
+{
+    const GraphSessionInfo facts = describe(*snapshot);
+    {
+        std::lock_guard<std::mutex> lock(sessions_mutex);
+        GraphSession &session = sessions[graph_id];
+        session.facts = facts;
+        session.snapshot = std::move(snapshot);
+        session.generation++;
+        session.last_used = Clock::now();
+    }
+    enforce_memory_budget(graph_id);
+}
 
+std::vector<GraphSessionInfo> list_graph_sessions()
+{
+    std::lock_guard<std::mutex> lock(sessions_mutex);
+    const auto now = Clock::now();
+    std::vector<GraphSessionInfo> list;
+    for (const auto &[graph_id, session] : sessions)
+    {
+        GraphSessionInfo info = session.facts;
+        info.graph_id = graph_id;
+        info.resident = static_cast<bool>(session.snapshot);
+        info.on_disk = session.saved_generation == session.generation;
+        info.disk_bytes = info.on_disk ? session.disk_bytes : 0;
+        info.idle_sec = std::chrono::duration<double>(now - session.last_used).count();
+        list.push_back(info);
+    }
+    return list;
+}
 
+size_t graph_memory_budget()
+{
+    std::lock_guard<std::mutex> lock(sessions_mutex);
+    return memory_budget;
+}
+
+void set_graph_memory_budget(size_t bytes)
+{
+    {
+        std::lock_guard<std::mutex> lock(sessions_mutex);
+        memory_budget = bytes;
+    }
+    enforce_memory_budget("");
+}
+
+std::mutex allotment_mutex;
+std::string allotment_graph_id = kDefaultGraphId;
+std::uint64_t allotment_revision = 0;
+std::uint64_t allotment_build_id = 0;
+std::vector<Centre> centres;
+std::vector<Student> students;
+std::unordered_map<std::string, std::string> final_assignments;
+std::vector<int> student_assignment;
+std::unordered_map<std::string, int> student_index;
+EligibilityRules eligibility_rules;
+AllotmentQuality allotment_quality;
+AllotmentRoster allotment_roster;
+
+} // namespace route_finder
@@ -20,8 +20,15 @@
 #include "httplib.h"
 #include "json_single.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <cctype>
 #include <chrono>
 #include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
 #include <ctime>
 #include <fstream>
 #include <future>
@@ -29,9 +36,13 @@
 #include <iostream>
 #include <limits>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <set>
 #include <sstream>
 #include <string>
+#include <string_view>
+#include <thread>
 #include <unordered_map>
 #include <utility>
 #include <vector>
@@ -41,7 +52,10 @@
 #include "route_finder/graph.hpp"
 #include "route_finder/kdtree.hpp"
 #include "route_finder/overpass.hpp"
+#include "route_finder/parallel.hpp"
+#include "route_finder/placement.hpp"
 #include "route_finder/routing.hpp"
+#include "route_finder/snapshot_io.hpp"
 #include "route_finder/state.hpp"
 #include "route_finder/types.hpp"
 
@@ -54,7 +68,7 @@ namespace route_finder
 
         constexpr const char *CACHE_FILE_NAME = "osm_cache.json";
 
-        // Global diagnostic tracking variables
+        // Diagnostic tracking, per graph session like g_graph_stats
         struct DiagnosticTimings
         {
             long long fetch_overpass_ms = 0;
@@ -64,7 +78,9 @@ namespace route_finder
             long long dijkstra_precompute_ms = 0;
             long long snap_students_ms = 0;
             long long allotment_ms = 0;
-        } g_timings;
+        };
+
+        std::map<std::string, DiagnosticTimings> g_timings;
 
         struct GraphStats
         {
@@ -75,65 +91,236 @@ namespace route_finder
             int component_count = 0;
             int main_component_id = -1;
             int main_component_nodes = 0;
-        } g_graph_stats;
+        };
+
+        // Per graph session; diagnostics report the one the allotment ran on.
+        std::map<std::string, GraphStats> g_graph_stats;
+
+        // One build at a time: a second /build-graph waits, then starts from
+        // whatever the first one published (and can reuse its full graph).
+        std::mutex g_build_mutex;
+        // Last GraphSnapshot::build_id handed out; guarded by g_build_mutex.
+        std::uint64_t g_build_count = 0;
+
+        // A /build-graph run on its own thread. Every stage change is appended
+        // to `events`, which /jobs/<id>/events replays and then follows, so a
+        // subscriber that connects late still sees the whole build.
+        struct BuildJob
+        {
+            std::string job_id;
+            std::string graph_id;
+            std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+            std::atomic<bool> cancel_requested{false};
+
+            std::mutex mutex;
+            std::condition_variable changed;
+            std::vector<json> events;
+            std::string state = "queued"; // queued, running, succeeded, failed, cancelled
+            std::string stage = "queued";
+            int percent = 0;
+            long long stage_started_ms = 0;
+            json result;
+
+            bool finished() const
+            {
+                return state == "succeeded" || state == "failed" || state == "cancelled";
+            }
+        };
+
+        class BuildCancelled : public std::runtime_error
+        {
+        public:
+            BuildCancelled() : std::runtime_error("Build cancelled.") {}
+        };
+
+        constexpr size_t kFinishedJobsKept = 32;
+
+        std::mutex g_jobs_mutex;
+        std::map<std::string, std::shared_ptr<BuildJob>> g_jobs;
+        int g_next_job_id = 1;
+
+        long long job_elapsed_ms(const BuildJob &job)
+        {
+            return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - job.started).count();
+        }
+
+        // Caller holds job.mutex.
+        json job_status_json(const BuildJob &job)
+        {
+            json status = {
+                {"job_id", job.job_id},
+                {"graph_id", job.graph_id},
+                {"state", job.state},
+                {"stage", job.stage},
+                {"percent", job.percent},
+                {"elapsed_ms", job_elapsed_ms(job)}};
+            if (job.state == "succeeded")
+            {
+                status["result"] = job.result;
+            }
+            else if (job.finished())
+            {
+                status["message"] = job.result.value("message", "");
+            }
+            return status;
+        }
+
+        // Caller holds job.mutex. `stage_ms` is how long the previous stage took.
+        void push_job_event(BuildJob &job, const std::string &type)
+        {
+            const long long now_ms = job_elapsed_ms(job);
+            json event = job_status_json(job);
+            event["type"] = type;
+            event["stage_ms"] = now_ms - job.stage_started_ms;
+            job.stage_started_ms = now_ms;
+            job.events.push_back(std::move(event));
+            job.changed.notify_all();
+        }
 
-        void build_kdtree_for_graph()
+        // Stage boundary of the build pipeline: honours a pending cancel, then
+        // publishes a progress event. A no-op for the blocking /build-graph.
+        void report_build_stage(BuildJob *job, const std::string &stage, int percent)
         {
-            std::cout << "Building KD-tree for " << nodes.size() << " nodes..." << std::endl;
+            if (!job)
+            {
+                return;
+            }
+            if (job->cancel_requested)
+            {
+                throw BuildCancelled();
+            }
+            std::lock_guard<std::mutex> lock(job->mutex);
+            job->state = "running";
+            job->stage = stage;
+            job->percent = percent;
+            push_job_event(*job, "progress");
+        }
 
-            std::vector<std::pair<long, std::pair<double, double>>> node_points;
-            node_points.reserve(nodes.size());
+        std::shared_ptr<BuildJob> find_job(const std::string &job_id)
+        {
+            std::lock_guard<std::mutex> lock(g_jobs_mutex);
+            const auto it = g_jobs.find(job_id);
+            return it != g_jobs.end() ? it->second : nullptr;
+        }
 
-            for (const auto &[node_id, node] : nodes)
+        // Forgets the oldest finished jobs beyond kFinishedJobsKept. Caller holds g_jobs_mutex.
+        void prune_finished_jobs()
+        {
+            std::vector<std::pair<std::chrono::steady_clock::time_point, std::string>> finished;
+            for (const auto &[job_id, job] : g_jobs)
             {
-                if (graph.find(node_id) != graph.end() && !graph[node_id].empty())
+                std::lock_guard<std::mutex> lock(job->mutex);
+                if (job->finished())
                 {
-                    node_points.push_back({node_id, {node.lat, node.lon}});
+                    finished.push_back({job->started, job_id});
                 }
             }
+            if (finished.size() <= kFinishedJobsKept)
+            {
+                return;
+            }
+            std::sort(finished.begin(), finished.end());
+            for (size_t i = 0; i + kFinishedJobsKept < finished.size(); i++)
+            {
+                g_jobs.erase(finished[i].second);
+            }
+        }
 
-            std::cout << "KD-tree will be built from " << node_points.size() << " connected nodes." << std::endl;
-
-            reset_kdtree();
-            kdtree_root = build_kdtree(node_points, 0);
+        bool same_bounds(double a_min_lat, double a_min_lon, double a_max_lat, double a_max_lon,
+                         double b_min_lat, double b_min_lon, double b_max_lat, double b_max_lon)
+        {
+            const double tolerance = 0.0001;
+            return std::abs(a_min_lat - b_min_lat) < tolerance &&
+                   std::abs(a_min_lon - b_min_lon) < tolerance &&
+                   std::abs(a_max_lat - b_max_lat) < tolerance &&
+                   std::abs(a_max_lon - b_max_lon) < tolerance;
         }
 
-        void snap_centres_to_graph()
+        void snap_centres_to_graph(GraphSnapshot &draft)
         {
-            for (auto &centre : centres)
+            for (auto &centre : draft.centres)
             {
-                centre.snapped_node_id = find_nearest_in_main_component(centre.lat, centre.lon);
+                centre.snapped_node_id = find_nearest_in_main_component(draft, centre.lat, centre.lon);
                 std::cout << "Centre " << centre.centre_id << " snapped to node " << centre.snapped_node_id;
-                if (node_component.count(centre.snapped_node_id))
+                if (draft.node_component.count(centre.snapped_node_id))
                 {
-                    std::cout << " (component " << node_component[centre.snapped_node_id] << ")";
+                    std::cout << " (component " << draft.node_component_of(centre.snapped_node_id) << ")";
                 }
                 std::cout << std::endl;
             }
         }
 
-        void snap_students_to_graph(json const &students_json)
+        // Snaps a point to the road network, moving it onto the main component
+        // when its nearest node is cut off. Returns -1 when nothing fits.
+        long snap_to_main_component(const GraphSnapshot &snapshot, double lat, double lon, bool &rescued)
         {
-            std::cout << "\n⚡ Snapping " << students_json.size() << " students to road network..." << std::endl;
-            auto start = std::chrono::high_resolution_clock::now();
+            rescued = false;
+            long snapped_node_id = find_best_snap_node_fast(snapshot, lat, lon);
+            if (snapped_node_id != -1)
+            {
+                int comp_id = snapshot.node_component_of(snapped_node_id);
+
+                // --- 3. THE FIX: Check if not on the mainland ---
+                if (comp_id != snapshot.main_component_id)
+                {
+                    snapped_node_id = find_nearest_in_main_component(snapshot, lat, lon);
+                    rescued = snapped_node_id != -1;
+                }
+            }
+            return snapped_node_id;
+        }
+
+        Student student_from_json(const GraphSnapshot &snapshot, const json &s)
+        {
+            Student student;
+            student.student_id = s.value("student_id", "");
+            student.lat = s.value("lat", 0.0);
+            student.lon = s.value("lon", 0.0);
+            student.category = s.value("category", "male");
+            bool rescued = false;
+            student.snapped_node_id = snap_to_main_component(snapshot, student.lat, student.lon, rescued);
+            return student;
+        }
 
-            std::unordered_map<int, int> comp_count;
-            for (auto &p : node_component)
+        // Optional {"pwd_requires_wheelchair_access", "female_only_centres"}
+        // object; absent keys keep the defaults (both rules on).
+        EligibilityRules rules_from_json(const json &body)
+        {
+            EligibilityRules rules;
+            if (body.contains("rules") && body["rules"].is_object())
             {
-                if (p.second > 0)
-                    comp_count[p.second]++;
+                const json &r = body["rules"];
+                rules.pwd_requires_wheelchair_access = r.value("pwd_requires_wheelchair_access", rules.pwd_requires_wheelchair_access);
+                rules.female_only_centres = r.value("female_only_centres", rules.female_only_centres);
             }
-            int main_comp_id = -1;
-            int max_comp_size = 0;
-            for (auto &q : comp_count)
+            return rules;
+        }
+
+        bool solver_from_name(const std::string &name, AllotmentSolver &solver)
+        {
+            static const std::pair<const char *, AllotmentSolver> kSolvers[] = {
+                {"greedy", AllotmentSolver::Greedy},
+                {"min_cost_flow", AllotmentSolver::MinCostFlow},
+                {"auction", AllotmentSolver::Auction},
+                {"bottleneck", AllotmentSolver::Bottleneck}};
+            for (const auto &entry : kSolvers)
             {
-                if (q.second > max_comp_size)
+                if (name == entry.first)
                 {
-                    max_comp_size = q.second;
-                    main_comp_id = q.first;
+                    solver = entry.second;
+                    return true;
                 }
             }
-            std::cout << "   Main component ID is " << main_comp_id << " with " << max_comp_size << " nodes." << std::endl;
+            return false;
+        }
+
+        void snap_students_to_graph(const GraphSnapshot &snapshot, json const &students_json)
+        {
+            std::cout << "\n⚡ Snapping " << students_json.size() << " students to road network..." << std::endl;
+            auto start = std::chrono::high_resolution_clock::now();
+
+            const int main_comp_id = snapshot.main_component_id;
+            std::cout << "   Main component ID is " << main_comp_id << "." << std::endl;
 
             students.clear();
             students.reserve(students_json.size());
@@ -148,26 +335,12 @@ namespace route_finder
                 student.lat = s.value("lat", 0.0);
                 student.lon = s.value("lon", 0.0);
                 student.category = s.value("category", "male");
-                student.snapped_node_id = find_best_snap_node_fast(student.lat, student.lon);
 
-                if (student.snapped_node_id != -1)
+                bool was_rescued = false;
+                student.snapped_node_id = snap_to_main_component(snapshot, student.lat, student.lon, was_rescued);
+                if (was_rescued)
                 {
-                    int comp_id = node_component.count(student.snapped_node_id) ? node_component[student.snapped_node_id] : -1;
-
-                    // --- 3. THE FIX: Check if not on the mainland ---
-                    if (comp_id != main_comp_id)
-                    {
-                        long alt_node = find_nearest_in_main_component(student.lat, student.lon);
-                        if (alt_node != -1)
-                        {
-                            student.snapped_node_id = alt_node;
-                            rescued++;
-                        }
-                        else
-                        {
-                            student.snapped_node_id = -1;
-                        }
-                    }
+                    rescued++;
                 }
 
                 if (student.snapped_node_id == -1)
@@ -186,277 +359,1636 @@ namespace route_finder
             std::cout << "✅ Snapping complete: " << snapped << " snapped, " << rescued << " rescued, " << failed << " failed in " << ms << "ms" << std::endl;
         }
 
-        json build_debug_distances_payload()
+        // Student bodies /run-allotment accepts, chosen by Content-Type. JSON is
+        // parsed whole; NDJSON (one student object per line) and CSV (a header
+        // row naming student_id, lat, lon and optionally category) are read
+        // and snapped as they arrive.
+        enum class StudentUploadFormat
         {
-            json distances_json = json::object();
-            for (const auto &student : students)
+            Json,
+            Ndjson,
+            Csv
+        };
+
+        StudentUploadFormat student_upload_format(const httplib::Request &req)
+        {
+            const std::string content_type = req.get_header_value("Content-Type");
+            if (content_type.find("ndjson") != std::string::npos || content_type.find("jsonl") != std::string::npos)
             {
-                if (allotment_lookup_map.find(student.snapped_node_id) != allotment_lookup_map.end())
+                return StudentUploadFormat::Ndjson;
+            }
+            if (content_type.find("text/csv") != std::string::npos)
+            {
+                return StudentUploadFormat::Csv;
+            }
+            return StudentUploadFormat::Json;
+        }
+
+        // A streamed upload has no JSON envelope, so its /run-allotment options
+        // come from the query string, under the same names as the body keys.
+        json allotment_options_from_query(const httplib::Request &req)
+        {
+            json options = json::object();
+            for (const char *key : {"graph_id", "solver", "candidates", "prepass"})
+            {
+                if (req.has_param(key))
                 {
-                    distances_json[student.student_id] = allotment_lookup_map[student.snapped_node_id];
+                    options[key] = req.get_param_value(key);
                 }
-                else
+            }
+            if (req.has_param("auction_epsilon"))
+            {
+                options["auction_epsilon"] = std::stod(req.get_param_value("auction_epsilon"));
+            }
+            if (req.has_param("threads"))
+            {
+                options["threads"] = static_cast<unsigned>(std::stoul(req.get_param_value("threads")));
+            }
+            if (req.has_param("debug_top_k"))
+            {
+                options["debug_distances"]["top_k"] = static_cast<size_t>(std::stoul(req.get_param_value("debug_top_k")));
+            }
+            else if (req.has_param("debug_distances"))
+            {
+                const std::string value = req.get_param_value("debug_distances");
+                options["debug_distances"] = value != "0" && value != "false";
+            }
+            for (const char *key : {"pwd_requires_wheelchair_access", "female_only_centres"})
+            {
+                if (req.has_param(key))
                 {
-                    distances_json[student.student_id] = json::object();
+                    const std::string value = req.get_param_value(key);
+                    options["rules"][key] = value != "0" && value != "false";
                 }
             }
-            return distances_json;
+            return options;
         }
 
-        json collect_diagnostics()
+        // Turns a streamed NDJSON or CSV upload into snapped students. Records
+        // are parsed straight out of each received chunk (only a line split
+        // across two chunks is copied) into fixed-size batches; a full batch
+        // is snapped on a worker while the next one is received and parsed,
+        // so the upload itself is never held in memory.
+        class StudentStreamLoader
         {
-            json diagnostic_report;
+        public:
+            static constexpr size_t kBatchSize = 16384;
 
-            const auto now = std::chrono::system_clock::now();
-            const std::time_t now_time = std::chrono::system_clock::to_time_t(now);
-            char timestamp[64];
-            std::strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now_time));
+            StudentStreamLoader(const GraphSnapshot &snapshot, StudentUploadFormat format)
+                : snapshot_(snapshot), csv_(format == StudentUploadFormat::Csv)
+            {
+                batch_.reserve(kBatchSize);
+            }
 
-            diagnostic_report["metadata"] = {
-                {"run_id", std::string("run_") + timestamp},
-                {"timestamp", timestamp},
-                {"city", "Unnamed"},
-                {"num_students", students.size()},
-                {"num_centres", centres.size()},
-                {"capacity_per_centre", centres.empty() ? 0 : centres.front().max_capacity},
-                {"notes", "Detailed diagnostic export"}};
+            ~StudentStreamLoader()
+            {
+                if (worker_.valid())
+                {
+                    worker_.wait();
+                }
+            }
 
-            std::unordered_map<std::string, int> centre_assignment_count;
-            for (const auto &centre : centres)
+            StudentStreamLoader(const StudentStreamLoader &) = delete;
+            StudentStreamLoader &operator=(const StudentStreamLoader &) = delete;
+
+            // Content receiver; returning false on a malformed record stops the upload.
+            bool feed(const char *data, size_t length)
             {
-                centre_assignment_count[centre.centre_id] = 0;
+                const char *cursor = data;
+                const char *end = data + length;
+                if (!partial_.empty())
+                {
+                    const char *newline = static_cast<const char *>(std::memchr(cursor, '\n', end - cursor));
+                    if (!newline)
+                    {
+                        partial_.append(cursor, end);
+                        return true;
+                    }
+                    partial_.append(cursor, newline);
+                    cursor = newline + 1;
+                    const bool parsed = parse_line(partial_.data(), partial_.data() + partial_.size());
+                    partial_.clear();
+                    if (!parsed)
+                    {
+                        return false;
+                    }
+                }
+                while (cursor < end)
+                {
+                    const char *newline = static_cast<const char *>(std::memchr(cursor, '\n', end - cursor));
+                    if (!newline)
+                    {
+                        partial_.assign(cursor, end);
+                        break;
+                    }
+                    if (!parse_line(cursor, newline))
+                    {
+                        return false;
+                    }
+                    cursor = newline + 1;
+                }
+                return true;
             }
-            for (const auto &[student_id, centre_id] : final_assignments)
+
+            // Parses an unterminated last line and snaps the final batch.
+            bool finish()
             {
-                centre_assignment_count[centre_id]++;
+                if (!partial_.empty())
+                {
+                    const bool parsed = parse_line(partial_.data(), partial_.data() + partial_.size());
+                    partial_.clear();
+                    if (!parsed)
+                    {
+                        return false;
+                    }
+                }
+                flush_batch();
+                collect();
+                return true;
             }
 
-            json centres_json = json::array();
-            for (const auto &centre : centres)
+            std::vector<Student> take_students() { return std::move(students_); }
+            const std::string &error() const { return error_; }
+            size_t rescued() const { return rescued_; }
+            size_t failed() const { return failed_; }
+            size_t batches() const { return batches_; }
+
+        private:
+            bool fail(const std::string &message)
             {
-                centres_json.push_back({{"centre_id", centre.centre_id},
-                                        {"lat", centre.lat},
-                                        {"lon", centre.lon},
-                                        {"graph_node_id", centre.snapped_node_id},
-                                        {"assigned_students", centre_assignment_count[centre.centre_id]}});
+                error_ = "Line " + std::to_string(line_) + ": " + message;
+                return false;
             }
-            diagnostic_report["centres"] = centres_json;
 
-            json students_json = json::array();
-            int unreachable_count = 0;
-            int large_snap_count = 0;
-            double snap_distance_sum = 0.0;
-            int snap_count = 0;
+            bool parse_line(const char *begin, const char *end)
+            {
+                line_++;
+                while (begin < end && std::isspace(static_cast<unsigned char>(*begin)))
+                {
+                    begin++;
+                }
+                while (end > begin && std::isspace(static_cast<unsigned char>(end[-1])))
+                {
+                    end--;
+                }
+                if (begin == end)
+                {
+                    return true;
+                }
 
-            for (const auto &student : students)
+                Student student;
+                if (csv_)
+                {
+                    split_csv(begin, end);
+                    if (lat_column_ < 0)
+                    {
+                        return parse_csv_header();
+                    }
+                    if (!parse_csv_record(student))
+                    {
+                        return false;
+                    }
+                }
+                else if (!parse_ndjson_record(begin, end, student))
+                {
+                    return false;
+                }
+
+                batch_.push_back(std::move(student));
+                if (batch_.size() >= kBatchSize)
+                {
+                    flush_batch();
+                }
+                return true;
+            }
+
+            // Reads one NDJSON record without building a DOM for it. Only the
+            // top-level student fields are kept; anything else is skipped.
+            class StudentRecordReader : public nlohmann::json_sax<json>
             {
-                json student_json;
-                student_json["student_id"] = student.student_id;
-                student_json["lat"] = student.lat;
-                student_json["lon"] = student.lon;
-                student_json["category"] = student.category;
-                student_json["snap_node_id"] = student.snapped_node_id;
+            public:
+                explicit StudentRecordReader(Student &student) : student_(student) {}
 
-                double snap_distance = -1.0;
-                if (nodes.find(student.snapped_node_id) != nodes.end())
+                bool null() override { return value_is("null"); }
+                bool boolean(bool) override { return value_is("boolean"); }
+                bool number_integer(number_integer_t value) override { return number(static_cast<double>(value)); }
+                bool number_unsigned(number_unsigned_t value) override { return number(static_cast<double>(value)); }
+                bool number_float(number_float_t value, const string_t &) override { return number(value); }
+                bool binary(binary_t &) override { return value_is("binary"); }
+
+                bool string(string_t &value) override
                 {
-                    const auto &snapped_node = nodes[student.snapped_node_id];
-                    snap_distance = haversine(student.lat, student.lon, snapped_node.lat, snapped_node.lon);
-                    snap_distance_sum += snap_distance;
-                    snap_count++;
-                    if (snap_distance > 100.0)
+                    if (depth_ == 1 && (key_ == "student_id" || key_ == "category"))
                     {
-                        large_snap_count++;
+                        (key_ == "student_id" ? student_.student_id : student_.category) = std::move(value);
+                        return true;
                     }
+                    return value_is("string");
                 }
-                student_json["snap_distance_m"] = snap_distance;
 
-                const bool assigned = final_assignments.find(student.student_id) != final_assignments.end();
-                if (!assigned)
+                bool start_object(std::size_t) override
                 {
-                    unreachable_count++;
+                    if (depth_ == 0 && seen_record_)
+                    {
+                        return reject("expected one JSON object per line.");
+                    }
+                    seen_record_ = true;
+                    depth_++;
+                    return true;
                 }
-                student_json["assigned_centre_id"] = assigned ? json(final_assignments[student.student_id]) : json();
 
-                std::map<std::string, double> alternative_costs;
-                int reachable_centres = 0;
-                double best_distance = std::numeric_limits<double>::max();
-                double second_best = std::numeric_limits<double>::max();
+                bool end_object() override
+                {
+                    depth_--;
+                    return true;
+                }
 
-                for (const auto &centre : centres)
+                bool start_array(std::size_t) override
                 {
-                    double distance = std::numeric_limits<double>::max();
-                    const auto lookup_it = allotment_lookup_map.find(student.snapped_node_id);
-                    if (lookup_it != allotment_lookup_map.end())
+                    if (depth_ == 0)
                     {
-                        const auto entry_it = lookup_it->second.find(centre.centre_id);
-                        if (entry_it != lookup_it->second.end())
-                        {
-                            distance = entry_it->second;
-                        }
+                        return reject("expected one JSON object per line.");
                     }
+                    depth_++;
+                    return true;
+                }
+
+                bool end_array() override
+                {
+                    depth_--;
+                    return true;
+                }
 
-                    alternative_costs[centre.centre_id] = distance;
-                    if (distance < std::numeric_limits<double>::max())
+                bool key(string_t &name) override
+                {
+                    if (depth_ == 1)
                     {
-                        reachable_centres++;
-                        if (distance < best_distance)
-                        {
-                            second_best = best_distance;
-                            best_distance = distance;
-                        }
-                        else if (distance < second_best)
-                        {
-                            second_best = distance;
-                        }
+                        key_ = std::move(name);
                     }
+                    return true;
                 }
 
-                student_json["alt_distances_m"] = alternative_costs;
-                student_json["component_id"] = node_component.count(student.snapped_node_id) ? node_component[student.snapped_node_id] : -1;
-                student_json["reachable_count"] = reachable_centres;
-                student_json["near_tie"] = (second_best < std::numeric_limits<double>::max() && std::abs(second_best - best_distance) < 20.0);
+                bool parse_error(std::size_t, const std::string &, const nlohmann::detail::exception &) override
+                {
+                    return reject("expected one JSON object per line.");
+                }
 
-                students_json.push_back(student_json);
-            }
+                const std::string &error() const { return error_; }
+
+            private:
+                bool number(double value)
+                {
+                    if (depth_ == 1 && (key_ == "lat" || key_ == "lon"))
+                    {
+                        (key_ == "lat" ? student_.lat : student_.lon) = value;
+                        return true;
+                    }
+                    return value_is("number");
+                }
 
-            diagnostic_report["students"] = students_json;
-            diagnostic_report["summary"] = {
-                {"unreachable_count", unreachable_count},
-                {"large_snap_count", large_snap_count},
-                {"avg_snap_distance_m", snap_count > 0 ? snap_distance_sum / snap_count : 0.0}};
+                // Scalars outside the student fields are ignored; a wrong type for
+                // one of them is an error, as with a JSON body.
+                bool value_is(const char *type)
+                {
+                    if (depth_ == 0)
+                    {
+                        return reject("expected one JSON object per line.");
+                    }
+                    if (depth_ == 1 && (key_ == "student_id" || key_ == "category" || key_ == "lat" || key_ == "lon"))
+                    {
+                        return reject("'" + key_ + "' cannot be a " + type + ".");
+                    }
+                    return true;
+                }
 
-            // Performance Summary
-            diagnostic_report["performance_summary"] = {
-                {"time_fetch_overpass_ms", g_timings.fetch_overpass_ms},
-                {"time_build_graph_ms", g_timings.build_graph_ms},
-                {"time_compute_components_ms", g_timings.compute_components_ms},
-                {"time_build_kdtree_ms", g_timings.build_kdtree_ms},
-                {"time_dijkstra_precompute_ms", g_timings.dijkstra_precompute_ms},
-                {"time_snap_students_ms", g_timings.snap_students_ms},
-                {"time_allotment_ms", g_timings.allotment_ms},
-                {"time_total_ms", g_timings.fetch_overpass_ms + g_timings.build_graph_ms +
-                                      g_timings.compute_components_ms + g_timings.build_kdtree_ms +
-                                      g_timings.dijkstra_precompute_ms + g_timings.snap_students_ms +
-                                      g_timings.allotment_ms}};
-
-            // Allotment Quality Report
-            int total_assigned = final_assignments.size();
-            int total_unassigned = students.size() - total_assigned;
-            double total_travel_time_sec = 0.0;
-            double max_travel_time_sec = 0.0;
-            int first_choice_count = 0;
-
-            // By-category stats
-            std::map<std::string, int> cat_total, cat_assigned;
-            std::map<std::string, double> cat_travel_sum;
+                bool reject(const std::string &message)
+                {
+                    if (error_.empty())
+                    {
+                        error_ = message;
+                    }
+                    return false;
+                }
 
-            for (const auto &student : students)
+                Student &student_;
+                std::string key_;
+                std::string error_;
+                int depth_ = 0;
+                bool seen_record_ = false;
+            };
+
+            // Same fields and defaults as the "students" array of a JSON body.
+            bool parse_ndjson_record(const char *begin, const char *end, Student &student)
             {
-                cat_total[student.category]++;
+                student.lat = 0.0;
+                student.lon = 0.0;
+                student.category = "male";
+                StudentRecordReader reader(student);
+                if (!json::sax_parse(begin, end, &reader))
+                {
+                    return fail(reader.error().empty() ? "expected one JSON object per line." : reader.error());
+                }
+                return true;
             }
 
-            for (const auto &student : students)
+            // Fields may be wrapped in double quotes but cannot contain commas.
+            void split_csv(const char *begin, const char *end)
             {
-                const auto it = final_assignments.find(student.student_id);
-                if (it != final_assignments.end())
+                fields_.clear();
+                while (true)
                 {
-                    const std::string &assigned_centre_id = it->second;
-                    cat_assigned[student.category]++;
-
-                    // Get travel time
-                    double travel_time_sec = 0.0;
-                    const auto lookup_it = allotment_lookup_map.find(student.snapped_node_id);
-                    if (lookup_it != allotment_lookup_map.end())
+                    const char *comma = std::find(begin, end, ',');
+                    const char *field_begin = begin;
+                    const char *field_end = comma;
+                    while (field_begin < field_end && std::isspace(static_cast<unsigned char>(*field_begin)))
                     {
-                        const auto entry_it = lookup_it->second.find(assigned_centre_id);
-                        if (entry_it != lookup_it->second.end())
-                        {
-                            travel_time_sec = entry_it->second;
-                        }
+                        field_begin++;
                     }
-
-                    total_travel_time_sec += travel_time_sec;
-                    cat_travel_sum[student.category] += travel_time_sec;
-                    if (travel_time_sec > max_travel_time_sec)
+                    while (field_end > field_begin && std::isspace(static_cast<unsigned char>(field_end[-1])))
+                    {
+                        field_end--;
+                    }
+                    if (field_end - field_begin >= 2 && *field_begin == '"' && field_end[-1] == '"')
+                    {
+                        field_begin++;
+                        field_end--;
+                    }
+                    fields_.emplace_back(field_begin, static_cast<size_t>(field_end - field_begin));
+                    if (comma == end)
                     {
-                        max_travel_time_sec = travel_time_sec;
+                        return;
                     }
+                    begin = comma + 1;
+                }
+            }
 
-                    // Check if first choice (minimum distance to any centre)
-                    double min_distance = std::numeric_limits<double>::max();
-                    for (const auto &centre : centres)
+            bool parse_csv_header()
+            {
+                for (int column = 0; column < static_cast<int>(fields_.size()); column++)
+                {
+                    const std::string_view name = fields_[column];
+                    if (name == "student_id")
                     {
-                        const auto lookup_it2 = allotment_lookup_map.find(student.snapped_node_id);
-                        if (lookup_it2 != allotment_lookup_map.end())
-                        {
-                            const auto entry_it2 = lookup_it2->second.find(centre.centre_id);
-                            if (entry_it2 != lookup_it2->second.end())
-                            {
-                                if (entry_it2->second < min_distance)
-                                {
-                                    min_distance = entry_it2->second;
-                                }
-                            }
-                        }
+                        id_column_ = column;
+                    }
+                    else if (name == "lat")
+                    {
+                        lat_column_ = column;
+                    }
+                    else if (name == "lon")
+                    {
+                        lon_column_ = column;
                     }
-                    if (travel_time_sec <= min_distance + 0.1) // tolerance for floating point
+                    else if (name == "category")
                     {
-                        first_choice_count++;
+                        category_column_ = column;
                     }
                 }
+                if (lat_column_ < 0 || lon_column_ < 0)
+                {
+                    lat_column_ = -1;
+                    return fail("the CSV header must name 'lat' and 'lon' columns.");
+                }
+                return true;
             }
 
-            json by_category = json::array();
-            for (const auto &[cat, total] : cat_total)
+            bool parse_csv_record(Student &student)
             {
-                int assigned = cat_assigned[cat];
-                double avg_travel = (assigned > 0) ? (cat_travel_sum[cat] / assigned) : 0.0;
-                by_category.push_back({{"category", cat},
-                                       {"total", total},
-                                       {"assigned", assigned},
-                                       {"unassigned", total - assigned},
-                                       {"avg_travel_time_sec", avg_travel}});
+                const auto field = [this](int column)
+                {
+                    return column >= 0 && column < static_cast<int>(fields_.size()) ? fields_[column] : std::string_view();
+                };
+                if (!parse_coordinate(field(lat_column_), student.lat) || !parse_coordinate(field(lon_column_), student.lon))
+                {
+                    return fail("'lat' and 'lon' must be numbers.");
+                }
+                student.student_id = std::string(field(id_column_));
+                const std::string_view category = field(category_column_);
+                student.category = category.empty() ? std::string("male") : std::string(category);
+                return true;
             }
 
-            diagnostic_report["allotment_quality_report"] = {
-                {"total_students", (int)students.size()},
-                {"total_assigned", total_assigned},
-                {"total_unassigned_final", total_unassigned},
-                {"total_travel_time_sec", total_travel_time_sec},
-                {"avg_travel_time_sec", total_assigned > 0 ? total_travel_time_sec / total_assigned : 0.0},
-                {"max_travel_time_sec", max_travel_time_sec},
-                {"first_choice_assignments", first_choice_count},
-                {"fallback_assignments", total_assigned - first_choice_count},
-                {"by_category", by_category}};
+            bool parse_coordinate(std::string_view text, double &value)
+            {
+                number_.assign(text.data(), text.size());
+                char *parsed_end = nullptr;
+                value = std::strtod(number_.c_str(), &parsed_end);
+                return !number_.empty() && parsed_end == number_.c_str() + number_.size();
+            }
 
-            // Graph Summary
-            diagnostic_report["graph_summary"] = {
-                {"graph_detail_setting", g_graph_stats.detail_setting},
-                {"nodes_count_total", g_graph_stats.nodes_total},
-                {"edges_count_directed", g_graph_stats.edges_directed},
-                {"oneway_edges_count", g_graph_stats.oneway_edges},
-                {"component_count", g_graph_stats.component_count},
-                {"main_component_id", g_graph_stats.main_component_id},
-                {"main_component_nodes", g_graph_stats.main_component_nodes},
-                {"isolated_nodes_count", g_graph_stats.nodes_total - g_graph_stats.main_component_nodes}};
+            // Hands the current batch to the worker once the previous one is done.
+            void flush_batch()
+            {
+                if (batch_.empty())
+                {
+                    return;
+                }
+                collect();
+                in_flight_ = std::move(batch_);
+                batch_.clear();
+                batch_.reserve(kBatchSize);
+                batches_++;
+                worker_ = std::async(std::launch::async, [this]()
+                                     { snap_batch(); });
+            }
 
-            return diagnostic_report;
-        }
+            void collect()
+            {
+                if (!worker_.valid())
+                {
+                    return;
+                }
+                worker_.get();
+                students_.insert(students_.end(), std::make_move_iterator(in_flight_.begin()), std::make_move_iterator(in_flight_.end()));
+                in_flight_.clear();
+            }
+
+            void snap_batch()
+            {
+                const unsigned workers = worker_count(in_flight_.size(), 2048);
+                std::vector<size_t> rescued(workers, 0);
+                std::vector<size_t> failed(workers, 0);
+                parallel_for_ranges(in_flight_.size(), workers, [&](unsigned worker, size_t begin, size_t end)
+                                    {
+                    for (size_t i = begin; i < end; i++)
+                    {
+                        Student &student = in_flight_[i];
+                        bool was_rescued = false;
+                        student.snapped_node_id = snap_to_main_component(snapshot_, student.lat, student.lon, was_rescued);
+                        rescued[worker] += was_rescued ? 1 : 0;
+                        failed[worker] += student.snapped_node_id == -1 ? 1 : 0;
+                    } });
+                for (unsigned worker = 0; worker < workers; worker++)
+                {
+                    rescued_ += rescued[worker];
+                    failed_ += failed[worker];
+                }
+            }
 
-        void ensure_graph_ready(httplib::Response &res)
+            const GraphSnapshot &snapshot_;
+            const bool csv_;
+            std::string partial_;
+            std::string number_;
+            std::vector<std::string_view> fields_;
+            int id_column_ = -1;
+            int lat_column_ = -1;
+            int lon_column_ = -1;
+            int category_column_ = -1;
+            std::vector<Student> batch_;
+            std::vector<Student> in_flight_;
+            std::vector<Student> students_;
+            std::future<void> worker_;
+            size_t line_ = 0;
+            size_t batches_ = 0;
+            size_t rescued_ = 0;
+            size_t failed_ = 0;
+            std::string error_;
+        };
+
+        // Travel time from a snapped node to centres[centre_index], or max() if unknown.
+        double lookup_travel_time(const GraphSnapshot &snapshot, long node_id, int centre_index)
         {
-            if (graph.empty() || nodes.empty())
+            if (centre_index < 0 || centre_index >= snapshot.distance_table.centre_count)
             {
-                json error;
-                error["status"] = "error";
-                error["message"] = "Graph not built. Call /build-graph first.";
-                res.set_content(error.dump(), "application/json");
+                return std::numeric_limits<double>::max();
             }
+            return snapshot.distance_table.at(centre_index, snapshot.dense_graph.index(node_id));
         }
 
-    } // namespace
-} // namespace route_finder
+        // Travel times from one student to every reachable centre, or only to
+        // the `top_k` nearest of them when top_k > 0.
+        json student_distances_json(const GraphSnapshot &snapshot, const Student &student, size_t top_k)
+        {
+            std::vector<std::pair<double, int>> reachable;
+            reachable.reserve(centres.size());
+            for (int c = 0; c < static_cast<int>(centres.size()); c++)
+            {
+                const double distance = lookup_travel_time(snapshot, student.snapped_node_id, c);
+                if (distance != std::numeric_limits<double>::max())
+                {
+                    reachable.emplace_back(distance, c);
+                }
+            }
+            if (top_k > 0 && top_k < reachable.size())
+            {
+                std::partial_sort(reachable.begin(), reachable.begin() + top_k, reachable.end());
+                reachable.resize(top_k);
+            }
+
+            json distances = json::object();
+            for (const auto &[distance, c] : reachable)
+            {
+                distances[centres[c].centre_id] = distance;
+            }
+            return distances;
+        }
+
+        json build_debug_distances_payload(const GraphSnapshot &snapshot, size_t top_k)
+        {
+            json distances_json = json::object();
+            for (const auto &student : students)
+            {
+                distances_json[student.student_id] = student_distances_json(snapshot, student, top_k);
+            }
+            return distances_json;
+        }
+
+        // /run-allotment leaves debug_distances out unless the body asks for
+        // them: `true` for every reachable centre, {"top_k": K} for the K
+        // nearest. GET /debug-distances pages through them instead.
+        bool debug_distances_requested(const json &body, size_t &top_k)
+        {
+            top_k = 0;
+            if (!body.contains("debug_distances"))
+            {
+                return false;
+            }
+            const json &option = body["debug_distances"];
+            if (option.is_object())
+            {
+                top_k = option.value("top_k", size_t{0});
+                return true;
+            }
+            return option.is_boolean() && option.get<bool>();
+        }
+
+        struct DebugDistanceFields
+        {
+            bool student_id = true;
+            bool assigned_centre = true;
+            bool distances = true;
+        };
+
+        bool debug_fields_from_param(const std::string &param, DebugDistanceFields &fields, std::string &unknown)
+        {
+            fields = DebugDistanceFields{false, false, false};
+            std::stringstream stream(param);
+            std::string name;
+            while (std::getline(stream, name, ','))
+            {
+                if (name == "student_id")
+                {
+                    fields.student_id = true;
+                }
+                else if (name == "assigned_centre")
+                {
+                    fields.assigned_centre = true;
+                }
+                else if (name == "distances")
+                {
+                    fields.distances = true;
+                }
+                else
+                {
+                    unknown = name;
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        json debug_distance_row(const GraphSnapshot &snapshot, size_t index, size_t top_k, const DebugDistanceFields &fields)
+        {
+            const Student &student = students[index];
+            json row = json::object();
+            if (fields.student_id)
+            {
+                row["student_id"] = student.student_id;
+            }
+            if (fields.assigned_centre)
+            {
+                const int centre = index < student_assignment.size() ? student_assignment[index] : -1;
+                row["assigned_centre"] = centre >= 0 ? json(centres[centre].centre_id) : json(nullptr);
+            }
+            if (fields.distances)
+            {
+                row["distances"] = student_distances_json(snapshot, student, top_k);
+            }
+            return row;
+        }
+
+        // Cursors name the allotment they were issued for, so a page request
+        // after /run-allotment or a delta is refused rather than skipping or
+        // repeating students. Caller holds allotment_mutex.
+        std::string debug_distances_cursor(size_t index)
+        {
+            return std::to_string(allotment_revision) + "." + std::to_string(index);
+        }
+
+        bool parse_debug_distances_cursor(const std::string &cursor, size_t &index)
+        {
+            const size_t dot = cursor.find('.');
+            if (dot == std::string::npos)
+            {
+                return false;
+            }
+            try
+            {
+                if (std::stoull(cursor.substr(0, dot)) != allotment_revision)
+                {
+                    return false;
+                }
+                index = static_cast<size_t>(std::stoull(cursor.substr(dot + 1)));
+            }
+            catch (const std::exception &)
+            {
+                return false;
+            }
+            return index <= students.size();
+        }
+
+        // Which parts of /export-diagnostics to write, and how.
+        struct DiagnosticsOptions
+        {
+            bool ndjson = false;
+            bool compact = false;
+            bool summary = true;
+            bool centres = true;
+            bool students = true;
+        };
+
+        // Everything in the report except the per-centre and per-student rows:
+        // metadata, summary, performance_summary, allotment_quality_report,
+        // graph_id and graph_summary. Small whatever the run size.
+        json diagnostics_summary_sections()
+        {
+            json sections;
+
+            const auto now = std::chrono::system_clock::now();
+            const std::time_t now_time = std::chrono::system_clock::to_time_t(now);
+            char timestamp[64];
+            std::strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now_time));
+
+            sections["metadata"] = {
+                {"run_id", std::string("run_") + timestamp},
+                {"timestamp", timestamp},
+                {"city", "Unnamed"},
+                {"num_students", students.size()},
+                {"num_centres", centres.size()},
+                {"capacity_per_centre", centres.empty() ? 0 : centres.front().max_capacity},
+                {"notes", "Detailed diagnostic export"}};
+
+            const AllotmentQuality &quality = allotment_quality;
+            sections["summary"] = {
+                {"unreachable_count", static_cast<int>(students.size()) - quality.assigned},
+                {"large_snap_count", quality.large_snaps},
+                {"avg_snap_distance_m", quality.snapped > 0 ? quality.snap_distance_sum / quality.snapped : 0.0}};
+
+            // Performance Summary
+            const DiagnosticTimings &timings = g_timings[allotment_graph_id];
+            sections["performance_summary"] = {
+                {"time_fetch_overpass_ms", timings.fetch_overpass_ms},
+                {"time_build_graph_ms", timings.build_graph_ms},
+                {"time_compute_components_ms", timings.compute_components_ms},
+                {"time_build_kdtree_ms", timings.build_kdtree_ms},
+                {"time_dijkstra_precompute_ms", timings.dijkstra_precompute_ms},
+                {"time_snap_students_ms", timings.snap_students_ms},
+                {"time_allotment_ms", timings.allotment_ms},
+                {"time_total_ms", timings.fetch_overpass_ms + timings.build_graph_ms +
+                                      timings.compute_components_ms + timings.build_kdtree_ms +
+                                      timings.dijkstra_precompute_ms + timings.snap_students_ms +
+                                      timings.allotment_ms}};
+
+            // Allotment Quality Report, read from the figures the engine maintains
+            json by_category = json::array();
+            for (const auto &[cat, figures] : quality.by_category)
+            {
+                by_category.push_back({{"category", cat},
+                                       {"total", figures.total},
+                                       {"assigned", figures.assigned},
+                                       {"unassigned", figures.total - figures.assigned},
+                                       {"avg_travel_time_sec", figures.assigned > 0 ? figures.travel_sum / figures.assigned : 0.0}});
+            }
+
+            sections["allotment_quality_report"] = {
+                {"total_students", (int)students.size()},
+                {"total_assigned", quality.assigned},
+                {"total_unassigned_final", static_cast<int>(students.size()) - quality.assigned},
+                {"total_travel_time_sec", quality.travel_sum},
+                {"avg_travel_time_sec", quality.assigned > 0 ? quality.travel_sum / quality.assigned : 0.0},
+                {"max_travel_time_sec", quality.max_travel},
+                {"first_choice_assignments", quality.first_choice_count},
+                {"fallback_assignments", quality.assigned - quality.first_choice_count},
+                {"by_category", by_category}};
+
+            // Graph Summary
+            const GraphStats &graph_stats = g_graph_stats[allotment_graph_id];
+            sections["graph_id"] = allotment_graph_id;
+            sections["graph_summary"] = {
+                {"graph_detail_setting", graph_stats.detail_setting},
+                {"nodes_count_total", graph_stats.nodes_total},
+                {"edges_count_directed", graph_stats.edges_directed},
+                {"oneway_edges_count", graph_stats.oneway_edges},
+                {"component_count", graph_stats.component_count},
+                {"main_component_id", graph_stats.main_component_id},
+                {"main_component_nodes", graph_stats.main_component_nodes},
+                {"isolated_nodes_count", graph_stats.nodes_total - graph_stats.main_component_nodes}};
+
+            return sections;
+        }
+
+        // One row of the "centres" section. Counting the centre's students is
+        // O(S), so the stream passes in counts taken once up front.
+        json diagnostics_centre_row(const Centre &centre, int assigned_students)
+        {
+            return {{"centre_id", centre.centre_id},
+                    {"lat", centre.lat},
+                    {"lon", centre.lon},
+                    {"graph_node_id", centre.snapped_node_id},
+                    {"assigned_students", assigned_students}};
+        }
+
+        json diagnostics_student_row(const GraphSnapshot &snapshot, int s)
+        {
+            const Student &student = students[s];
+            const AllotmentQuality &quality = allotment_quality;
+            json student_json;
+            student_json["student_id"] = student.student_id;
+            student_json["lat"] = student.lat;
+            student_json["lon"] = student.lon;
+            student_json["category"] = student.category;
+            student_json["snap_node_id"] = student.snapped_node_id;
+
+            student_json["snap_distance_m"] = quality.snap_distance[s];
+
+            const auto assignment_it = final_assignments.find(student.student_id);
+            student_json["assigned_centre_id"] = assignment_it != final_assignments.end() ? json(assignment_it->second) : json();
+
+            std::map<std::string, double> alternative_costs;
+            for (int c = 0; c < static_cast<int>(centres.size()); c++)
+            {
+                alternative_costs[centres[c].centre_id] = lookup_travel_time(snapshot, student.snapped_node_id, c);
+            }
+
+            const double best_distance = quality.best_time[s];
+            const double second_best = quality.second_best_time[s];
+            student_json["alt_distances_m"] = alternative_costs;
+            student_json["component_id"] = snapshot.node_component_of(student.snapped_node_id);
+            student_json["reachable_count"] = quality.reachable_count[s];
+            student_json["near_tie"] = (second_best < std::numeric_limits<double>::max() && std::abs(second_best - best_distance) < 20.0);
+            return student_json;
+        }
+
+        // Writes /export-diagnostics a piece at a time through a chunked
+        // response, so memory stays at one chunk whatever the student and
+        // centre counts. Each piece is produced under allotment_mutex; if the
+        // allotment changes mid-stream the stream is abandoned rather than
+        // mixing two runs.
+        //
+        // JSON output has the same keys and layout as the old single-DOM
+        // report (sorted keys, two-space indent unless compact). NDJSON output
+        // is one record per line: a "summary" record, then one "centre" and one
+        // "student" record per row.
+        class DiagnosticsStream
+        {
+        public:
+            DiagnosticsStream(std::shared_ptr<const GraphSnapshot> snapshot, const DiagnosticsOptions &options)
+                : snapshot_(std::move(snapshot)), options_(options), revision_(allotment_revision)
+            {
+                if (options_.summary)
+                {
+                    summary_ = diagnostics_summary_sections();
+                }
+                if (options_.centres)
+                {
+                    std::unordered_map<std::string, int> assignment_count;
+                    for (const auto &[student_id, centre_id] : final_assignments)
+                    {
+                        assignment_count[centre_id]++;
+                    }
+                    for (const auto &centre : centres)
+                    {
+                        centre_counts_.push_back(assignment_count[centre.centre_id]);
+                    }
+                }
+
+                // Sorted like nlohmann's object keys, so JSON output matches a dump().
+                for (const auto &[key, value] : summary_.items())
+                {
+                    sections_.push_back(key);
+                }
+                if (options_.centres)
+                {
+                    sections_.push_back("centres");
+                }
+                if (options_.students)
+                {
+                    sections_.push_back("students");
+                }
+                if (!options_.ndjson)
+                {
+                    std::sort(sections_.begin(), sections_.end());
+                }
+            }
+
+            // Appends the next piece to `out`. Returns false when the report is
+            // complete. Throws if the allotment changed since the stream began.
+            bool next(std::string &out)
+            {
+                std::lock_guard<std::mutex> lock(allotment_mutex);
+                if (allotment_revision != revision_)
+                {
+                    throw std::runtime_error("Allotment changed during export; request the report again.");
+                }
+                if (finished_)
+                {
+                    return false;
+                }
+
+                if (!started_)
+                {
+                    started_ = true;
+                    if (options_.ndjson)
+                    {
+                        if (options_.summary)
+                        {
+                            json record = summary_;
+                            record["type"] = "summary";
+                            out += record.dump() + "\n";
+                        }
+                    }
+                    else
+                    {
+                        out += options_.compact ? "{" : "{\n";
+                    }
+                }
+
+                while (section_ < sections_.size() && out.size() < kChunkBytes)
+                {
+                    const std::string &key = sections_[section_];
+                    if (key == "centres" || key == "students")
+                    {
+                        write_rows(key, out);
+                    }
+                    else
+                    {
+                        if (!options_.ndjson)
+                        {
+                            write_key(key, out);
+                            out += reindent(summary_[key].dump(indent()), 1);
+                        }
+                        section_++;
+                    }
+                }
+
+                if (section_ == sections_.size())
+                {
+                    if (!options_.ndjson)
+                    {
+                        out += options_.compact ? "}" : "\n}";
+                    }
+                    finished_ = true;
+                }
+                return true;
+            }
+
+        private:
+            static constexpr size_t kChunkBytes = 64 * 1024;
+
+            int indent() const
+            {
+                return options_.compact ? -1 : 2;
+            }
+
+            // Shifts a dump() made at depth 0 to `depth` (two spaces per level).
+            // Newlines only occur between tokens; strings carry them escaped.
+            std::string reindent(const std::string &text, int depth) const
+            {
+                if (options_.compact)
+                {
+                    return text;
+                }
+                const std::string pad(2 * depth, ' ');
+                std::string shifted;
+                shifted.reserve(text.size());
+                for (const char c : text)
+                {
+                    shifted += c;
+                    if (c == '\n')
+                    {
+                        shifted += pad;
+                    }
+                }
+                return shifted;
+            }
+
+            void write_key(const std::string &key, std::string &out)
+            {
+                if (section_ > 0)
+                {
+                    out += options_.compact ? "," : ",\n";
+                }
+                out += options_.compact ? json(key).dump() + ":" : "  " + json(key).dump() + ": ";
+            }
+
+            void write_rows(const std::string &key, std::string &out)
+            {
+                const bool is_centres = key == "centres";
+                const size_t row_count = is_centres ? centres.size() : students.size();
+
+                if (!options_.ndjson && row_ == 0)
+                {
+                    write_key(key, out);
+                    out += row_count == 0 ? "[]" : "[";
+                }
+
+                for (; row_ < row_count && out.size() < kChunkBytes; row_++)
+                {
+                    json row = is_centres ? diagnostics_centre_row(centres[row_], centre_counts_[row_])
+                                          : diagnostics_student_row(*snapshot_, static_cast<int>(row_));
+                    if (options_.ndjson)
+                    {
+                        row["type"] = is_centres ? "centre" : "student";
+                        out += row.dump() + "\n";
+                        continue;
+                    }
+                    if (row_ > 0)
+                    {
+                        out += ",";
+                    }
+                    out += options_.compact ? row.dump() : "\n    " + reindent(row.dump(2), 2);
+                }
+
+                if (row_ == row_count)
+                {
+                    if (!options_.ndjson && row_count > 0)
+                    {
+                        out += options_.compact ? "]" : "\n  ]";
+                    }
+                    row_ = 0;
+                    section_++;
+                }
+            }
+
+            std::shared_ptr<const GraphSnapshot> snapshot_;
+            DiagnosticsOptions options_;
+            std::uint64_t revision_;
+            json summary_ = json::object();
+            std::vector<int> centre_counts_;
+            std::vector<std::string> sections_;
+            size_t section_ = 0;
+            size_t row_ = 0;
+            bool started_ = false;
+            bool finished_ = false;
+        };
+
+        std::string graph_id_param(const httplib::Request &req)
+        {
+            return req.has_param("graph_id") ? req.get_param_value("graph_id") : std::string(kDefaultGraphId);
+        }
+
+        bool ensure_graph_ready(const std::string &graph_id, const GraphSnapshot &snapshot, httplib::Response &res)
+        {
+            if (!snapshot.empty())
+            {
+                return true;
+            }
+            json error;
+            error["status"] = "error";
+            error["message"] = graph_id == kDefaultGraphId
+                                   ? "Graph not built. Call /build-graph first."
+                                   : "Graph '" + graph_id + "' not built. Call /build-graph with this graph_id first.";
+            res.set_content(error.dump(), "application/json");
+            return false;
+        }
+
+        // Student, centre and assignment state belongs to one graph session at
+        // a time: the one /run-allotment last ran on. Caller holds allotment_mutex.
+        bool ensure_allotment_graph(const std::string &graph_id, httplib::Response &res)
+        {
+            if (graph_id == allotment_graph_id)
+            {
+                return true;
+            }
+            json error;
+            error["status"] = "error";
+            error["message"] = "The current allotment was run on graph '" + allotment_graph_id +
+                               "'. Call /run-allotment with graph_id '" + graph_id + "' first.";
+            res.set_content(error.dump(), "application/json");
+            return false;
+        }
+
+        // The allotment's centre indices and student snaps are only valid on
+        // the build it was computed on. Caller holds allotment_mutex.
+        bool ensure_allotment_current(const GraphSnapshot &snapshot, httplib::Response &res)
+        {
+            if (snapshot.build_id == allotment_build_id)
+            {
+                return true;
+            }
+            json error;
+            error["status"] = "error";
+            error["message"] = allotment_build_id == 0
+                                   ? "No allotment yet. Call /run-allotment first."
+                                   : "Graph '" + allotment_graph_id + "' was rebuilt after the last allotment. Call /run-allotment again.";
+            res.set_content(error.dump(), "application/json");
+            return false;
+        }
+
+        // Response encodings for the bulk endpoints, chosen by ?format= or the
+        // Accept header. gzip for the JSON ones is left to httplib, which
+        // compresses text responses when the client sends Accept-Encoding.
+        enum class ResponseEncoding
+        {
+            Json,
+            Cbor,
+            MessagePack,
+            Columnar
+        };
+
+        constexpr const char *kColumnarContentType = "application/vnd.route-finder.columnar";
+
+        ResponseEncoding negotiate_encoding(const httplib::Request &req)
+        {
+            const std::string format = req.has_param("format") ? req.get_param_value("format") : "";
+            const std::string accept = req.get_header_value("Accept");
+            if (format == "cbor" || (format.empty() && accept.find("application/cbor") != std::string::npos))
+            {
+                return ResponseEncoding::Cbor;
+            }
+            if (format == "msgpack" || (format.empty() && accept.find("msgpack") != std::string::npos))
+            {
+                return ResponseEncoding::MessagePack;
+            }
+            if (format == "columnar" || (format.empty() && accept.find(kColumnarContentType) != std::string::npos))
+            {
+                return ResponseEncoding::Columnar;
+            }
+            return ResponseEncoding::Json;
+        }
+
+        // Raw little-endian columns, for clients that want matrices and
+        // assignment vectors without parsing text:
+        //
+        //   "RFCOLS01", u32 column count, then per column:
+        //   u8 type, u32 name length, name, u64 element count, elements
+        //
+        // Types: 1 = i32, 2 = f64, 3 = strings (u32 length + UTF-8 bytes each),
+        // 4 = one JSON document (count is its byte length). Matrices are f64
+        // columns in row-major order; their shape is given by the id columns.
+        class ColumnarWriter
+        {
+        public:
+            ColumnarWriter()
+            {
+                out_.append("RFCOLS01", 8);
+                put(std::uint32_t{0});
+            }
+
+            void add_int32(const std::string &name, const std::vector<int> &values)
+            {
+                begin(1, name, values.size());
+                for (const int value : values)
+                {
+                    put(static_cast<std::uint32_t>(value));
+                }
+            }
+
+            void add_float64(const std::string &name, const std::vector<double> &values)
+            {
+                begin(2, name, values.size());
+                for (const double value : values)
+                {
+                    std::uint64_t bits;
+                    std::memcpy(&bits, &value, sizeof(bits));
+                    put(bits);
+                }
+            }
+
+            void add_strings(const std::string &name, const std::vector<std::string> &values)
+            {
+                begin(3, name, values.size());
+                for (const auto &value : values)
+                {
+                    put(static_cast<std::uint32_t>(value.size()));
+                    out_ += value;
+                }
+            }
+
+            void add_json(const std::string &name, const json &value)
+            {
+                const std::string text = value.dump();
+                begin(4, name, text.size());
+                out_ += text;
+            }
+
+            std::string finish()
+            {
+                for (int i = 0; i < 4; i++)
+                {
+                    out_[8 + i] = static_cast<char>((columns_ >> (8 * i)) & 0xff);
+                }
+                return std::move(out_);
+            }
+
+        private:
+            template <typename T>
+            void put(T value)
+            {
+                for (size_t i = 0; i < sizeof(T); i++)
+                {
+                    out_ += static_cast<char>((value >> (8 * i)) & 0xff);
+                }
+            }
+
+            void begin(std::uint8_t type, const std::string &name, size_t count)
+            {
+                columns_++;
+                put(type);
+                put(static_cast<std::uint32_t>(name.size()));
+                out_ += name;
+                put(static_cast<std::uint64_t>(count));
+            }
+
+            std::string out_;
+            std::uint32_t columns_ = 0;
+        };
+
+        // Sets the body and reports its size and how long encoding took
+        // (`serialise_start` lets callers include building the payload).
+        void send_encoded(httplib::Response &res, std::string body, const char *content_type,
+                          std::chrono::high_resolution_clock::time_point serialise_start)
+        {
+            const double serialise_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - serialise_start).count();
+            res.set_header("X-Serialize-Ms", std::to_string(std::round(serialise_ms * 1000.0) / 1000.0));
+            res.set_header("X-Body-Bytes", std::to_string(body.size()));
+            res.set_content(std::move(body), content_type);
+        }
+
+        // JSON, CBOR or MessagePack, as negotiated; columnar requests get JSON
+        // from endpoints that have no columnar layout.
+        void send_json(const httplib::Request &req, httplib::Response &res, const json &body,
+                       std::chrono::high_resolution_clock::time_point serialise_start = std::chrono::high_resolution_clock::now())
+        {
+            switch (negotiate_encoding(req))
+            {
+            case ResponseEncoding::Cbor:
+            {
+                const auto bytes = json::to_cbor(body);
+                send_encoded(res, std::string(bytes.begin(), bytes.end()), "application/cbor", serialise_start);
+                return;
+            }
+            case ResponseEncoding::MessagePack:
+            {
+                const auto bytes = json::to_msgpack(body);
+                send_encoded(res, std::string(bytes.begin(), bytes.end()), "application/msgpack", serialise_start);
+                return;
+            }
+            default:
+                send_encoded(res, body.dump(), "application/json", serialise_start);
+                return;
+            }
+        }
+
+        json graph_sessions_json()
+        {
+            size_t resident_bytes = 0;
+            json graphs = json::array();
+            for (const auto &info : list_graph_sessions())
+            {
+                if (info.resident)
+                {
+                    resident_bytes += info.memory_bytes;
+                }
+                graphs.push_back({{"graph_id", info.graph_id},
+                                  {"resident", info.resident},
+                                  {"on_disk", info.on_disk},
+                                  {"memory_bytes", info.memory_bytes},
+                                  {"disk_bytes", info.disk_bytes},
+                                  {"idle_sec", std::round(info.idle_sec * 10.0) / 10.0},
+                                  {"nodes_count", info.nodes},
+                                  {"edges_count", info.edges},
+                                  {"centres_count", info.centres},
+                                  {"loaded_detail", info.detail}});
+            }
+
+            json response;
+            response["status"] = "success";
+            response["memory_budget_bytes"] = graph_memory_budget();
+            response["resident_bytes"] = resident_bytes;
+            response["graphs"] = graphs;
+            return response;
+        }
+
+        // The whole /build-graph pipeline. `job` is null for the blocking
+        // endpoint; for /jobs/build-graph it receives stage events and can
+        // cancel the build at the next stage boundary.
+        json run_build_pipeline(const json &body, BuildJob *job)
+        {
+            const double min_lat = body.value("min_lat", 26.0);
+            const double min_lon = body.value("min_lon", 72.0);
+            const double max_lat = body.value("max_lat", 27.0);
+            const double max_lon = body.value("max_lon", 74.0);
+            const std::string detail = body.value("graph_detail", "medium");
+            const bool use_cache = body.value("use_cache", false);
+            const bool simplify = body.value("simplify", false);
+            const bool path_trees = body.value("path_trees", true);
+            const std::string graph_id = body.value("graph_id", std::string(kDefaultGraphId));
+            if (!valid_graph_id(graph_id))
+            {
+                throw std::runtime_error("graph_id must be 1-64 letters, digits, '-' or '_'.");
+            }
+
+            // Everything below fills a private draft; requests keep reading the
+            // published snapshot until the draft replaces it at the end.
+            std::lock_guard<std::mutex> build_lock(g_build_mutex);
+            report_build_stage(job, "fetch", 5);
+            const auto previous = current_snapshot(graph_id);
+            const auto draft = std::make_shared<GraphSnapshot>();
+            draft->build_id = ++g_build_count;
+
+            if (body.contains("centres") && body["centres"].is_array())
+            {
+                for (const auto &centre_json : body["centres"])
+                {
+                    if (!centre_json.is_object())
+                    {
+                        continue;
+                    }
+
+                    Centre centre;
+                    centre.centre_id = centre_json.value("centre_id", "centre");
+                    centre.lat = centre_json.value("lat", 0.0);
+                    centre.lon = centre_json.value("lon", 0.0);
+                    centre.max_capacity = centre_json.value("max_capacity", 500);
+                    centre.current_load = 0;
+                    centre.has_wheelchair_access = centre_json.value("has_wheelchair_access", false);
+                    centre.is_female_only = centre_json.value("is_female_only", false);
+
+                    draft->centres.push_back(centre);
+                }
+            }
+
+            std::string osm_payload;
+            long long fetch_ms = 0;
+            bool cache_valid = false;
+            std::string graph_source = "overpass";
+            std::string source_detail = "high";
+            long long build_ms = 0;
+
+            const GraphBounds &loaded = previous->source_bounds;
+            const bool reuse_loaded = previous->has_source_bounds && previous->full_graph && !previous->full_graph->empty() &&
+                                      graph_detail_covers(previous->full_graph_detail, detail) &&
+                                      same_bounds(loaded.min_lat, loaded.min_lon, loaded.max_lat, loaded.max_lon,
+                                                  min_lat, min_lon, max_lat, max_lon);
+
+            if (reuse_loaded)
+            {
+                std::cout << "♻️  MEMORY HIT: Deriving detail=" << detail << " view from loaded "
+                          << previous->full_graph_detail << "-detail graph" << std::endl;
+                graph_source = "memory";
+                report_build_stage(job, "build_graph", 30);
+
+                const auto build_start = std::chrono::high_resolution_clock::now();
+                draft->full_graph = previous->full_graph;
+                draft->full_graph_detail = previous->full_graph_detail;
+                draft->has_source_bounds = true;
+                draft->source_bounds = previous->source_bounds;
+                draft->nodes = previous->nodes;
+                apply_graph_detail(*draft, detail);
+                const auto build_end = std::chrono::high_resolution_clock::now();
+                build_ms = std::chrono::duration_cast<std::chrono::milliseconds>(build_end - build_start).count();
+            }
+            else
+            {
+                // --- CACHING LOGIC WITH VALIDATION ---
+                std::ifstream cache_file(CACHE_FILE_NAME);
+                if (use_cache && cache_file.good())
+                {
+                    std::stringstream buffer;
+                    buffer << cache_file.rdbuf();
+                    cache_file.close();
+                    
+                    try
+                    {
+                        json cached_data = json::parse(buffer.str());
+                        
+                        // Validate cache metadata
+                        if (cached_data.contains("metadata"))
+                        {
+                            const auto &meta = cached_data["metadata"];
+                            const double cached_min_lat = meta.value("min_lat", 0.0);
+                            const double cached_min_lon = meta.value("min_lon", 0.0);
+                            const double cached_max_lat = meta.value("max_lat", 0.0);
+                            const double cached_max_lon = meta.value("max_lon", 0.0);
+                            const std::string cached_detail = meta.value("graph_detail", "");
+                            
+                            // Lower detail levels are subsets of higher ones, so any
+                            // cache at or above the requested detail can be filtered down.
+                            if (same_bounds(cached_min_lat, cached_min_lon, cached_max_lat, cached_max_lon,
+                                            min_lat, min_lon, max_lat, max_lon) &&
+                                !cached_detail.empty() && graph_detail_covers(cached_detail, detail))
+                            {
+                                cache_valid = true;
+                                source_detail = cached_detail;
+                                graph_source = "cache";
+                                osm_payload = cached_data["osm_data"].dump();
+                                std::cout << "🚀 CACHE HIT: Re-using " << cached_detail << "-detail data from '" << CACHE_FILE_NAME << "'" << std::endl;
+                            }
+                            else
+                            {
+                                std::cout << "⚠️  CACHE INVALID: Bounds or detail mismatch. Fetching fresh data..." << std::endl;
+                            }
+                        }
+                        else
+                        {
+                            std::cout << "⚠️  CACHE INVALID: No metadata found. Fetching fresh data..." << std::endl;
+                        }
+                    }
+                    catch (const std::exception &e)
+                    {
+                        std::cout << "⚠️  CACHE ERROR: Failed to parse cache file. Fetching fresh data..." << std::endl;
+                    }
+                }
+                
+                if (!cache_valid)
+                {
+                    if (use_cache && cache_file.good())
+                    {
+                        std::cout << "📡 Fetching from Overpass API..." << std::endl;
+                    }
+                    else if (use_cache)
+                    {
+                        std::cout << "⚠️  CACHE MISS: Cache file not found. Fetching from API..." << std::endl;
+                    }
+
+                    // Always fetch every road class once; lower detail levels are
+                    // derived in memory by apply_graph_detail().
+                    const auto fetch_start = std::chrono::high_resolution_clock::now();
+                    osm_payload = fetch_overpass_data(min_lat, min_lon, max_lat, max_lon, source_detail);
+                    const auto fetch_end = std::chrono::high_resolution_clock::now();
+                    fetch_ms = std::chrono::duration_cast<std::chrono::milliseconds>(fetch_end - fetch_start).count();
+
+                    // Save to cache with metadata
+                    json cache_object;
+                    cache_object["metadata"] = {
+                        {"min_lat", min_lat},
+                        {"min_lon", min_lon},
+                        {"max_lat", max_lat},
+                        {"max_lon", max_lon},
+                        {"graph_detail", source_detail},
+                        {"timestamp", std::time(nullptr)}
+                    };
+                    cache_object["osm_data"] = json::parse(osm_payload);
+                    
+                    std::ofstream out_cache(CACHE_FILE_NAME);
+                    if (out_cache.good())
+                    {
+                        out_cache << cache_object.dump();
+                        out_cache.close();
+                        std::cout << "💾 CACHE WRITE: Saved new data to '" << CACHE_FILE_NAME << "' with metadata" << std::endl;
+                    }
+                }
+                // --- END CACHING LOGIC ---
+
+                report_build_stage(job, "build_graph", 30);
+                json osm_data = json::parse(osm_payload);
+
+                const auto build_start = std::chrono::high_resolution_clock::now();
+                build_graph_from_overpass(*draft, osm_data, source_detail);
+                if (!draft->nodes.empty() && detail != source_detail)
+                {
+                    apply_graph_detail(*draft, detail);
+                }
+                const auto build_end = std::chrono::high_resolution_clock::now();
+                build_ms = std::chrono::duration_cast<std::chrono::milliseconds>(build_end - build_start).count();
+
+                if (draft->nodes.empty())
+                {
+                    std::cout << "Overpass data empty, generating simulated graph fallback." << std::endl;
+                    generate_simulated_graph_fallback(*draft, min_lat, min_lon, max_lat, max_lon);
+                    graph_source = "simulated";
+                }
+
+                draft->has_source_bounds = true;
+                draft->source_bounds = {min_lat, min_lon, max_lat, max_lon};
+            }
+
+            json simplification_json = {{"enabled", simplify}};
+            if (simplify)
+            {
+                report_build_stage(job, "simplify", 45);
+                const auto simplify_start = std::chrono::high_resolution_clock::now();
+                const auto stats = simplify_graph_topology(*draft);
+                const auto simplify_end = std::chrono::high_resolution_clock::now();
+                build_ms += std::chrono::duration_cast<std::chrono::milliseconds>(simplify_end - simplify_start).count();
+
+                const auto reduction_pct = [](size_t before, size_t after)
+                {
+                    return before > 0 ? 100.0 * (static_cast<double>(before) - static_cast<double>(after)) / before : 0.0;
+                };
+                simplification_json["nodes_before"] = stats.nodes_before;
+                simplification_json["nodes_after"] = stats.nodes_after;
+                simplification_json["node_reduction_pct"] = reduction_pct(stats.nodes_before, stats.nodes_after);
+                simplification_json["edges_before"] = stats.edges_before;
+                simplification_json["edges_after"] = stats.edges_after;
+                simplification_json["edge_reduction_pct"] = reduction_pct(stats.edges_before, stats.edges_after);
+                simplification_json["chains_contracted"] = stats.chains_contracted;
+                simplification_json["shape_points"] = stats.shape_points;
+                simplification_json["dijkstra_before_ms"] = stats.dijkstra_before_ms;
+                simplification_json["dijkstra_after_ms"] = stats.dijkstra_after_ms;
+                simplification_json["dijkstra_speedup"] = stats.dijkstra_after_ms > 0.0 ? stats.dijkstra_before_ms / stats.dijkstra_after_ms : 0.0;
+            }
+
+            json roi_json = {{"enabled", false}};
+            long long prune_ms = 0;
+            if (body.contains("roi") && body["roi"].is_object())
+            {
+                const auto &roi_body = body["roi"];
+
+                RegionOfInterest roi;
+                roi.margin_metres = roi_body.value("margin_m", 0.0);
+                roi.margin_seconds = roi_body.value("margin_sec", 0.0);
+                if (roi.margin_metres <= 0.0 && roi.margin_seconds <= 0.0)
+                {
+                    roi.margin_metres = 2000.0;
+                }
+                for (const auto &centre : draft->centres)
+                {
+                    roi.anchor_points.push_back({centre.lat, centre.lon});
+                }
+                if (roi_body.contains("student_area") && roi_body["student_area"].is_object())
+                {
+                    const auto &area = roi_body["student_area"];
+                    const double area_min_lat = area.value("min_lat", 0.0);
+                    const double area_min_lon = area.value("min_lon", 0.0);
+                    const double area_max_lat = area.value("max_lat", 0.0);
+                    const double area_max_lon = area.value("max_lon", 0.0);
+                    roi.anchor_points.push_back({area_min_lat, area_min_lon});
+                    roi.anchor_points.push_back({area_min_lat, area_max_lon});
+                    roi.anchor_points.push_back({area_max_lat, area_min_lon});
+                    roi.anchor_points.push_back({area_max_lat, area_max_lon});
+                }
+
+                report_build_stage(job, "prune", 50);
+                const auto prune_start = std::chrono::high_resolution_clock::now();
+                const auto stats = prune_graph_to_region(*draft, roi);
+                const auto prune_end = std::chrono::high_resolution_clock::now();
+                prune_ms = std::chrono::duration_cast<std::chrono::milliseconds>(prune_end - prune_start).count();
+
+                roi_json = {
+                    {"enabled", true},
+                    {"margin_m", roi.margin_metres},
+                    {"margin_sec", roi.margin_seconds},
+                    {"hull_vertices", stats.hull_vertices},
+                    {"nodes_before", stats.nodes_before},
+                    {"nodes_kept", stats.nodes_kept},
+                    {"edges_before", stats.edges_before},
+                    {"edges_kept", stats.edges_kept},
+                    {"kept_pct", stats.nodes_before > 0 ? 100.0 * stats.nodes_kept / stats.nodes_before : 0.0},
+                    {"prune_ms", prune_ms}};
+            }
+
+            // Strongly connected components, computed exactly once per build on
+            // the final (detail-filtered, simplified, pruned) graph.
+            report_build_stage(job, "components", 55);
+            const auto comp_start = std::chrono::high_resolution_clock::now();
+            build_dense_graph(*draft);
+            compute_connected_components(*draft);
+            const auto comp_end = std::chrono::high_resolution_clock::now();
+
+            report_build_stage(job, "kdtree", 65);
+            const auto kd_start = std::chrono::high_resolution_clock::now();
+            build_snapshot_kdtree(*draft);
+            snap_centres_to_graph(*draft);
+            const auto kd_end = std::chrono::high_resolution_clock::now();
+
+            report_build_stage(job, "distance_table", 75);
+            const auto dijkstra_start = std::chrono::high_resolution_clock::now();
+            build_allotment_lookup(*draft, path_trees);
+            const auto dijkstra_end = std::chrono::high_resolution_clock::now();
+
+            const auto comp_ms = std::chrono::duration_cast<std::chrono::milliseconds>(comp_end - comp_start).count();
+            const auto kd_ms = std::chrono::duration_cast<std::chrono::milliseconds>(kd_end - kd_start).count();
+            const auto dijkstra_ms = std::chrono::duration_cast<std::chrono::milliseconds>(dijkstra_end - dijkstra_start).count();
+
+            size_t edge_total = 0;
+            for (const auto &entry : draft->graph)
+            {
+                edge_total += entry.second.size();
+            }
+
+            // Calculate main component
+            std::unordered_map<int, int> comp_counts;
+            for (const auto &[node_id, comp_id] : draft->node_component)
+            {
+                if (comp_id > 0)
+                {
+                    comp_counts[comp_id]++;
+                }
+            }
+
+            GraphStats graph_stats;
+            graph_stats.detail_setting = detail;
+            graph_stats.nodes_total = static_cast<int>(draft->nodes.size());
+            graph_stats.edges_directed = static_cast<int>(edge_total);
+            graph_stats.component_count = static_cast<int>(comp_counts.size());
+            graph_stats.main_component_id = draft->main_component_id;
+            graph_stats.main_component_nodes = comp_counts[draft->main_component_id];
+
+            // Last chance to cancel; once published the build cannot be undone.
+            report_build_stage(job, "publish", 95);
+
+            // Published outside allotment_mutex: describe() and evicting
+            // sessions to disk must not stall allotment requests. Until the
+            // reset below, those requests see a snapshot whose build_id is not
+            // allotment_build_id and refuse.
+            publish_snapshot(draft, graph_id);
+
+            // Centres and the graph they were snapped to change together. The
+            // allotment's centre indices and student snaps refer to the old
+            // build, so rebuilding its graph clears it; allotment_build_id
+            // keeps naming the old build until /run-allotment runs again. A
+            // run that already reached the new build is left alone.
+            {
+                std::lock_guard<std::mutex> lock(allotment_mutex);
+                if (graph_id == allotment_graph_id && allotment_build_id != draft->build_id)
+                {
+                    if (!students.empty())
+                    {
+                        std::cout << "Graph '" << graph_id << "' rebuilt; cleared the allotment of "
+                                  << students.size() << " students." << std::endl;
+                    }
+                    centres = draft->centres;
+                    students.clear();
+                    student_assignment.clear();
+                    student_index.clear();
+                    final_assignments.clear();
+                    allotment_quality = AllotmentQuality();
+                    allotment_roster = AllotmentRoster();
+                    allotment_revision++;
+                }
+
+                // Store timing and graph stats for diagnostics
+                DiagnosticTimings &timings = g_timings[graph_id];
+                timings.fetch_overpass_ms = fetch_ms;
+                timings.build_graph_ms = build_ms;
+                timings.compute_components_ms = comp_ms + prune_ms;
+                timings.build_kdtree_ms = kd_ms;
+                timings.dijkstra_precompute_ms = dijkstra_ms;
+                g_graph_stats[graph_id] = graph_stats;
+            }
+
+            json response;
+            response["status"] = "success";
+            response["graph_id"] = graph_id;
+            response["memory_bytes"] = snapshot_memory_bytes(*draft);
+            response["path_trees"] = draft->distance_table.has_path_trees();
+            response["nodes_count"] = draft->nodes.size();
+            response["edges_count"] = edge_total;
+            response["graph_source"] = graph_source;
+            response["loaded_detail"] = draft->full_graph_detail;
+            response["simplification"] = simplification_json;
+            response["roi"] = roi_json;
+            response["components"] = {
+                {"strongly_connected", graph_stats.component_count},
+                {"main_component_nodes", graph_stats.main_component_nodes},
+                {"compute_components_ms", comp_ms}};
+            response["timing"] = {
+                {"fetch_overpass_ms", fetch_ms},
+                {"build_graph_ms", build_ms},
+                {"build_kdtree_ms", kd_ms},
+                {"dijkstra_precompute_ms", dijkstra_ms},
+                {"total_ms", fetch_ms + build_ms + kd_ms + dijkstra_ms}};
+
+            return response;
+        }
+
+        // Body of the job thread: runs the pipeline and records how it ended.
+        void run_build_job(std::shared_ptr<BuildJob> job, json body)
+        {
+            std::string state;
+            json result;
+            try
+            {
+                result = run_build_pipeline(body, job.get());
+                state = "succeeded";
+            }
+            catch (const BuildCancelled &ex)
+            {
+                state = "cancelled";
+                result = {{"status", "error"}, {"message", ex.what()}};
+            }
+            catch (const std::exception &ex)
+            {
+                state = "failed";
+                result = {{"status", "error"}, {"message", ex.what()}};
+            }
+
+            std::cout << "Build job " << job->job_id << " " << state << " after " << job_elapsed_ms(*job) << " ms." << std::endl;
+            std::lock_guard<std::mutex> lock(job->mutex);
+            job->state = state;
+            if (state == "succeeded")
+            {
+                job->stage = "done";
+                job->percent = 100;
+            }
+            job->result = std::move(result);
+            push_job_event(*job, state);
+        }
+
+    } // namespace
+} // namespace route_finder
 
 int main()
 {
@@ -469,6 +2001,7 @@ int main()
         res.set_header("Access-Control-Allow-Origin", "*");
         res.set_header("Access-Control-Allow-Methods", "GET, POST, OPTIONS");
         res.set_header("Access-Control-Allow-Headers", "Content-Type");
+        res.set_header("Access-Control-Expose-Headers", "X-Serialize-Ms, X-Body-Bytes");
         if (req.method == "OPTIONS")
         {
             res.status = 200;
@@ -481,212 +2014,590 @@ int main()
         try
         {
             const auto body = json::parse(req.body);
+            res.set_content(run_build_pipeline(body, nullptr).dump(), "application/json");
+        }
+        catch (const std::exception &ex)
+        {
+            json error;
+            error["status"] = "error";
+            error["message"] = ex.what();
+            res.set_content(error.dump(), "application/json");
+        } });
 
-            const double min_lat = body.value("min_lat", 26.0);
-            const double min_lon = body.value("min_lon", 72.0);
-            const double max_lat = body.value("max_lat", 27.0);
-            const double max_lon = body.value("max_lon", 74.0);
-            const std::string detail = body.value("graph_detail", "medium");
-            const bool use_cache = body.value("use_cache", false);
+    server.Post("/jobs/build-graph", [](const httplib::Request &req, httplib::Response &res)
+                {
+        try
+        {
+            auto body = json::parse(req.body);
+            const std::string graph_id = body.value("graph_id", std::string(kDefaultGraphId));
+            if (!valid_graph_id(graph_id))
+            {
+                throw std::runtime_error("graph_id must be 1-64 letters, digits, '-' or '_'.");
+            }
 
-            centres.clear();
-            if (body.contains("centres") && body["centres"].is_array())
+            const auto job = std::make_shared<BuildJob>();
+            job->graph_id = graph_id;
             {
-                for (const auto &centre_json : body["centres"])
+                std::lock_guard<std::mutex> lock(g_jobs_mutex);
+                prune_finished_jobs();
+                job->job_id = "job-" + std::to_string(g_next_job_id++);
+                g_jobs[job->job_id] = job;
+            }
+            {
+                std::lock_guard<std::mutex> lock(job->mutex);
+                push_job_event(*job, "progress");
+            }
+
+            // The build owns its thread, so no server worker waits on it; jobs
+            // still run one at a time behind g_build_mutex.
+            std::thread(run_build_job, job, std::move(body)).detach();
+
+            json response;
+            response["status"] = "success";
+            response["job_id"] = job->job_id;
+            response["graph_id"] = graph_id;
+            response["status_url"] = "/jobs/" + job->job_id;
+            response["events_url"] = "/jobs/" + job->job_id + "/events";
+            res.set_content(response.dump(), "application/json");
+        }
+        catch (const std::exception &ex)
+        {
+            json error;
+            error["status"] = "error";
+            error["message"] = ex.what();
+            res.set_content(error.dump(), "application/json");
+        } });
+
+    server.Get("/jobs/:id", [](const httplib::Request &req, httplib::Response &res)
+               {
+        const auto job = find_job(req.path_params.at("id"));
+        if (!job)
+        {
+            json error;
+            error["status"] = "error";
+            error["message"] = "Unknown job '" + req.path_params.at("id") + "'.";
+            res.set_content(error.dump(), "application/json");
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(job->mutex);
+        json response = job_status_json(*job);
+        response["status"] = "success";
+        res.set_content(response.dump(), "application/json"); });
+
+    server.Post("/jobs/:id/cancel", [](const httplib::Request &req, httplib::Response &res)
                 {
-                    if (!centre_json.is_object())
-                    {
-                        continue;
-                    }
+        const auto job = find_job(req.path_params.at("id"));
+        if (!job)
+        {
+            json error;
+            error["status"] = "error";
+            error["message"] = "Unknown job '" + req.path_params.at("id") + "'.";
+            res.set_content(error.dump(), "application/json");
+            return;
+        }
+
+        // Takes effect at the next stage boundary; a build that already
+        // reached "publish" completes.
+        std::lock_guard<std::mutex> lock(job->mutex);
+        if (!job->finished())
+        {
+            job->cancel_requested = true;
+        }
+        json response = job_status_json(*job);
+        response["status"] = "success";
+        response["cancel_requested"] = job->cancel_requested.load();
+        res.set_content(response.dump(), "application/json"); });
+
+    // Server-Sent Events: replays the job's events, then follows it until it
+    // finishes. A comment line every 15 s keeps idle proxies from closing the stream.
+    server.Get("/jobs/:id/events", [](const httplib::Request &req, httplib::Response &res)
+               {
+        const auto job = find_job(req.path_params.at("id"));
+        if (!job)
+        {
+            json error;
+            error["status"] = "error";
+            error["message"] = "Unknown job '" + req.path_params.at("id") + "'.";
+            res.set_content(error.dump(), "application/json");
+            return;
+        }
+
+        res.set_header("Cache-Control", "no-cache");
+        auto next_event = std::make_shared<size_t>(0);
+        res.set_chunked_content_provider("text/event-stream", [job, next_event](size_t, httplib::DataSink &sink)
+                                         {
+            std::string chunk;
+            bool finished = false;
+            {
+                std::unique_lock<std::mutex> lock(job->mutex);
+                job->changed.wait_for(lock, std::chrono::seconds(15), [&]
+                                      { return *next_event < job->events.size(); });
+                for (; *next_event < job->events.size(); ++*next_event)
+                {
+                    const json &event = job->events[*next_event];
+                    chunk += "event: " + event["type"].get<std::string>() + "\n";
+                    chunk += "data: " + event.dump() + "\n\n";
+                }
+                finished = job->finished();
+            }
+
+            if (chunk.empty())
+            {
+                chunk = ": keep-alive\n\n";
+            }
+            if (!sink.write(chunk.data(), chunk.size()))
+            {
+                return false;
+            }
+            if (finished)
+            {
+                sink.done();
+            }
+            return true; }); });
+
+    server.Get("/graphs", [](const httplib::Request &, httplib::Response &res)
+               {
+        try
+        {
+            res.set_content(graph_sessions_json().dump(), "application/json");
+        }
+        catch (const std::exception &ex)
+        {
+            json error;
+            error["status"] = "error";
+            error["message"] = ex.what();
+            res.set_content(error.dump(), "application/json");
+        } });
+
+    server.Post("/graphs/budget", [](const httplib::Request &req, httplib::Response &res)
+                {
+        try
+        {
+            const auto body = json::parse(req.body);
+            const double budget_mb = body.value("memory_budget_mb", -1.0);
+            if (budget_mb < 0.0)
+            {
+                json error;
+                error["status"] = "error";
+                error["message"] = "memory_budget_mb must be a non-negative number.";
+                res.set_content(error.dump(), "application/json");
+                return;
+            }
+
+            // Shrinking the budget evicts least recently used graphs to disk right away.
+            set_graph_memory_budget(static_cast<size_t>(budget_mb * 1024.0 * 1024.0));
+            res.set_content(graph_sessions_json().dump(), "application/json");
+        }
+        catch (const std::exception &ex)
+        {
+            json error;
+            error["status"] = "error";
+            error["message"] = ex.what();
+            res.set_content(error.dump(), "application/json");
+        } });
+
+    // Registered with a content reader so NDJSON/CSV uploads can be snapped
+    // while they are still arriving; JSON bodies are read whole as before.
+    server.Post("/run-allotment", [](const httplib::Request &req, httplib::Response &res, const httplib::ContentReader &content_reader)
+                {
+        try
+        {
+            const StudentUploadFormat upload_format = student_upload_format(req);
+            const bool streamed = upload_format != StudentUploadFormat::Json;
+            json request_body;
+            if (streamed)
+            {
+                request_body = allotment_options_from_query(req);
+            }
+            else
+            {
+                std::string body;
+                content_reader([&body](const char *data, size_t length)
+                               {
+                    body.append(data, length);
+                    return true; });
+                request_body = json::parse(body);
+            }
+
+            const std::string graph_id = request_body.value("graph_id", std::string(kDefaultGraphId));
+            const auto snapshot = current_snapshot(graph_id);
+            if (!ensure_graph_ready(graph_id, *snapshot, res))
+            {
+                if (streamed)
+                {
+                    // The upload is left unread, so the connection cannot be reused.
+                    res.set_header("Connection", "close");
+                }
+                return;
+            }
+
+            AllotmentOptions allotment_options;
+            const std::string solver = request_body.value("solver", std::string("greedy"));
+            if (!solver_from_name(solver, allotment_options.solver))
+            {
+                json error;
+                error["status"] = "error";
+                error["message"] = "Unknown solver '" + solver + "'. Use 'greedy', 'min_cost_flow', 'auction' or 'bottleneck'.";
+                if (streamed)
+                {
+                    res.set_header("Connection", "close");
+                }
+                res.set_content(error.dump(), "application/json");
+                return;
+            }
+
+            const auto total_start = std::chrono::high_resolution_clock::now();
+            const auto snap_start = std::chrono::high_resolution_clock::now();
+            std::vector<Student> streamed_students;
+            if (streamed)
+            {
+                std::cout << "\n⚡ Streaming " << (upload_format == StudentUploadFormat::Csv ? "CSV" : "NDJSON")
+                          << " students onto the road network..." << std::endl;
+                StudentStreamLoader loader(*snapshot, upload_format);
+                const bool received = content_reader([&loader](const char *data, size_t length)
+                                                     { return loader.feed(data, length); });
+                if (!received || !loader.finish())
+                {
+                    json error;
+                    error["status"] = "error";
+                    error["message"] = loader.error().empty() ? "Student upload was interrupted." : loader.error();
+                    res.set_header("Connection", "close");
+                    res.set_content(error.dump(), "application/json");
+                    return;
+                }
+                streamed_students = loader.take_students();
+                std::cout << "✅ Snapping complete: " << streamed_students.size() - loader.failed() << " snapped, "
+                          << loader.rescued() << " rescued, " << loader.failed() << " failed in "
+                          << loader.batches() << " batches" << std::endl;
+            }
+
+            std::lock_guard<std::mutex> lock(allotment_mutex);
+            if (graph_id != allotment_graph_id || snapshot->build_id != allotment_build_id)
+            {
+                // The allotment moves to this graph session or build, with its
+                // centres; a re-run on the same build keeps capacity changes.
+                centres = snapshot->centres;
+                allotment_graph_id = graph_id;
+                allotment_build_id = snapshot->build_id;
+            }
+            allotment_revision++;
+
+            if (streamed)
+            {
+                students = std::move(streamed_students);
+            }
+            else
+            {
+                snap_students_to_graph(*snapshot, request_body["students"]);
+            }
+            const auto snap_end = std::chrono::high_resolution_clock::now();
+
+            // Dijkstra already computed in /build-graph - no need to re-run
+            std::cout << "\n🎯 Using pre-computed Dijkstra distances from /build-graph..." << std::endl;
+
+            allotment_options.lazy_candidates = request_body.value("candidates", std::string("lazy")) != "eager";
+            allotment_options.voronoi_prepass = request_body.value("prepass", std::string()) == "voronoi";
+            allotment_options.rules = rules_from_json(request_body);
+            allotment_options.auction_epsilon = request_body.value("auction_epsilon", allotment_options.auction_epsilon);
+            allotment_options.threads = request_body.value("threads", 0u);
+
+            const auto allot_start = std::chrono::high_resolution_clock::now();
+            const AllotmentSummary summary = run_allotment(*snapshot, allotment_options);
+            const auto allot_end = std::chrono::high_resolution_clock::now();
+            const auto total_end = std::chrono::high_resolution_clock::now();
+
+            const auto snap_ms = std::chrono::duration_cast<std::chrono::milliseconds>(snap_end - snap_start).count();
+            const auto allot_ms = std::chrono::duration_cast<std::chrono::milliseconds>(allot_end - allot_start).count();
+            const auto total_ms = std::chrono::duration_cast<std::chrono::milliseconds>(total_end - total_start).count();
 
-                    Centre centre;
-                    centre.centre_id = centre_json.value("centre_id", "centre");
-                    centre.lat = centre_json.value("lat", 0.0);
-                    centre.lon = centre_json.value("lon", 0.0);
-                    centre.max_capacity = centre_json.value("max_capacity", 500);
-                    centre.current_load = 0;
-                    centre.has_wheelchair_access = centre_json.value("has_wheelchair_access", false);
-                    centre.is_female_only = centre_json.value("is_female_only", false);
+            // Store timing for diagnostics
+            DiagnosticTimings &timings = g_timings[graph_id];
+            timings.snap_students_ms = snap_ms;
+            timings.allotment_ms = allot_ms;
 
-                    centres.push_back(centre);
-                }
+            json response;
+            response["status"] = "success";
+            response["timing"] = {
+                {"snap_students_ms", snap_ms},
+                {"allotment_ms", allot_ms},
+                {"total_ms", total_ms}};
+            response["solver"] = {
+                {"name", summary.solver},
+                {"solve_ms", summary.solve_ms},
+                {"assigned", summary.assigned},
+                {"prepass_assigned", summary.prepass_assigned},
+                {"total_travel_time_sec", summary.travel_time},
+                {"max_travel_time_sec", summary.max_travel_time},
+                {"greedy_assigned", summary.greedy_assigned},
+                {"greedy_total_travel_time_sec", summary.greedy_travel_time},
+                {"greedy_max_travel_time_sec", summary.greedy_max_travel_time},
+                {"greedy_ms", summary.greedy_ms},
+                {"eligible_centres", {{"male", summary.eligible_centres[kTierMale]},
+                                      {"pwd", summary.eligible_centres[kTierPwd]},
+                                      {"female", summary.eligible_centres[kTierFemale]}}},
+                {"ineligible_students", summary.ineligible_students},
+                {"improvement_pct", summary.greedy_travel_time > 0.0
+                                        ? 100.0 * (summary.greedy_travel_time - summary.travel_time) / summary.greedy_travel_time
+                                        : 0.0}};
+            if (allotment_options.solver == AllotmentSolver::Bottleneck)
+            {
+                response["solver"]["bottleneck"] = {
+                    {"threshold_sec", summary.bottleneck.threshold_sec},
+                    {"probes", summary.bottleneck.probes},
+                    {"distinct_thresholds", summary.bottleneck.distinct_thresholds},
+                    {"tier_targets", {{"male", summary.bottleneck.tier_targets[kTierMale]},
+                                      {"pwd", summary.bottleneck.tier_targets[kTierPwd]},
+                                      {"female", summary.bottleneck.tier_targets[kTierFemale]}}}};
+            }
+            if (allotment_options.solver == AllotmentSolver::Auction)
+            {
+                response["solver"]["auction"] = {
+                    {"phases", summary.auction.phases},
+                    {"rounds", summary.auction.rounds},
+                    {"bids", summary.auction.bids},
+                    {"final_epsilon", summary.auction.final_epsilon},
+                    {"gap_bound_sec", summary.auction.gap_bound_sec},
+                    {"threads", summary.auction.threads}};
             }
 
-            std::string osm_payload;
-            long long fetch_ms = 0;
-            bool cache_valid = false;
-
-            // --- CACHING LOGIC WITH VALIDATION ---
-            std::ifstream cache_file(CACHE_FILE_NAME);
-            if (use_cache && cache_file.good())
+            size_t debug_top_k = 0;
+            const bool with_debug_distances = debug_distances_requested(request_body, debug_top_k);
+            const auto serialise_start = std::chrono::high_resolution_clock::now();
+            if (negotiate_encoding(req) == ResponseEncoding::Columnar)
             {
-                std::stringstream buffer;
-                buffer << cache_file.rdbuf();
-                cache_file.close();
-                
-                try
+                // Assignments as centre indices and, when asked for, the
+                // distances as one students x centres matrix (+inf = unreachable).
+                std::vector<std::string> student_ids, centre_ids;
+                std::vector<int> assigned_centre;
+                std::vector<double> distance_matrix;
+                student_ids.reserve(students.size());
+                assigned_centre.reserve(students.size());
+                if (with_debug_distances)
                 {
-                    json cached_data = json::parse(buffer.str());
-                    
-                    // Validate cache metadata
-                    if (cached_data.contains("metadata"))
-                    {
-                        const auto &meta = cached_data["metadata"];
-                        const double cached_min_lat = meta.value("min_lat", 0.0);
-                        const double cached_min_lon = meta.value("min_lon", 0.0);
-                        const double cached_max_lat = meta.value("max_lat", 0.0);
-                        const double cached_max_lon = meta.value("max_lon", 0.0);
-                        const std::string cached_detail = meta.value("graph_detail", "");
-                        
-                        // Check if bounds and detail match (with small tolerance for floating point)
-                        const double tolerance = 0.0001;
-                        if (std::abs(cached_min_lat - min_lat) < tolerance &&
-                            std::abs(cached_min_lon - min_lon) < tolerance &&
-                            std::abs(cached_max_lat - max_lat) < tolerance &&
-                            std::abs(cached_max_lon - max_lon) < tolerance &&
-                            cached_detail == detail)
-                        {
-                            cache_valid = true;
-                            osm_payload = cached_data["osm_data"].dump();
-                            std::cout << "🚀 CACHE HIT: Re-using data from '" << CACHE_FILE_NAME << "' (bounds and detail match)" << std::endl;
-                        }
-                        else
-                        {
-                            std::cout << "⚠️  CACHE INVALID: Bounds or detail mismatch. Fetching fresh data..." << std::endl;
-                        }
+                    distance_matrix.reserve(students.size() * centres.size());
+                }
+                for (size_t s = 0; s < students.size(); s++)
+                {
+                    student_ids.push_back(students[s].student_id);
+                    assigned_centre.push_back(s < student_assignment.size() ? student_assignment[s] : -1);
+                    if (!with_debug_distances)
+                    {
+                        continue;
                     }
-                    else
+                    for (int c = 0; c < static_cast<int>(centres.size()); c++)
                     {
-                        std::cout << "⚠️  CACHE INVALID: No metadata found. Fetching fresh data..." << std::endl;
+                        const double distance = lookup_travel_time(*snapshot, students[s].snapped_node_id, c);
+                        distance_matrix.push_back(distance == std::numeric_limits<double>::max() ? std::numeric_limits<double>::infinity() : distance);
                     }
                 }
-                catch (const std::exception &e)
-                {
-                    std::cout << "⚠️  CACHE ERROR: Failed to parse cache file. Fetching fresh data..." << std::endl;
-                }
-            }
-            
-            if (!cache_valid)
-            {
-                if (use_cache && cache_file.good())
-                {
-                    std::cout << "📡 Fetching from Overpass API..." << std::endl;
-                }
-                else if (use_cache)
+                for (const auto &centre : centres)
                 {
-                    std::cout << "⚠️  CACHE MISS: Cache file not found. Fetching from API..." << std::endl;
+                    centre_ids.push_back(centre.centre_id);
                 }
 
-                const auto fetch_start = std::chrono::high_resolution_clock::now();
-                osm_payload = fetch_overpass_data(min_lat, min_lon, max_lat, max_lon, detail);
-                const auto fetch_end = std::chrono::high_resolution_clock::now();
-                fetch_ms = std::chrono::duration_cast<std::chrono::milliseconds>(fetch_end - fetch_start).count();
-
-                // Save to cache with metadata
-                json cache_object;
-                cache_object["metadata"] = {
-                    {"min_lat", min_lat},
-                    {"min_lon", min_lon},
-                    {"max_lat", max_lat},
-                    {"max_lon", max_lon},
-                    {"graph_detail", detail},
-                    {"timestamp", std::time(nullptr)}
-                };
-                cache_object["osm_data"] = json::parse(osm_payload);
-                
-                std::ofstream out_cache(CACHE_FILE_NAME);
-                if (out_cache.good())
+                ColumnarWriter columns;
+                columns.add_json("meta", response);
+                columns.add_strings("student_id", student_ids);
+                columns.add_strings("centre_id", centre_ids);
+                columns.add_int32("assigned_centre", assigned_centre);
+                if (with_debug_distances)
                 {
-                    out_cache << cache_object.dump();
-                    out_cache.close();
-                    std::cout << "💾 CACHE WRITE: Saved new data to '" << CACHE_FILE_NAME << "' with metadata" << std::endl;
+                    columns.add_float64("debug_distances", distance_matrix);
                 }
+                send_encoded(res, columns.finish(), kColumnarContentType, serialise_start);
+                return;
+            }
+            response["assignments"] = final_assignments;
+            if (with_debug_distances)
+            {
+                response["debug_distances"] = build_debug_distances_payload(*snapshot, debug_top_k);
             }
-            // --- END CACHING LOGIC ---
+            send_json(req, res, response, serialise_start);
+        }
+        catch (const std::exception &ex)
+        {
+            json error;
+            error["status"] = "error";
+            error["message"] = ex.what();
+            res.set_content(error.dump(), "application/json");
+        } });
 
-            json osm_data = json::parse(osm_payload);
+    // Per-student centre travel times of the current allotment, read from the
+    // distance table a page at a time (?cursor=, ?limit=) or for one student
+    // (?student_id=). ?top_k=K keeps the K nearest centres and ?fields= picks
+    // from student_id, assigned_centre and distances.
+    server.Get("/debug-distances", [](const httplib::Request &req, httplib::Response &res)
+               {
+        std::lock_guard<std::mutex> lock(allotment_mutex);
+        try
+        {
+            constexpr size_t kDefaultPageSize = 500;
+            constexpr size_t kMaxPageSize = 5000;
 
-            const auto build_start = std::chrono::high_resolution_clock::now();
-            build_graph_from_overpass(osm_data);
-            const auto build_end = std::chrono::high_resolution_clock::now();
+            json error;
+            error["status"] = "error";
+            if (students.empty())
+            {
+                error["message"] = "No allotment to inspect. Call /run-allotment first.";
+                res.set_content(error.dump(), "application/json");
+                return;
+            }
+            const auto snapshot = current_snapshot(allotment_graph_id);
+            if (!ensure_graph_ready(allotment_graph_id, *snapshot, res))
+            {
+                return;
+            }
+            if (!ensure_allotment_current(*snapshot, res))
+            {
+                return;
+            }
 
-            if (nodes.empty())
+            const size_t top_k = req.has_param("top_k") ? static_cast<size_t>(std::stoul(req.get_param_value("top_k"))) : 0;
+            DebugDistanceFields fields;
+            std::string unknown_field;
+            if (req.has_param("fields") && !debug_fields_from_param(req.get_param_value("fields"), fields, unknown_field))
             {
-                std::cout << "Overpass data empty, generating simulated graph fallback." << std::endl;
-                generate_simulated_graph_fallback(min_lat, min_lon, max_lat, max_lon);
+                error["message"] = "Unknown field '" + unknown_field + "'. Use 'student_id', 'assigned_centre' or 'distances'.";
+                res.set_content(error.dump(), "application/json");
+                return;
             }
 
-            // Compute connected components to identify main component
-            const auto comp_start = std::chrono::high_resolution_clock::now();
-            compute_connected_components();
-            const auto comp_end = std::chrono::high_resolution_clock::now();
+            json response;
+            response["status"] = "success";
+            response["students"] = json::array();
+            if (req.has_param("student_id"))
+            {
+                const std::string student_id = req.get_param_value("student_id");
+                const auto it = student_index.find(student_id);
+                if (it == student_index.end())
+                {
+                    error["message"] = "Unknown student '" + student_id + "'.";
+                    res.set_content(error.dump(), "application/json");
+                    return;
+                }
+                response["students"].push_back(debug_distance_row(*snapshot, it->second, top_k, fields));
+                send_json(req, res, response);
+                return;
+            }
 
-            const auto kd_start = std::chrono::high_resolution_clock::now();
-            build_kdtree_for_graph();
-            snap_centres_to_graph();
-            const auto kd_end = std::chrono::high_resolution_clock::now();
+            size_t begin = 0;
+            if (req.has_param("cursor") && !parse_debug_distances_cursor(req.get_param_value("cursor"), begin))
+            {
+                error["message"] = "Cursor is invalid or from an earlier allotment. Start again without a cursor.";
+                res.set_content(error.dump(), "application/json");
+                return;
+            }
+            const size_t limit = req.has_param("limit")
+                                     ? std::min(kMaxPageSize, std::max<size_t>(1, std::stoul(req.get_param_value("limit"))))
+                                     : kDefaultPageSize;
+            const size_t end = std::min(students.size(), begin + limit);
+            for (size_t i = begin; i < end; i++)
+            {
+                response["students"].push_back(debug_distance_row(*snapshot, i, top_k, fields));
+            }
+            response["total_students"] = students.size();
+            response["next_cursor"] = end < students.size() ? json(debug_distances_cursor(end)) : json(nullptr);
+            send_json(req, res, response);
+        }
+        catch (const std::exception &ex)
+        {
+            json error;
+            error["status"] = "error";
+            error["message"] = ex.what();
+            res.set_content(error.dump(), "application/json");
+        } });
 
-            const auto dijkstra_start = std::chrono::high_resolution_clock::now();
-            build_allotment_lookup();
-            const auto dijkstra_end = std::chrono::high_resolution_clock::now();
+    server.Post("/allotment/delta", [](const httplib::Request &req, httplib::Response &res)
+                {
+        std::lock_guard<std::mutex> lock(allotment_mutex);
+        const auto snapshot = current_snapshot(allotment_graph_id);
+        if (!ensure_graph_ready(allotment_graph_id, *snapshot, res))
+        {
+            return;
+        }
+        if (!ensure_allotment_current(*snapshot, res))
+        {
+            return;
+        }
+        const bool assignments_fit = std::all_of(student_assignment.begin(), student_assignment.end(), [](int centre)
+                                                 { return centre < static_cast<int>(centres.size()); });
+        if (student_assignment.size() != students.size() || student_index.size() != students.size() || !assignments_fit)
+        {
+            json error;
+            error["status"] = "error";
+            error["message"] = "No allotment to update. Call /run-allotment first.";
+            res.set_content(error.dump(), "application/json");
+            return;
+        }
 
-            const auto build_ms = std::chrono::duration_cast<std::chrono::milliseconds>(build_end - build_start).count();
-            const auto comp_ms = std::chrono::duration_cast<std::chrono::milliseconds>(comp_end - comp_start).count();
-            const auto kd_ms = std::chrono::duration_cast<std::chrono::milliseconds>(kd_end - kd_start).count();
-            const auto dijkstra_ms = std::chrono::duration_cast<std::chrono::milliseconds>(dijkstra_end - dijkstra_start).count();
+        try
+        {
+            const auto request_body = json::parse(req.body);
+            if (!ensure_allotment_graph(request_body.value("graph_id", allotment_graph_id), res))
+            {
+                return;
+            }
+            allotment_revision++;
+            const auto start = std::chrono::high_resolution_clock::now();
 
-            // Store timing for diagnostics
-            g_timings.fetch_overpass_ms = fetch_ms;
-            g_timings.build_graph_ms = build_ms;
-            g_timings.compute_components_ms = comp_ms;
-            g_timings.build_kdtree_ms = kd_ms;
-            g_timings.dijkstra_precompute_ms = dijkstra_ms;
-
-            // Store graph stats for diagnostics
-            g_graph_stats.detail_setting = detail;
-            g_graph_stats.nodes_total = static_cast<int>(nodes.size());
-            
-            size_t edge_total = 0;
-            for (const auto &entry : graph)
+            // Only new and moved students are snapped; everyone else keeps their cached node.
+            AllotmentDelta delta;
+            delta.max_cascade = request_body.value("max_cascade", delta.max_cascade);
+            for (const auto &s : request_body.value("add", json::array()))
             {
-                edge_total += entry.second.size();
+                delta.added.push_back(student_from_json(*snapshot, s));
             }
-            g_graph_stats.edges_directed = static_cast<int>(edge_total);
-            
-            // Calculate main component
-            std::unordered_map<int, int> comp_counts;
-            for (const auto &[node_id, comp_id] : node_component)
+            for (const auto &s : request_body.value("move", json::array()))
             {
-                if (comp_id > 0)
+                Student moved = student_from_json(*snapshot, s);
+                const auto it = student_index.find(moved.student_id);
+                if (!s.contains("category") && it != student_index.end())
                 {
-                    comp_counts[comp_id]++;
+                    moved.category = students[it->second].category;
                 }
+                delta.moved.push_back(moved);
             }
-            g_graph_stats.component_count = static_cast<int>(comp_counts.size());
-            
-            int max_comp_size = 0;
-            for (const auto &[comp_id, count] : comp_counts)
+            for (const auto &id : request_body.value("remove", json::array()))
             {
-                if (count > max_comp_size)
-                {
-                    max_comp_size = count;
-                    g_graph_stats.main_component_id = comp_id;
-                    g_graph_stats.main_component_nodes = count;
-                }
+                delta.removed.push_back(id.get<std::string>());
+            }
+            for (const auto &change : request_body.value("capacity", json::array()))
+            {
+                delta.capacity_changes.push_back({change.value("centre_id", ""), change.value("max_capacity", 0)});
+            }
+            const auto snap_end = std::chrono::high_resolution_clock::now();
+
+            const AllotmentDeltaStats stats = apply_allotment_delta(*snapshot, delta);
+            const auto end = std::chrono::high_resolution_clock::now();
+
+            json changed = json::object();
+            for (const auto &student_id : stats.changed_students)
+            {
+                const auto it = final_assignments.find(student_id);
+                changed[student_id] = it != final_assignments.end() ? json(it->second) : json();
             }
 
             json response;
             response["status"] = "success";
-            response["nodes_count"] = nodes.size();
-            response["edges_count"] = edge_total;
+            response["changes"] = {
+                {"added", stats.added},
+                {"removed", stats.removed},
+                {"moved", stats.moved},
+                {"capacity_changes", stats.capacity_changes},
+                {"evictions", stats.evictions},
+                {"relocations", stats.relocations},
+                {"cascade_limit_hits", stats.cascade_limit_hits}};
+            response["assignments"] = changed;
+            response["unknown_students"] = stats.unknown_students;
+            response["unknown_centres"] = stats.unknown_centres;
+            response["assigned_count"] = final_assignments.size();
+            response["total_students"] = students.size();
             response["timing"] = {
-                {"fetch_overpass_ms", fetch_ms},
-                {"build_graph_ms", build_ms},
-                {"build_kdtree_ms", kd_ms},
-                {"dijkstra_precompute_ms", dijkstra_ms},
-                {"total_ms", fetch_ms + build_ms + kd_ms + dijkstra_ms}};
+                {"snap_ms", std::chrono::duration_cast<std::chrono::microseconds>(snap_end - start).count() / 1000.0},
+                {"delta_ms", std::chrono::duration_cast<std::chrono::microseconds>(end - snap_end).count() / 1000.0}};
 
-            res.set_content(response.dump(), "application/json");
+            send_json(req, res, response);
         }
         catch (const std::exception &ex)
         {
@@ -696,13 +2607,23 @@ int main()
             res.set_content(error.dump(), "application/json");
         } });
 
-    server.Post("/run-allotment", [](const httplib::Request &req, httplib::Response &res)
+    server.Post("/scenarios", [](const httplib::Request &req, httplib::Response &res)
                 {
-        if (graph.empty() || nodes.empty())
+        std::lock_guard<std::mutex> lock(allotment_mutex);
+        const auto snapshot = current_snapshot(allotment_graph_id);
+        if (!ensure_graph_ready(allotment_graph_id, *snapshot, res))
+        {
+            return;
+        }
+        if (!ensure_allotment_current(*snapshot, res))
+        {
+            return;
+        }
+        if (students.empty())
         {
             json error;
             error["status"] = "error";
-            error["message"] = "Graph not built. Call /build-graph first.";
+            error["message"] = "No students loaded. Call /run-allotment first.";
             res.set_content(error.dump(), "application/json");
             return;
         }
@@ -710,38 +2631,275 @@ int main()
         try
         {
             const auto request_body = json::parse(req.body);
+            if (!ensure_allotment_graph(request_body.value("graph_id", allotment_graph_id), res))
+            {
+                return;
+            }
+            const auto start = std::chrono::high_resolution_clock::now();
 
-            const auto total_start = std::chrono::high_resolution_clock::now();
-            const auto snap_start = std::chrono::high_resolution_clock::now();
-            snap_students_to_graph(request_body["students"]);
-            const auto snap_end = std::chrono::high_resolution_clock::now();
+            // Scenarios already run in parallel, so each auction defaults to one thread.
+            std::vector<AllotmentScenario> scenarios;
+            for (const auto &spec : request_body.value("scenarios", json::array()))
+            {
+                AllotmentScenario scenario;
+                scenario.name = spec.value("name", "scenario_" + std::to_string(scenarios.size() + 1));
+                const std::string solver = spec.value("solver", std::string("greedy"));
+                if (!solver_from_name(solver, scenario.options.solver))
+                {
+                    json error;
+                    error["status"] = "error";
+                    error["message"] = "Unknown solver '" + solver + "' in scenario '" + scenario.name + "'.";
+                    res.set_content(error.dump(), "application/json");
+                    return;
+                }
+                scenario.options.lazy_candidates = spec.value("candidates", std::string("lazy")) != "eager";
+                scenario.options.voronoi_prepass = spec.value("prepass", std::string()) == "voronoi";
+                scenario.options.auction_epsilon = spec.value("auction_epsilon", scenario.options.auction_epsilon);
+                scenario.options.threads = spec.value("threads", 1u);
+                scenario.options.rules = rules_from_json(spec);
+                for (const auto &change : spec.value("capacity", json::array()))
+                {
+                    scenario.capacity_changes.push_back({change.value("centre_id", ""), change.value("max_capacity", 0)});
+                }
+                for (const auto &centre_id : spec.value("close", json::array()))
+                {
+                    scenario.closed_centres.push_back(centre_id.get<std::string>());
+                }
+                scenarios.push_back(std::move(scenario));
+            }
 
-            // Dijkstra already computed in /build-graph - no need to re-run
-            std::cout << "\n🎯 Using pre-computed Dijkstra distances from /build-graph..." << std::endl;
+            const std::vector<ScenarioOutcome> outcomes = run_scenarios(*snapshot, scenarios, request_body.value("threads", 0u));
+            const auto end = std::chrono::high_resolution_clock::now();
 
-            const auto allot_start = std::chrono::high_resolution_clock::now();
-            run_batch_greedy_allotment();
-            const auto allot_end = std::chrono::high_resolution_clock::now();
-            const auto total_end = std::chrono::high_resolution_clock::now();
+            // One row per scenario, in request order, under a shared column list.
+            json rows = json::array();
+            json unknown_centres = json::object();
+            for (const auto &outcome : outcomes)
+            {
+                const AllotmentSummary &summary = outcome.summary;
+                rows.push_back({outcome.name,
+                                summary.solver,
+                                outcome.open_centres,
+                                outcome.seats,
+                                summary.assigned,
+                                static_cast<int>(students.size()) - summary.assigned,
+                                summary.travel_time,
+                                summary.assigned > 0 ? summary.travel_time / summary.assigned : 0.0,
+                                summary.max_travel_time,
+                                outcome.full_centres,
+                                summary.solve_ms});
+                if (!outcome.unknown_centres.empty())
+                {
+                    unknown_centres[outcome.name] = outcome.unknown_centres;
+                }
+            }
 
-            const auto snap_ms = std::chrono::duration_cast<std::chrono::milliseconds>(snap_end - snap_start).count();
-            const auto allot_ms = std::chrono::duration_cast<std::chrono::milliseconds>(allot_end - allot_start).count();
-            const auto total_ms = std::chrono::duration_cast<std::chrono::milliseconds>(total_end - total_start).count();
+            json response;
+            response["status"] = "success";
+            response["students"] = students.size();
+            response["columns"] = {"name", "solver", "open_centres", "seats", "assigned", "unassigned",
+                                   "total_travel_time_sec", "mean_travel_time_sec", "max_travel_time_sec",
+                                   "full_centres", "solve_ms"};
+            response["rows"] = rows;
+            response["unknown_centres"] = unknown_centres;
+            response["timing"] = {
+                {"total_ms", std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() / 1000.0}};
 
-            // Store timing for diagnostics
-            g_timings.snap_students_ms = snap_ms;
-            g_timings.allotment_ms = allot_ms;
+            send_json(req, res, response);
+        }
+        catch (const std::exception &ex)
+        {
+            json error;
+            error["status"] = "error";
+            error["message"] = ex.what();
+            res.set_content(error.dump(), "application/json");
+        } });
+
+    server.Post("/placement", [](const httplib::Request &req, httplib::Response &res)
+                {
+        try
+        {
+            const auto request_body = json::parse(req.body);
+            const std::string graph_id = request_body.value("graph_id", std::string(kDefaultGraphId));
+            const auto snapshot = current_snapshot(graph_id);
+            if (!ensure_graph_ready(graph_id, *snapshot, res))
+            {
+                return;
+            }
+            const auto start = std::chrono::high_resolution_clock::now();
+
+            std::vector<PlacementCandidate> candidates;
+            int unsnapped_candidates = 0;
+            for (const auto &site : request_body.value("candidates", json::array()))
+            {
+                PlacementCandidate candidate;
+                candidate.site_id = site.value("site_id", "site_" + std::to_string(candidates.size() + 1));
+                candidate.lat = site.value("lat", 0.0);
+                candidate.lon = site.value("lon", 0.0);
+                candidate.capacity = site.value("capacity", 0);
+                candidate.fixed_cost_sec = site.value("fixed_cost_sec", 0.0);
+                bool rescued = false;
+                candidate.snapped_node_id = snap_to_main_component(*snapshot, candidate.lat, candidate.lon, rescued);
+                if (candidate.snapped_node_id == -1)
+                {
+                    unsnapped_candidates++;
+                }
+                candidates.push_back(candidate);
+            }
+
+            // The student distribution is either sent with the request or
+            // taken from the students of the last /run-allotment.
+            std::vector<long> student_nodes;
+            if (request_body.contains("students"))
+            {
+                for (const auto &s : request_body["students"])
+                {
+                    bool rescued = false;
+                    student_nodes.push_back(snap_to_main_component(*snapshot, s.value("lat", 0.0), s.value("lon", 0.0), rescued));
+                }
+            }
+            else
+            {
+                std::lock_guard<std::mutex> lock(allotment_mutex);
+                for (const auto &student : students)
+                {
+                    student_nodes.push_back(student.snapped_node_id);
+                }
+            }
+            if (candidates.empty() || student_nodes.empty())
+            {
+                json error;
+                error["status"] = "error";
+                error["message"] = "Placement needs candidate sites and students.";
+                res.set_content(error.dump(), "application/json");
+                return;
+            }
+            const auto snap_end = std::chrono::high_resolution_clock::now();
+
+            PlacementOptions options;
+            options.sites = request_body.value("sites", options.sites);
+            options.max_travel_time_sec = request_body.value("max_travel_time_sec", options.max_travel_time_sec);
+            options.uncovered_penalty_sec = request_body.value("uncovered_penalty_sec", options.uncovered_penalty_sec);
+            options.max_swaps = request_body.value("max_swaps", options.max_swaps);
+            options.threads = request_body.value("threads", 0u);
+            const PlacementResult placement = optimise_centre_placement(*snapshot, candidates, student_nodes, options);
+            const auto end = std::chrono::high_resolution_clock::now();
+
+            json open_sites = json::array();
+            for (size_t k = 0; k < placement.open_sites.size(); k++)
+            {
+                const PlacementCandidate &site = candidates[placement.open_sites[k]];
+                open_sites.push_back({{"site_id", site.site_id},
+                                      {"lat", site.lat},
+                                      {"lon", site.lon},
+                                      {"capacity", site.capacity},
+                                      {"students", placement.site_students[k]}});
+            }
 
             json response;
             response["status"] = "success";
-            response["assignments"] = final_assignments;
-            response["debug_distances"] = build_debug_distances_payload();
+            response["open_sites"] = open_sites;
+            response["objective_sec"] = placement.objective;
+            response["greedy_objective_sec"] = placement.greedy_objective;
+            response["swaps"] = placement.swaps;
+            response["passes"] = placement.passes;
+            response["coverage"] = {
+                {"covered_students", placement.covered_students},
+                {"uncovered_students", placement.uncovered_students},
+                {"unreachable_students", placement.unreachable_students},
+                {"total_travel_time_sec", placement.travel_time},
+                {"mean_travel_time_sec", placement.covered_students > 0 ? placement.travel_time / placement.covered_students : 0.0},
+                {"max_travel_time_sec", placement.max_travel_time}};
+            if (placement.capacitated)
+            {
+                response["capacitated"] = {
+                    {"assigned", placement.capacitated_assigned},
+                    {"total_travel_time_sec", placement.capacitated_travel_time},
+                    {"capacity_shortfall", placement.capacity_shortfall}};
+            }
+            response["unsnapped_candidates"] = unsnapped_candidates;
+            response["demand_nodes"] = placement.demand_nodes;
+            response["distance_entries"] = placement.distance_entries;
             response["timing"] = {
-                {"snap_students_ms", snap_ms},
-                {"allotment_ms", allot_ms},
-                {"total_ms", total_ms}};
+                {"snap_ms", std::chrono::duration_cast<std::chrono::microseconds>(snap_end - start).count() / 1000.0},
+                {"distance_ms", placement.distance_ms},
+                {"greedy_ms", placement.greedy_ms},
+                {"swap_ms", placement.swap_ms},
+                {"total_ms", std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() / 1000.0}};
+
+            send_json(req, res, response);
+        }
+        catch (const std::exception &ex)
+        {
+            json error;
+            error["status"] = "error";
+            error["message"] = ex.what();
+            res.set_content(error.dump(), "application/json");
+        } });
+
+    // Nearest-centre labelling of the road network for the map overlay.
+    // ?stride=N returns every Nth node to keep large graphs light.
+    server.Get("/voronoi", [](const httplib::Request &req, httplib::Response &res)
+               {
+        const auto snapshot = current_snapshot(graph_id_param(req));
+        const VoronoiPartition &voronoi = snapshot->voronoi;
+        const DenseGraph &dense_graph = snapshot->dense_graph;
+        const std::vector<Centre> &centres = snapshot->centres;
+        if (voronoi.empty() || voronoi.nearest.size() != static_cast<size_t>(dense_graph.size()))
+        {
+            json error;
+            error["status"] = "error";
+            error["message"] = "No Voronoi partition. Call /build-graph with centres first.";
+            res.set_content(error.dump(), "application/json");
+            return;
+        }
+
+        try
+        {
+            const int stride = req.has_param("stride") ? std::max(1, std::stoi(req.get_param_value("stride"))) : 1;
+            const auto round_time = [](double time)
+            { return time == std::numeric_limits<double>::max() ? json() : json(std::round(time * 10.0) / 10.0); };
+
+            std::vector<int> cell_nodes(centres.size(), 0);
+            std::vector<double> cell_reach(centres.size(), 0.0);
+            json node_rows = json::array();
+            for (int n = 0; n < dense_graph.size(); n++)
+            {
+                const int nearest = voronoi.nearest[n];
+                if (nearest >= 0 && nearest < static_cast<int>(centres.size()))
+                {
+                    cell_nodes[nearest]++;
+                    cell_reach[nearest] = std::max(cell_reach[nearest], voronoi.nearest_time[n]);
+                }
+                if (n % stride != 0)
+                {
+                    continue;
+                }
+                const auto node_it = snapshot->nodes.find(dense_graph.node_ids[n]);
+                if (node_it == snapshot->nodes.end())
+                {
+                    continue;
+                }
+                // [lat, lon, nearest, time, runner_up, runner_up_time]
+                node_rows.push_back({node_it->second.lat, node_it->second.lon,
+                                     nearest, round_time(voronoi.nearest_time[n]),
+                                     voronoi.runner_up[n], round_time(voronoi.runner_up_time[n])});
+            }
+
+            json cells = json::array();
+            for (size_t c = 0; c < centres.size(); c++)
+            {
+                cells.push_back({{"centre_id", centres[c].centre_id},
+                                 {"nodes", cell_nodes[c]},
+                                 {"max_time_sec", cell_reach[c]}});
+            }
 
-            res.set_content(response.dump(), "application/json");
+            json response;
+            response["status"] = "success";
+            response["centres"] = cells;
+            response["stride"] = stride;
+            response["nodes"] = node_rows;
+            send_json(req, res, response);
         }
         catch (const std::exception &ex)
         {
@@ -751,21 +2909,87 @@ int main()
             res.set_content(error.dump(), "application/json");
         } });
 
-    server.Get("/export-diagnostics", [](const httplib::Request &, httplib::Response &res)
+    server.Get("/export-diagnostics", [](const httplib::Request &req, httplib::Response &res)
                {
-        if (graph.empty() || nodes.empty())
+        std::lock_guard<std::mutex> lock(allotment_mutex);
+        if (req.has_param("graph_id") && !ensure_allotment_graph(req.get_param_value("graph_id"), res))
+        {
+            return;
+        }
+        const auto snapshot = current_snapshot(allotment_graph_id);
+        if (!ensure_graph_ready(allotment_graph_id, *snapshot, res))
         {
-            json error;
-            error["status"] = "error";
-            error["message"] = "Graph not built. Call /build-graph first.";
-            res.set_content(error.dump(), "application/json");
             return;
         }
 
         try
         {
-            const auto diagnostics = collect_diagnostics();
-            res.set_content(diagnostics.dump(2), "application/json");
+            DiagnosticsOptions options;
+            const std::string format = req.has_param("format") ? req.get_param_value("format") : "json";
+            if (format != "json" && format != "ndjson")
+            {
+                throw std::runtime_error("format must be 'json' or 'ndjson'.");
+            }
+            options.ndjson = format == "ndjson";
+            options.compact = req.has_param("compact") && req.get_param_value("compact") != "0" && req.get_param_value("compact") != "false";
+            if (req.has_param("sections"))
+            {
+                options.summary = options.centres = options.students = false;
+                std::stringstream list(req.get_param_value("sections"));
+                std::string section;
+                while (std::getline(list, section, ','))
+                {
+                    if (section == "summary")
+                    {
+                        options.summary = true;
+                    }
+                    else if (section == "centres")
+                    {
+                        options.centres = true;
+                    }
+                    else if (section == "students")
+                    {
+                        options.students = true;
+                    }
+                    else
+                    {
+                        throw std::runtime_error("Unknown diagnostics section '" + section + "'; use summary, centres or students.");
+                    }
+                }
+            }
+
+            // Cheap unless the figures were invalidated since the last allotment.
+            if (!allotment_quality.valid || allotment_quality.best_time.size() != students.size())
+            {
+                rebuild_allotment_quality(*snapshot);
+            }
+            const auto stream = std::make_shared<DiagnosticsStream>(snapshot, options);
+            const bool ndjson = options.ndjson;
+            res.set_chunked_content_provider(ndjson ? "application/x-ndjson" : "application/json",
+                                             [stream, ndjson](size_t, httplib::DataSink &sink)
+                                             {
+                std::string chunk;
+                try
+                {
+                    if (!stream->next(chunk))
+                    {
+                        sink.done();
+                        return true;
+                    }
+                }
+                catch (const std::exception &ex)
+                {
+                    // Headers are already sent; NDJSON readers get an error
+                    // record, JSON readers a truncated document.
+                    std::cout << "Diagnostics export aborted: " << ex.what() << std::endl;
+                    if (ndjson)
+                    {
+                        const std::string record = json{{"type", "error"}, {"message", ex.what()}}.dump() + "\n";
+                        sink.write(record.data(), record.size());
+                    }
+                    return false;
+                }
+                return sink.write(chunk.data(), chunk.size()); });
         }
         catch (const std::exception &ex)
         {
@@ -775,26 +2999,72 @@ int main()
             res.set_content(error.dump(), "application/json");
         } });
 
+    // Route from a student to a centre. When the centre is one of the graph's
+    // centres (by node id or exact coordinates, or the assigned centre of
+    // ?student_id=) the route is walked along its stored path tree; other
+    // pairs, or builds without path trees, fall back to A*.
     server.Get("/get-path", [](const httplib::Request &req, httplib::Response &res)
                {
-        if (graph.empty() || nodes.empty())
-        {
-            json error;
-            error["status"] = "error";
-            error["message"] = "Graph not built. Call /build-graph first.";
-            res.set_content(error.dump(), "application/json");
-            return;
-        }
-
         try
         {
+            std::string graph_id = graph_id_param(req);
             std::vector<long> student_candidates;
             std::vector<long> centre_candidates;
+            int tree_centre = -1;
+            long tree_student_node = -1;
+            // Build the allotment was computed on, when routing one of its students.
+            std::uint64_t allotment_build = 0;
+
+            if (req.has_param("student_id"))
+            {
+                std::lock_guard<std::mutex> lock(allotment_mutex);
+                const std::string student_id = req.get_param_value("student_id");
+                const auto it = student_index.find(student_id);
+                if (it == student_index.end())
+                {
+                    throw std::runtime_error("Unknown student '" + student_id + "'.");
+                }
+                const int assigned = static_cast<size_t>(it->second) < student_assignment.size() ? student_assignment[it->second] : -1;
+                if (assigned < 0)
+                {
+                    throw std::runtime_error("Student '" + student_id + "' is not assigned to a centre.");
+                }
+                graph_id = allotment_graph_id;
+                allotment_build = allotment_build_id;
+                tree_centre = assigned;
+                tree_student_node = students[it->second].snapped_node_id;
+                student_candidates.push_back(tree_student_node);
+                centre_candidates.push_back(centres[assigned].snapped_node_id);
+            }
+
+            const auto snapshot = current_snapshot(graph_id);
+            if (!ensure_graph_ready(graph_id, *snapshot, res))
+            {
+                return;
+            }
+            if (allotment_build != 0 && snapshot->build_id != allotment_build)
+            {
+                throw std::runtime_error("Graph '" + graph_id + "' was rebuilt after the last allotment. Call /run-allotment again.");
+            }
+            const auto &graph_centres = snapshot->centres;
 
-            if (req.has_param("student_node_id") && req.has_param("centre_node_id"))
+            if (tree_centre >= 0)
+            {
+                // Resolved from the allotment above.
+            }
+            else if (req.has_param("student_node_id") && req.has_param("centre_node_id"))
             {
                 student_candidates.push_back(std::stol(req.get_param_value("student_node_id")));
                 centre_candidates.push_back(std::stol(req.get_param_value("centre_node_id")));
+                tree_student_node = student_candidates.front();
+                for (int c = 0; c < static_cast<int>(graph_centres.size()); c++)
+                {
+                    if (graph_centres[c].snapped_node_id == centre_candidates.front())
+                    {
+                        tree_centre = c;
+                        break;
+                    }
+                }
             }
             else if (req.has_param("student_lat") && req.has_param("student_lon") &&
                      req.has_param("centre_lat") && req.has_param("centre_lon"))
@@ -804,23 +3074,45 @@ int main()
                 const double centre_lat = std::stod(req.get_param_value("centre_lat"));
                 const double centre_lon = std::stod(req.get_param_value("centre_lon"));
 
-                student_candidates = find_k_nearest_nodes(student_lat, student_lon, 5);
-                centre_candidates = find_k_nearest_nodes(centre_lat, centre_lon, 5);
+                student_candidates = find_k_nearest_nodes(*snapshot, student_lat, student_lon, 5);
+                centre_candidates = find_k_nearest_nodes(*snapshot, centre_lat, centre_lon, 5);
+                for (int c = 0; c < static_cast<int>(graph_centres.size()); c++)
+                {
+                    if (graph_centres[c].lat == centre_lat && graph_centres[c].lon == centre_lon)
+                    {
+                        bool rescued = false;
+                        tree_centre = c;
+                        tree_student_node = snap_to_main_component(*snapshot, student_lat, student_lon, rescued);
+                        break;
+                    }
+                }
             }
             else
             {
                 throw std::runtime_error("Missing required parameters.");
             }
 
-            const auto astar_start = std::chrono::high_resolution_clock::now();
+            const auto route_start = std::chrono::high_resolution_clock::now();
             std::vector<long> best_path;
             bool found = false;
+            const DistanceTable &table = snapshot->distance_table;
+            if (tree_centre >= 0 && tree_centre < static_cast<int>(table.next_hop_by_centre.size()))
+            {
+                best_path = path_along_next_hops(snapshot->dense_graph, table.next_hop_by_centre[tree_centre],
+                                                 snapshot->dense_graph.index(tree_student_node));
+                found = !best_path.empty();
+            }
+            const bool from_path_tree = found;
 
             for (long student_node : student_candidates)
             {
+                if (found)
+                {
+                    break;
+                }
                 for (long centre_node : centre_candidates)
                 {
-                    auto path = a_star(student_node, centre_node);
+                    auto path = a_star(*snapshot, student_node, centre_node);
                     if (!path.empty())
                     {
                         best_path = std::move(path);
@@ -828,55 +3120,67 @@ int main()
                         break;
                     }
                 }
-                if (found)
-                {
-                    break;
-                }
             }
-            const auto astar_end = std::chrono::high_resolution_clock::now();
+            const auto route_end = std::chrono::high_resolution_clock::now();
 
             json response;
             response["status"] = "success";
 
             json path_coords = json::array();
+            for (const auto &[lat, lon] : path_to_coordinates(*snapshot, best_path))
+            {
+                path_coords.push_back({lat, lon});
+            }
+
+            // Calculate actual travel time by summing edge weights (which are in seconds)
             double total_time_seconds = 0.0;
-            
-            for (size_t i = 0; i < best_path.size(); i++)
+            for (size_t i = 1; i < best_path.size(); i++)
             {
-                long node_id = best_path[i];
-                if (nodes.find(node_id) != nodes.end())
+                const auto prev_it = snapshot->graph.find(best_path[i - 1]);
+                if (prev_it == snapshot->graph.end())
                 {
-                    path_coords.push_back({nodes[node_id].lat, nodes[node_id].lon});
-                    
-                    // Calculate actual travel time by summing edge weights (which are in seconds)
-                    if (i > 0)
+                    continue;
+                }
+
+                // Graph structure: std::pair<long, double> = (neighbor_id, time_seconds)
+                for (const auto &neighbor : prev_it->second)
+                {
+                    if (neighbor.first == best_path[i])
                     {
-                        long prev_node = best_path[i - 1];
-                        if (graph.find(prev_node) != graph.end())
-                        {
-                            // Graph structure: std::pair<long, double> = (neighbor_id, time_seconds)
-                            for (const auto &neighbor : graph[prev_node])
-                            {
-                                if (neighbor.first == node_id)
-                                {
-                                    total_time_seconds += neighbor.second;
-                                    break;
-                                }
-                            }
-                        }
+                        total_time_seconds += neighbor.second;
+                        break;
                     }
                 }
             }
             
             response["path"] = path_coords;
+            response["method"] = from_path_tree ? "path_tree" : "astar";
             response["travel_time_seconds"] = total_time_seconds;
 
-            const auto astar_ms = std::chrono::duration_cast<std::chrono::milliseconds>(astar_end - astar_start).count();
+            const auto route_ms = std::chrono::duration_cast<std::chrono::milliseconds>(route_end - route_start).count();
             response["timing"] = {
-                {"astar_ms", astar_ms},
-                {"total_ms", astar_ms}};
+                {"astar_ms", from_path_tree ? 0 : route_ms},
+                {"route_ms", route_ms},
+                {"total_ms", route_ms}};
 
-            res.set_content(response.dump(), "application/json");
+            if (negotiate_encoding(req) == ResponseEncoding::Columnar)
+            {
+                const auto serialise_start = std::chrono::high_resolution_clock::now();
+                std::vector<double> lats, lons;
+                for (const auto &point : path_coords)
+                {
+                    lats.push_back(point[0].get<double>());
+                    lons.push_back(point[1].get<double>());
+                }
+                response.erase("path");
+                ColumnarWriter columns;
+                columns.add_json("meta", response);
+                columns.add_float64("lat", lats);
+                columns.add_float64("lon", lons);
+                send_encoded(res, columns.finish(), kColumnarContentType, serialise_start);
+                return;
+            }
+            send_json(req, res, response);
         }
         catch (const std::exception &ex)
         {
@@ -886,20 +3190,423 @@ int main()
             res.set_content(error.dump(), "application/json");
         } });
 
-    server.Post("/parallel-dijkstra", [](const httplib::Request &req, httplib::Response &res)
+    // Many student -> centre routes on the current allotment's graph in one
+    // call: "pairs" of {student_id or lat/lon, centre_id}, or "centre_id"
+    // alone for every student assigned there. Pairs are grouped by centre so
+    // each centre grows one reverse search tree that all its students read
+    // their route from; the trees are grown in parallel.
+    server.Post("/paths", [](const httplib::Request &req, httplib::Response &res)
+                {
+        std::lock_guard<std::mutex> lock(allotment_mutex);
+        try
+        {
+            const auto total_start = std::chrono::high_resolution_clock::now();
+            const json request_body = json::parse(req.body);
+            const auto snapshot = current_snapshot(allotment_graph_id);
+            if (!ensure_graph_ready(allotment_graph_id, *snapshot, res))
+            {
+                return;
+            }
+            if (!ensure_allotment_current(*snapshot, res))
+            {
+                return;
+            }
+
+            json error;
+            error["status"] = "error";
+            std::unordered_map<std::string, int> centre_lookup;
+            for (int c = 0; c < static_cast<int>(centres.size()); c++)
+            {
+                centre_lookup[centres[c].centre_id] = c;
+            }
+
+            struct PathQuery
+            {
+                std::string student_id;
+                int centre = -1;
+                long student_node = -1;
+            };
+            std::vector<PathQuery> queries;
+            if (request_body.contains("pairs") && request_body["pairs"].is_array())
+            {
+                for (const auto &pair : request_body["pairs"])
+                {
+                    PathQuery query;
+                    const std::string centre_id = pair.value("centre_id", "");
+                    const auto centre_it = centre_lookup.find(centre_id);
+                    if (centre_it == centre_lookup.end())
+                    {
+                        error["message"] = "Unknown centre '" + centre_id + "'.";
+                        res.set_content(error.dump(), "application/json");
+                        return;
+                    }
+                    query.centre = centre_it->second;
+                    query.student_id = pair.value("student_id", "");
+                    if (pair.contains("lat") && pair.contains("lon"))
+                    {
+                        bool rescued = false;
+                        query.student_node = snap_to_main_component(*snapshot, pair["lat"].get<double>(), pair["lon"].get<double>(), rescued);
+                    }
+                    else
+                    {
+                        const auto student_it = student_index.find(query.student_id);
+                        if (student_it == student_index.end())
+                        {
+                            error["message"] = "Unknown student '" + query.student_id + "'. Pass lat/lon for students outside the allotment.";
+                            res.set_content(error.dump(), "application/json");
+                            return;
+                        }
+                        query.student_node = students[student_it->second].snapped_node_id;
+                    }
+                    queries.push_back(std::move(query));
+                }
+            }
+            else if (request_body.contains("centre_id"))
+            {
+                const std::string centre_id = request_body["centre_id"].get<std::string>();
+                const auto centre_it = centre_lookup.find(centre_id);
+                if (centre_it == centre_lookup.end())
+                {
+                    error["message"] = "Unknown centre '" + centre_id + "'.";
+                    res.set_content(error.dump(), "application/json");
+                    return;
+                }
+                for (size_t s = 0; s < students.size() && s < student_assignment.size(); s++)
+                {
+                    if (student_assignment[s] == centre_it->second)
+                    {
+                        queries.push_back({students[s].student_id, centre_it->second, students[s].snapped_node_id});
+                    }
+                }
+            }
+            else
+            {
+                error["message"] = "Pass \"pairs\" ([{\"student_id\", \"centre_id\"}, ...]) or \"centre_id\".";
+                res.set_content(error.dump(), "application/json");
+                return;
+            }
+
+            std::vector<std::vector<size_t>> queries_by_centre(centres.size());
+            for (size_t q = 0; q < queries.size(); q++)
+            {
+                queries_by_centre[queries[q].centre].push_back(q);
+            }
+            std::vector<int> searched_centres;
+            for (int c = 0; c < static_cast<int>(centres.size()); c++)
+            {
+                if (!queries_by_centre[c].empty())
+                {
+                    searched_centres.push_back(c);
+                }
+            }
+
+            const DenseGraph &dense = snapshot->dense_graph;
+            const DistanceTable &table = snapshot->distance_table;
+            std::vector<std::vector<std::pair<double, double>>> polylines(queries.size());
+            std::vector<double> travel_times(queries.size(), std::numeric_limits<double>::max());
+            const unsigned requested_threads = request_body.value("threads", 0u);
+            const unsigned workers = requested_threads > 0 ? std::min<unsigned>(requested_threads, std::max<size_t>(1, searched_centres.size()))
+                                                           : worker_count(searched_centres.size());
+            const auto search_start = std::chrono::high_resolution_clock::now();
+            parallel_for_ranges(searched_centres.size(), workers, [&](unsigned, size_t begin, size_t end)
+                                {
+                DenseSweep sweep;
+                std::vector<int> parents;
+                std::vector<int> targets;
+                for (size_t k = begin; k < end; k++)
+                {
+                    const int c = searched_centres[k];
+                    const std::vector<size_t> &group = queries_by_centre[c];
+                    targets.clear();
+                    for (const size_t q : group)
+                    {
+                        targets.push_back(dense.index(queries[q].student_node));
+                    }
+
+                    // Stored trees make every route a walk; builds without
+                    // them grow one tree per centre here instead.
+                    const std::vector<std::int32_t> *tree = &parents;
+                    if (table.has_path_trees())
+                    {
+                        tree = &table.next_hop_by_centre[c];
+                    }
+                    else
+                    {
+                        dijkstra_dense_tree(dense, dense.index(centres[c].snapped_node_id), true, targets, sweep, parents);
+                    }
+
+                    for (size_t t = 0; t < group.size(); t++)
+                    {
+                        const std::vector<long> route = path_along_next_hops(dense, *tree, targets[t]);
+                        if (route.empty())
+                        {
+                            continue;
+                        }
+                        travel_times[group[t]] = table.at(c, targets[t]);
+                        polylines[group[t]] = path_to_coordinates(*snapshot, route);
+                    }
+                } });
+            const auto search_end = std::chrono::high_resolution_clock::now();
+
+            json response;
+            response["status"] = "success";
+            response["paths"] = json::array();
+            int found = 0;
+            for (size_t q = 0; q < queries.size(); q++)
+            {
+                json entry;
+                entry["student_id"] = queries[q].student_id;
+                entry["centre_id"] = centres[queries[q].centre].centre_id;
+                entry["path"] = json::array();
+                for (const auto &[lat, lon] : polylines[q])
+                {
+                    entry["path"].push_back({lat, lon});
+                }
+                if (travel_times[q] != std::numeric_limits<double>::max())
+                {
+                    entry["travel_time_seconds"] = travel_times[q];
+                    found++;
+                }
+                else
                 {
-        if (graph.empty() || nodes.empty())
+                    entry["travel_time_seconds"] = nullptr;
+                }
+                response["paths"].push_back(std::move(entry));
+            }
+            response["found"] = found;
+            response["searches"] = table.has_path_trees() ? 0 : searched_centres.size();
+            response["threads"] = workers;
+            response["timing"] = {
+                {"search_ms", std::chrono::duration_cast<std::chrono::milliseconds>(search_end - search_start).count()},
+                {"total_ms", std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - total_start).count()}};
+            std::cout << "Computed " << found << "/" << queries.size() << " paths from " << searched_centres.size()
+                      << (table.has_path_trees() ? " stored" : " grown") << " centre path trees on " << workers << " threads." << std::endl;
+            send_json(req, res, response);
+        }
+        catch (const std::exception &ex)
         {
             json error;
             error["status"] = "error";
-            error["message"] = "Graph not built. Call /build-graph first.";
+            error["message"] = ex.what();
             res.set_content(error.dump(), "application/json");
-            return;
+        } });
+
+    // Every assigned route of the current allotment, one point tree per
+    // centre: routes are walked along the centre's path tree and stop at the
+    // first point already exported, so shared approaches are sent once.
+    // parent[i] is the next point towards the centre (-1 at the centre) and
+    // "students" maps each student to the point its route starts from.
+    server.Get("/export-routes", [](const httplib::Request &req, httplib::Response &res)
+               {
+        std::lock_guard<std::mutex> lock(allotment_mutex);
+        try
+        {
+            const auto total_start = std::chrono::high_resolution_clock::now();
+            const auto snapshot = current_snapshot(allotment_graph_id);
+            if (!ensure_graph_ready(allotment_graph_id, *snapshot, res))
+            {
+                return;
+            }
+            if (!ensure_allotment_current(*snapshot, res))
+            {
+                return;
+            }
+
+            const std::string only_centre = req.has_param("centre_id") ? req.get_param_value("centre_id") : "";
+            std::vector<std::vector<size_t>> students_by_centre(centres.size());
+            for (size_t s = 0; s < students.size() && s < student_assignment.size(); s++)
+            {
+                const int c = student_assignment[s];
+                if (c >= 0 && (only_centre.empty() || centres[c].centre_id == only_centre))
+                {
+                    students_by_centre[c].push_back(s);
+                }
+            }
+            std::vector<int> exported_centres;
+            for (int c = 0; c < static_cast<int>(centres.size()); c++)
+            {
+                if (!students_by_centre[c].empty())
+                {
+                    exported_centres.push_back(c);
+                }
+            }
+            if (!only_centre.empty() && exported_centres.empty())
+            {
+                json error;
+                error["status"] = "error";
+                error["message"] = "No students are assigned to centre '" + only_centre + "'.";
+                res.set_content(error.dump(), "application/json");
+                return;
+            }
+
+            struct RouteTree
+            {
+                std::vector<std::pair<double, double>> points;
+                std::vector<int> parent;
+                std::vector<std::pair<size_t, int>> student_points;
+                std::vector<size_t> unreachable;
+                size_t route_points = 0;
+            };
+            const DenseGraph &dense = snapshot->dense_graph;
+            const DistanceTable &table = snapshot->distance_table;
+            std::vector<RouteTree> trees(exported_centres.size());
+            const unsigned workers = worker_count(exported_centres.size());
+            parallel_for_ranges(exported_centres.size(), workers, [&](unsigned, size_t begin, size_t end)
+                                {
+                DenseSweep sweep;
+                std::vector<int> parents;
+                std::vector<int> targets;
+                std::vector<int> chain;
+                std::vector<int> depth;
+                std::unordered_map<int, int> node_point;
+                const auto node_coordinates = [&](int index)
+                {
+                    const auto it = snapshot->nodes.find(dense.node_ids[index]);
+                    return it != snapshot->nodes.end() ? std::make_pair(it->second.lat, it->second.lon) : std::make_pair(0.0, 0.0);
+                };
+
+                for (size_t k = begin; k < end; k++)
+                {
+                    const int c = exported_centres[k];
+                    RouteTree &out = trees[k];
+                    targets.clear();
+                    for (const size_t s : students_by_centre[c])
+                    {
+                        targets.push_back(dense.index(students[s].snapped_node_id));
+                    }
+                    const int root = dense.index(centres[c].snapped_node_id);
+                    const std::vector<std::int32_t> *tree = &parents;
+                    if (table.has_path_trees())
+                    {
+                        tree = &table.next_hop_by_centre[c];
+                    }
+                    else if (root >= 0)
+                    {
+                        dijkstra_dense_tree(dense, root, true, targets, sweep, parents);
+                    }
+                    const std::vector<std::int32_t> &next_hop = *tree;
+
+                    node_point.clear();
+                    depth.clear();
+                    if (root >= 0 && root < static_cast<int>(next_hop.size()) && next_hop[root] == root)
+                    {
+                        node_point[root] = 0;
+                        out.points.push_back(node_coordinates(root));
+                        out.parent.push_back(-1);
+                        depth.push_back(1);
+                    }
+
+                    for (size_t t = 0; t < targets.size(); t++)
+                    {
+                        const size_t s = students_by_centre[c][t];
+                        int node = targets[t];
+                        if (node_point.empty() || node < 0 || node >= static_cast<int>(next_hop.size()) || next_hop[node] < 0)
+                        {
+                            out.unreachable.push_back(s);
+                            continue;
+                        }
+
+                        // Walk until the route meets the exported tree, then
+                        // append the new stretch from that point outwards.
+                        chain.clear();
+                        while (node_point.find(node) == node_point.end())
+                        {
+                            chain.push_back(node);
+                            node = next_hop[node];
+                        }
+                        for (size_t i = chain.size(); i-- > 0;)
+                        {
+                            const int from = chain[i];
+                            const int to = i + 1 < chain.size() ? chain[i + 1] : node;
+                            int parent = node_point[to];
+                            const auto shape_it = snapshot->edge_shapes.find({dense.node_ids[from], dense.node_ids[to]});
+                            if (shape_it != snapshot->edge_shapes.end())
+                            {
+                                // Shape points run from -> to, so add them backwards.
+                                for (std::uint32_t p = shape_it->second.count; p-- > 0;)
+                                {
+                                    out.points.push_back(snapshot->edge_shape_points[shape_it->second.offset + p]);
+                                    out.parent.push_back(parent);
+                                    depth.push_back(depth[parent] + 1);
+                                    parent = static_cast<int>(out.points.size()) - 1;
+                                }
+                            }
+                            out.points.push_back(node_coordinates(from));
+                            out.parent.push_back(parent);
+                            depth.push_back(depth[parent] + 1);
+                            node_point[from] = static_cast<int>(out.points.size()) - 1;
+                        }
+                        const int start = node_point[targets[t]];
+                        out.student_points.push_back({s, start});
+                        out.route_points += depth[start];
+                    }
+                } });
+
+            json response;
+            response["status"] = "success";
+            response["revision"] = allotment_revision;
+            response["centres"] = json::array();
+            json unreachable = json::array();
+            size_t routes = 0;
+            size_t tree_points = 0;
+            size_t route_points = 0;
+            for (size_t k = 0; k < exported_centres.size(); k++)
+            {
+                const RouteTree &tree = trees[k];
+                json entry;
+                entry["centre_id"] = centres[exported_centres[k]].centre_id;
+                entry["points"] = json::array();
+                for (const auto &[lat, lon] : tree.points)
+                {
+                    entry["points"].push_back({lat, lon});
+                }
+                entry["parent"] = tree.parent;
+                entry["students"] = json::object();
+                for (const auto &[s, point] : tree.student_points)
+                {
+                    entry["students"][students[s].student_id] = point;
+                }
+                for (const size_t s : tree.unreachable)
+                {
+                    unreachable.push_back(students[s].student_id);
+                }
+                routes += tree.student_points.size();
+                tree_points += tree.points.size();
+                route_points += tree.route_points;
+                response["centres"].push_back(std::move(entry));
+            }
+            response["unreachable"] = std::move(unreachable);
+            response["stats"] = {
+                {"routes", routes},
+                {"tree_points", tree_points},
+                {"route_points", route_points},
+                {"path_trees", table.has_path_trees() ? "stored" : "grown"},
+                {"threads", workers}};
+            response["timing"] = {
+                {"total_ms", std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - total_start).count()}};
+            std::cout << "Exported " << routes << " routes as " << tree_points << " points (" << route_points
+                      << " unshared) for " << exported_centres.size() << " centres." << std::endl;
+            send_json(req, res, response);
         }
+        catch (const std::exception &ex)
+        {
+            json error;
+            error["status"] = "error";
+            error["message"] = ex.what();
+            res.set_content(error.dump(), "application/json");
+        } });
 
+    server.Post("/parallel-dijkstra", [](const httplib::Request &req, httplib::Response &res)
+                {
         try
         {
             const auto body = json::parse(req.body);
+            const std::string graph_id = body.value("graph_id", std::string(kDefaultGraphId));
+            const auto snapshot = current_snapshot(graph_id);
+            if (!ensure_graph_ready(graph_id, *snapshot, res))
+            {
+                return;
+            }
             const std::string workflow_name = body.value("workflow_name", "Parallel_Dijkstra");
             const std::string workflow_type = body.value("workflow_type", "parallel");
             const bool save_to_files = body.value("save_to_files", false);
@@ -908,12 +3615,13 @@ int main()
             const auto start_time = std::chrono::high_resolution_clock::now();
 
             std::vector<std::future<DijkstraResult>> futures;
+            const std::vector<Centre> &centres = snapshot->centres;
             futures.reserve(centres.size());
 
             const auto parallel_start = std::chrono::high_resolution_clock::now();
             for (const auto &centre : centres)
             {
-                futures.push_back(std::async(std::launch::async, run_dijkstra_for_centre, std::ref(centre)));
+                futures.push_back(std::async(std::launch::async, run_dijkstra_for_centre, std::cref(snapshot->graph), std::cref(centre)));
             }
 
             std::vector<DijkstraResult> results;
@@ -997,8 +3705,8 @@ int main()
                 {"speedup", speedup}};
             response["performance_metrics"] = {
                 {"num_threads_used", centres.size()},
-                {"nodes_in_graph", nodes.size()},
-                {"edges_in_graph", graph.size()}};
+                {"nodes_in_graph", snapshot->nodes.size()},
+                {"edges_in_graph", snapshot->graph.size()}};
 
             res.set_content(response.dump(2), "application/json");
         }
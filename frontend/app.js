@@ -85,12 +85,18 @@ function enableCentreSelection() {
 function addCentre(lat, lon) {
   const centreId = `centre_${centres.length + 1}`;
   const capacity = parseInt(document.getElementById("centreCapacity").value);
+  const wheelchairAccess = document.getElementById(
+    "centreWheelchairToggle"
+  ).checked;
+  const femaleOnly = document.getElementById("centreFemaleOnlyToggle").checked;
 
   const centre = {
     centre_id: centreId,
     lat: lat,
     lon: lon,
     max_capacity: capacity,
+    has_wheelchair_access: wheelchairAccess,
+    is_female_only: femaleOnly,
   };
 
   centres.push(centre);
@@ -109,6 +115,9 @@ function addCentre(lat, lon) {
   marker.bindPopup(`
         <strong>${centreId}</strong><br>
         Capacity: ${capacity}<br>
+        Wheelchair accessible: ${wheelchairAccess ? "Yes" : "No"}<br>
+        Female only: ${femaleOnly ? "Yes" : "No"}<br>
+        <button onclick="showCentrePaths('${centreId}')">Show All Routes</button>
     `);
 
   centreMarkers.push(marker);
@@ -166,7 +175,8 @@ async function buildGraph() {
 
     console.log("Sending build-graph request:", payload);
 
-    const response = await fetch(`${API_BASE_URL}/build-graph`, {
+    // The build runs as a background job; its stages stream back over SSE.
+    const response = await fetch(`${API_BASE_URL}/jobs/build-graph`, {
       method: "POST",
       headers: {
         "Content-Type": "application/json",
@@ -174,7 +184,8 @@ async function buildGraph() {
       body: JSON.stringify(payload),
     });
 
-    const data = await response.json();
+    const job = await response.json();
+    const data = job.status === "success" ? await waitForBuildJob(job) : job;
 
     if (data.status === "success") {
       graphBuilt = true;
@@ -213,6 +224,42 @@ async function buildGraph() {
   }
 }
 
+// Follows a build job's progress events until it finishes, showing the
+// current stage in the loader. Resolves with the /build-graph response.
+function waitForBuildJob(job) {
+  return new Promise((resolve) => {
+    const events = new EventSource(`${API_BASE_URL}${job.events_url}`);
+
+    events.addEventListener("progress", (e) => {
+      const event = JSON.parse(e.data);
+      showLoader(
+        `Building graph: ${event.stage.replace("_", " ")} (${event.percent}%)`
+      );
+    });
+
+    const finish = (e) => {
+      events.close();
+      const event = JSON.parse(e.data);
+      resolve(
+        event.state === "succeeded"
+          ? event.result
+          : { status: "error", message: event.message }
+      );
+    };
+    events.addEventListener("succeeded", finish);
+    events.addEventListener("failed", finish);
+    events.addEventListener("cancelled", finish);
+
+    events.onerror = () => {
+      events.close();
+      resolve({
+        status: "error",
+        message: `Lost connection to build job ${job.job_id}`,
+      });
+    };
+  });
+}
+
 function simulateStudents() {
   const count = parseInt(document.getElementById("studentCount").value);
 
@@ -360,7 +407,7 @@ async function runAllotment() {
 
     if (data.status === "success") {
       assignments = data.assignments;
-      debugDistances = data.debug_distances;
+      debugDistances = {};
       visualizeAssignments();
 
       const assignedCount = Object.keys(assignments).length;
@@ -406,8 +453,6 @@ function visualizeAssignments() {
 
   students.forEach((student, index) => {
     const assignedCentreId = assignments[student.student_id];
-    const studentDistances = debugDistances[student.student_id] || {}; // Get this student's debug data
-
     let markerColor = "#6b7280";
     let popupContent = `
       <strong>${student.student_id}</strong><br>
@@ -424,45 +469,77 @@ function visualizeAssignments() {
       popupContent += "<strong>Status: Unassigned</strong>";
     }
 
-    let debugTable = `
+    studentMarkers[index].setStyle({
+      fillColor: markerColor,
+      fillOpacity: 0.9,
+      radius: 5,
+    });
+
+    studentMarkers[index].bindPopup(popupContent + distanceTable(null));
+    studentMarkers[index].off("popupopen");
+    studentMarkers[index].on("popupopen", (event) =>
+      loadStudentDistances(student.student_id, event.popup, popupContent)
+    );
+  });
+
+  updateStats();
+}
+
+// Travel times are fetched per student when a popup opens, instead of
+// shipping every student's distances with the allotment response.
+async function loadStudentDistances(studentId, popup, popupContent) {
+  if (!debugDistances[studentId]) {
+    try {
+      const response = await fetch(
+        `${API_BASE_URL}/debug-distances?student_id=${encodeURIComponent(
+          studentId
+        )}&fields=distances`
+      );
+      const data = await response.json();
+      if (data.status !== "success") {
+        return;
+      }
+      debugDistances[studentId] = data.students[0].distances;
+    } catch (error) {
+      console.error("Error loading travel times:", error);
+      return;
+    }
+  }
+  popup.setContent(popupContent + distanceTable(debugDistances[studentId]));
+}
+
+function distanceTable(studentDistances) {
+  let debugTable = `
       <hr style="margin: 5px 0;">
       <strong>Travel Time:</strong>
       <table style="width: 100%; font-size: 0.8em;">
     `;
 
-    centres.forEach((centre, i) => {
-      const timeSeconds = studentDistances[centre.centre_id];
-      const color = centreColors[i % centreColors.length];
-
-      let timeText = "N/A";
-      if (timeSeconds === Infinity || (timeSeconds && timeSeconds > 9000000)) {
-        timeText = "<strong>Unreachable</strong>";
-      } else if (timeSeconds != null) {
-        const minutes = Math.floor(timeSeconds / 60);
-        const seconds = Math.floor(timeSeconds % 60);
-        timeText = `${minutes}m ${seconds}s`;
-      }
+  if (!studentDistances) {
+    return debugTable + "<tr><td>Loading...</td></tr></table>";
+  }
+
+  centres.forEach((centre, i) => {
+    const timeSeconds = studentDistances[centre.centre_id];
+    const color = centreColors[i % centreColors.length];
+
+    let timeText = "N/A";
+    if (timeSeconds === Infinity || (timeSeconds && timeSeconds > 9000000)) {
+      timeText = "<strong>Unreachable</strong>";
+    } else if (timeSeconds != null) {
+      const minutes = Math.floor(timeSeconds / 60);
+      const seconds = Math.floor(timeSeconds % 60);
+      timeText = `${minutes}m ${seconds}s`;
+    }
 
-      debugTable += `
+    debugTable += `
         <tr>
           <td><span class="legend-color" style="background-color:${color}"></span> ${centre.centre_id}</td>
           <td style="text-align: right;">${timeText}</td>
         </tr>
       `;
-    });
-    debugTable += "</table>";
-    popupContent += debugTable;
-
-    studentMarkers[index].setStyle({
-      fillColor: markerColor,
-      fillOpacity: 0.9,
-      radius: 5,
-    });
-
-    studentMarkers[index].bindPopup(popupContent);
   });
-
-  updateStats();
+  return debugTable + "</table>";
 }
 
 async function showPath(studentId, centreId) {
@@ -506,9 +583,11 @@ async function showPath(studentId, centreId) {
 
       if (data.timing) {
         document.getElementById("statAStarTime").textContent =
-          data.timing.astar_ms + " ms";
+          data.timing.route_ms +
+          " ms" +
+          (data.method === "path_tree" ? " (path tree)" : "");
 
-        console.log("A* timing:", data.timing);
+        console.log("Path timing:", data.method, data.timing);
       }
 
       let travelMsg = `Path found with ${data.path.length} points!`;
@@ -535,6 +614,58 @@ async function showPath(studentId, centreId) {
   }
 }
 
+// Every assigned student's route to one centre, fetched in a single
+// /paths request instead of one /get-path call per student.
+async function showCentrePaths(centreId) {
+  if (Object.keys(assignments).length === 0) {
+    alert("Please run the allotment first!");
+    return;
+  }
+
+  showLoader("Finding routes to " + centreId + "...");
+
+  try {
+    const response = await fetch(`${API_BASE_URL}/paths`, {
+      method: "POST",
+      headers: {
+        "Content-Type": "application/json",
+      },
+      body: JSON.stringify({ centre_id: centreId }),
+    });
+    const data = await response.json();
+    hideLoader();
+
+    if (data.status !== "success") {
+      alert("Error finding routes: " + data.message);
+      return;
+    }
+
+    pathLayers.forEach((layer) => map.removeLayer(layer));
+    pathLayers = [];
+
+    const index = centres.findIndex((c) => c.centre_id === centreId);
+    const color = centreColors[Math.max(index, 0) % centreColors.length];
+    data.paths.forEach((route) => {
+      if (route.path.length > 0) {
+        pathLayers.push(
+          L.polyline(route.path, { color: color, weight: 2, opacity: 0.7 }).addTo(map)
+        );
+      }
+    });
+
+    if (pathLayers.length > 0) {
+      map.fitBounds(L.featureGroup(pathLayers).getBounds());
+    }
+    console.log(
+      `Drew ${data.found} routes to ${centreId} in ${data.timing.total_ms} ms`
+    );
+  } catch (error) {
+    hideLoader();
+    alert("Failed to get routes. Check backend server.");
+    console.error("Error:", error);
+  }
+}
+
 //UI
 
 function updateStats() {